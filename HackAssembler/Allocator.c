@@ -0,0 +1,49 @@
+#include "Allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// constants
+const Allocator default_allocator = {
+    .alloc = std_alloc, .realloc = std_realloc, .free = std_free, .ctx = NULL};
+
+void *mem_alloc(const Allocator *allocator, size_t size) {
+    return allocator->alloc(size, allocator->ctx);
+}
+
+void *mem_calloc(const Allocator *allocator, size_t num, size_t size) {
+    if (size != 0 && num > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = allocator->alloc(num*size, allocator->ctx);
+    if (ptr) {
+        memset(ptr, 0, num*size);
+    }
+    return ptr;
+}
+
+void *mem_realloc(const Allocator *allocator, void *ptr, size_t size) {
+    return allocator->realloc(ptr, size, allocator->ctx);
+}
+
+void mem_free(const Allocator *allocator, void *ptr) {
+    if (ptr) {
+        allocator->free(ptr, allocator->ctx);
+    }
+}
+
+void *std_alloc(size_t size, void *ctx) {
+    (void)ctx;
+    return malloc(size);
+}
+
+void *std_realloc(void *ptr, size_t size, void *ctx) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+void std_free(void *ptr, void *ctx) {
+    (void)ctx;
+    free(ptr);
+}
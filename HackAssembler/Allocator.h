@@ -0,0 +1,45 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+// data types
+
+// memory allocator supplied by the caller, all the memory of an assembly is
+// taken from it. Each function gets the ctx of the allocator, and returns NULL
+// when no memory is left
+typedef struct Allocator {
+    void *(*alloc)(size_t size, void *ctx);
+    void *(*realloc)(void *ptr, size_t size, void *ctx);
+    void (*free)(void *ptr, void *ctx);
+    void *ctx;
+} Allocator;
+
+
+// constants
+
+// allocator using malloc, realloc and free
+extern const Allocator default_allocator;
+
+
+// functions
+
+// allocates size bytes from the allocator
+void *mem_alloc(const Allocator *allocator, size_t size);
+
+// allocates num elements of size bytes from the allocator, set to zero
+void *mem_calloc(const Allocator *allocator, size_t num, size_t size);
+
+// resizes the memory at ptr, which may be NULL, to size bytes, returns NULL
+// leaving ptr unchanged on failure
+void *mem_realloc(const Allocator *allocator, void *ptr, size_t size);
+
+// frees the memory at ptr, which may be NULL
+void mem_free(const Allocator *allocator, void *ptr);
+
+// functions of the default allocator
+void *std_alloc(size_t size, void *ctx);
+void *std_realloc(void *ptr, size_t size, void *ctx);
+void std_free(void *ptr, void *ctx);
+
+#endif
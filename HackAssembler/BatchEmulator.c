@@ -0,0 +1,427 @@
+#include "BatchEmulator.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "HackAssembler.h"
+
+// constants
+const uint16_t halted_pc = 0x8000;
+
+BatchEmulator *new_batch_emulator(const Allocator *allocator,
+        size_t num_instances) {
+    if (!allocator) {
+        allocator = &default_allocator;
+    }
+    if (num_instances == 0 || num_instances > UINT32_MAX
+            || num_instances > SIZE_MAX / ram_size / sizeof(uint16_t)) {
+        return NULL;
+    }
+    BatchEmulator *be = mem_calloc(allocator, 1, sizeof(*be));
+    if (!be) {
+        return NULL;
+    }
+    be->allocator = allocator;
+    be->num_instances = num_instances;
+    be->ops = mem_alloc(allocator, rom_size*sizeof(*be->ops));
+    be->ram = mem_alloc(allocator, ram_size*num_instances*sizeof(*be->ram));
+    be->a = mem_alloc(allocator, num_instances*sizeof(*be->a));
+    be->d = mem_alloc(allocator, num_instances*sizeof(*be->d));
+    be->pc = mem_alloc(allocator, num_instances*sizeof(*be->pc));
+    be->cycles = mem_alloc(allocator, num_instances*sizeof(*be->cycles));
+    be->halt_reasons = mem_alloc(allocator,
+            num_instances*sizeof(*be->halt_reasons));
+    if (!be->ops || !be->ram || !be->a || !be->d || !be->pc || !be->cycles
+            || !be->halt_reasons) {
+        delete_batch_emulator(be);
+        return NULL;
+    }
+    load_batch_program(be, NULL, 0);
+    return be;
+}
+
+void delete_batch_emulator(BatchEmulator *be) {
+    if (!be) {
+        return;
+    }
+    mem_free(be->allocator, be->ops);
+    mem_free(be->allocator, be->ram);
+    mem_free(be->allocator, be->a);
+    mem_free(be->allocator, be->d);
+    mem_free(be->allocator, be->pc);
+    mem_free(be->allocator, be->cycles);
+    mem_free(be->allocator, be->halt_reasons);
+    mem_free(be->allocator, be);
+}
+
+bool load_batch_program(BatchEmulator *be, const uint16_t *words,
+        size_t num_words) {
+    if (num_words > rom_size) {
+        return false;
+    }
+    decode_program(be->ops, words, num_words);
+    be->num_words = num_words;
+    reset_batch(be);
+    return true;
+}
+
+void reset_batch(BatchEmulator *be) {
+    size_t n = be->num_instances;
+    memset(be->ram, 0, ram_size*n*sizeof(*be->ram));
+    memset(be->a, 0, n*sizeof(*be->a));
+    memset(be->d, 0, n*sizeof(*be->d));
+    memset(be->pc, 0, n*sizeof(*be->pc));
+    memset(be->cycles, 0, n*sizeof(*be->cycles));
+    memset(be->halt_reasons, 0, n*sizeof(*be->halt_reasons));
+    be->num_steps = 0;
+}
+
+uint16_t *batch_ram_word(BatchEmulator *be, size_t instance, size_t addr) {
+    return &be->ram[addr*be->num_instances + instance];
+}
+
+bool run_batch(BatchEmulator *be, uint64_t max_cycles, long num_threads) {
+    size_t n = be->num_instances;
+    if (num_threads < 1) {
+        num_threads = 1;
+    } else if ((size_t)num_threads > n) {
+        num_threads = n;
+    }
+    BatchWorker *workers = mem_calloc(be->allocator, num_threads,
+            sizeof(*workers));
+    if (!workers) {
+        return false;
+    }
+    for (long i = 0; i < num_threads; ++i) {
+        workers[i] = (BatchWorker) {.be = be, .first = i*n/num_threads,
+            .end = (i + 1)*n/num_threads, .max_cycles = max_cycles};
+    }
+    // no need for threads with a single worker
+    pthread_t *threads = num_threads > 1
+        ? mem_alloc(be->allocator, num_threads*sizeof(*threads)) : NULL;
+    long num_started = 0;
+    while (threads && num_started < num_threads
+            && !pthread_create(&threads[num_started], NULL, run_batch_worker,
+                &workers[num_started])) {
+        ++num_started;
+    }
+    for (long i = num_started; i < num_threads; ++i) { // could not start
+        run_batch_worker(&workers[i]);
+    }
+    for (long i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    mem_free(be->allocator, threads);
+    bool success = true;
+    be->num_steps = 0;
+    for (long i = 0; i < num_threads; ++i) {
+        be->num_steps += workers[i].num_steps;
+        success &= !workers[i].out_of_memory;
+    }
+    mem_free(be->allocator, workers);
+    return success;
+}
+
+void *run_batch_worker(void *worker_ptr) {
+    BatchWorker *worker = worker_ptr;
+    BatchEmulator *be = worker->be;
+    const Allocator *allocator = be->allocator;
+    size_t num_lanes = worker->end - worker->first;
+    worker->group_at = mem_alloc(allocator,
+            rom_size*sizeof(*worker->group_at));
+    worker->out = mem_alloc(allocator, num_lanes*sizeof(*worker->out));
+    worker->next_pc = mem_alloc(allocator,
+            num_lanes*sizeof(*worker->next_pc));
+    worker->joined = mem_alloc(allocator, num_lanes*sizeof(*worker->joined));
+    worker->out_of_memory = !worker->group_at || !worker->out
+        || !worker->next_pc || !worker->joined;
+    if (!worker->out_of_memory) {
+        memset(worker->group_at, -1, rom_size*sizeof(*worker->group_at));
+        for (size_t i = worker->first; i < worker->end; ++i) {
+            if (!add_lane(worker, 0, i)) {
+                break;
+            }
+        }
+        worker->groups[0].dense = true;
+    }
+    while (worker->num_groups > 0 && !worker->out_of_memory) {
+        size_t group = 0;
+        for (size_t i = 1; i < worker->num_groups; ++i) {
+            if (worker->groups[i].pc < worker->groups[group].pc) {
+                group = i;
+            }
+        }
+        uint32_t others_pc = UINT32_MAX; // lowest pc of the other groups
+        for (size_t i = 0; i < worker->num_groups; ++i) {
+            if (i != group && worker->groups[i].pc < others_pc) {
+                others_pc = worker->groups[i].pc;
+            }
+        }
+        // runs the group on its own while it stays whole and behind the
+        // others, not looking for the lowest pc again
+        size_t num_groups = worker->num_groups;
+        do {
+            step_group(worker, group);
+        } while (worker->num_groups == num_groups && !worker->out_of_memory
+                && worker->groups[group].pc < others_pc);
+    }
+    for (size_t i = 0; i < worker->num_groups; ++i) {
+        mem_free(allocator, worker->groups[i].lanes);
+    }
+    mem_free(allocator, worker->groups);
+    mem_free(allocator, worker->group_at);
+    mem_free(allocator, worker->out);
+    mem_free(allocator, worker->next_pc);
+    mem_free(allocator, worker->joined);
+    return NULL;
+}
+
+// runs stmt for each lane k of a group, the instance lane, counting the
+// instances rather than reading them from the lanes of a dense group, so
+// that its loops are over consecutive words
+#define FOR_EACH_LANE(stmt) do { \
+        if (dense) { \
+            size_t lane = lanes[0]; \
+            for (size_t k = 0; k < num_lanes; ++k, ++lane) { \
+                stmt; \
+            } \
+        } else { \
+            for (size_t k = 0; k < num_lanes; ++k) { \
+                size_t lane = lanes[k]; \
+                stmt; \
+            } \
+        } \
+    } while (0)
+
+void step_group(BatchWorker *worker, size_t group) {
+    BatchEmulator *be = worker->be;
+    size_t n = be->num_instances;
+    uint16_t *ram = be->ram;
+    uint16_t *a = be->a;
+    uint16_t *d = be->d;
+    uint16_t *out = worker->out;
+    uint16_t *next_pc = worker->next_pc;
+    uint32_t *lanes = worker->groups[group].lanes;
+    size_t num_lanes = worker->groups[group].num_lanes;
+    uint16_t pc = worker->groups[group].pc;
+    uint16_t pc_plus_1 = (pc + 1) & addr_mask;
+    const EmulatorOp *op = &be->ops[pc];
+    uint64_t steps = ++worker->groups[group].steps;
+    ++worker->num_steps;
+    worker->group_at[pc] = -1; // moved below
+
+    bool dense = worker->groups[group].dense;
+    if (op->kind == OP_LOAD) {
+        FOR_EACH_LANE(a[lane] = op->value);
+    } else {
+        compute_group_alu(worker, &worker->groups[group], op);
+        // the jump target and M are at the A from before the op
+        if (op->jump) {
+            FOR_EACH_LANE(next_pc[k] = jump_target(be, op, out[k], lane,
+                        pc_plus_1));
+        }
+        if (op->dest & dest_m) {
+            FOR_EACH_LANE(ram[(a[lane] & addr_mask)*n + lane] = out[k]);
+        }
+        if (op->dest & dest_d) {
+            FOR_EACH_LANE(d[lane] = out[k]);
+        }
+        if (op->dest & dest_a) {
+            FOR_EACH_LANE(a[lane] = out[k]);
+        }
+    }
+    bool at_limit = steps == worker->groups[group].limit_steps;
+    if (!op->jump && !at_limit) { // the whole group goes on
+        move_group(worker, group, pc_plus_1);
+        return;
+    }
+    for (size_t k = 0; !op->jump && k < num_lanes; ++k) {
+        next_pc[k] = pc_plus_1;
+    }
+
+    // the lanes going where the first lane still running goes stay in the
+    // group, the others are added to the groups where they go
+    uint64_t max_cycles = worker->max_cycles;
+    uint64_t limit_steps = UINT64_MAX;
+    size_t num_kept = 0;
+    uint16_t kept_pc = halted_pc;
+    for (size_t k = 0; k < num_lanes; ++k) {
+        uint32_t lane = lanes[k];
+        uint64_t cycles = be->cycles[lane] + steps
+            - worker->joined[lane - worker->first];
+        if (next_pc[k] == halted_pc) {
+            be->cycles[lane] = cycles;
+        } else if (cycles == max_cycles) {
+            be->cycles[lane] = cycles;
+            be->pc[lane] = next_pc[k];
+            be->halt_reasons[lane] = HALT_CYCLE_LIMIT;
+        } else if (num_kept == 0 || next_pc[k] == kept_pc) {
+            kept_pc = next_pc[k];
+            lanes[num_kept++] = lane;
+            if (max_cycles && steps + max_cycles - cycles < limit_steps) {
+                limit_steps = steps + max_cycles - cycles;
+            }
+        } else {
+            be->cycles[lane] = cycles;
+            if (!add_lane(worker, next_pc[k], lane)) {
+                return;
+            }
+        }
+    }
+    worker->groups[group].dense &= num_kept == num_lanes;
+    worker->groups[group].num_lanes = num_kept;
+    worker->groups[group].limit_steps = limit_steps;
+    if (num_kept == 0) {
+        remove_group(worker, group);
+    } else {
+        move_group(worker, group, kept_pc);
+    }
+}
+
+uint16_t jump_target(BatchEmulator *be, const EmulatorOp *op, uint16_t out,
+        size_t lane, uint16_t pc_plus_1) {
+    uint8_t sign = (int16_t)out < 0 ? jump_lt : out ? jump_gt : jump_eq;
+    if (!(op->jump & sign)) {
+        return pc_plus_1;
+    } else if (op->halts) {
+        be->pc[lane] = be->a[lane] & addr_mask;
+        be->halt_reasons[lane] = HALT_LOOP;
+        return halted_pc;
+    }
+    return be->a[lane] & addr_mask;
+}
+
+// M register of the lane, the RAM word addressed by its A
+#define M ram[(a[lane] & addr_mask)*n + lane]
+#define A a[lane]
+#define D d[lane]
+
+// computes the output of every lane
+#define FOR_LANES(out_expr) FOR_EACH_LANE(out[k] = (out_expr))
+
+// sets the output of every lane to a constant
+#define FILL_LANES(value) do { \
+        for (size_t k = 0; k < num_lanes; ++k) { \
+            out[k] = (value); \
+        } \
+    } while (0)
+
+void compute_group_alu(BatchWorker *worker, const BatchGroup *group,
+        const EmulatorOp *op) {
+    const BatchEmulator *be = worker->be;
+    size_t n = be->num_instances;
+    const uint16_t *ram = be->ram;
+    const uint16_t *a = be->a;
+    const uint16_t *d = be->d;
+    uint16_t *out = worker->out;
+    const uint32_t *lanes = group->lanes;
+    size_t num_lanes = group->num_lanes;
+    bool dense = group->dense;
+    switch (op->kind) {
+        case COMP_0:         FILL_LANES(0); break;
+        case COMP_1:         FILL_LANES(1); break;
+        case COMP_NEG_1:     FILL_LANES(0xffff); break;
+        case COMP_D:         FOR_LANES(D); break;
+        case COMP_A:         FOR_LANES(A); break;
+        case COMP_M:         FOR_LANES(M); break;
+        case COMP_NOT_D:     FOR_LANES(~D); break;
+        case COMP_NOT_A:     FOR_LANES(~A); break;
+        case COMP_NOT_M:     FOR_LANES(~M); break;
+        case COMP_NEG_D:     FOR_LANES(-D); break;
+        case COMP_NEG_A:     FOR_LANES(-A); break;
+        case COMP_NEG_M:     FOR_LANES(-M); break;
+        case COMP_D_PLUS_1:  FOR_LANES(D + 1); break;
+        case COMP_A_PLUS_1:  FOR_LANES(A + 1); break;
+        case COMP_M_PLUS_1:  FOR_LANES(M + 1); break;
+        case COMP_D_MINUS_1: FOR_LANES(D - 1); break;
+        case COMP_A_MINUS_1: FOR_LANES(A - 1); break;
+        case COMP_M_MINUS_1: FOR_LANES(M - 1); break;
+        case COMP_D_PLUS_A:  FOR_LANES(D + A); break;
+        case COMP_D_PLUS_M:  FOR_LANES(D + M); break;
+        case COMP_D_MINUS_A: FOR_LANES(D - A); break;
+        case COMP_D_MINUS_M: FOR_LANES(D - M); break;
+        case COMP_A_MINUS_D: FOR_LANES(A - D); break;
+        case COMP_M_MINUS_D: FOR_LANES(M - D); break;
+        case COMP_D_AND_A:   FOR_LANES(D & A); break;
+        case COMP_D_AND_M:   FOR_LANES(D & M); break;
+        case COMP_D_OR_A:    FOR_LANES(D | A); break;
+        case COMP_D_OR_M:    FOR_LANES(D | M); break;
+        default:             FOR_LANES(compute_alu(op->comp, D, A, M));
+    }
+}
+
+#undef M
+#undef A
+#undef D
+#undef FOR_LANES
+#undef FILL_LANES
+#undef FOR_EACH_LANE
+
+bool add_lane(BatchWorker *worker, uint16_t pc, uint32_t lane) {
+    const Allocator *allocator = worker->be->allocator;
+    int32_t index = worker->group_at[pc];
+    if (index < 0) {
+        if (!grow_array(allocator, &worker->groups, worker->num_groups,
+                    &worker->groups_capacity, sizeof(*worker->groups))) {
+            worker->out_of_memory = true;
+            return false;
+        }
+        index = worker->num_groups++;
+        worker->groups[index] = (BatchGroup) {.pc = pc,
+            .limit_steps = UINT64_MAX};
+        worker->group_at[pc] = index;
+    }
+    BatchGroup *group = &worker->groups[index];
+    if (!grow_array(allocator, &group->lanes, group->num_lanes,
+                &group->capacity, sizeof(*group->lanes))) {
+        worker->out_of_memory = true;
+        return false;
+    }
+    group->lanes[group->num_lanes++] = lane;
+    group->dense = false;
+    worker->joined[lane - worker->first] = group->steps;
+    // the steps of the group at which the lane reaches the limit
+    uint64_t limit = group->steps + worker->max_cycles
+        - worker->be->cycles[lane];
+    if (worker->max_cycles && limit < group->limit_steps) {
+        group->limit_steps = limit;
+    }
+    return true;
+}
+
+void move_group(BatchWorker *worker, size_t group, uint16_t pc) {
+    BatchGroup *moved = &worker->groups[group];
+    int32_t other = worker->group_at[pc];
+    moved->pc = pc;
+    if (other < 0) {
+        worker->group_at[pc] = group;
+        return;
+    }
+    for (size_t k = 0; k < moved->num_lanes; ++k) {
+        uint32_t lane = moved->lanes[k];
+        worker->be->cycles[lane] += moved->steps
+            - worker->joined[lane - worker->first];
+        if (!add_lane(worker, pc, lane)) {
+            return;
+        }
+    }
+    remove_group(worker, group);
+    // the instances of a group holding all those of the worker can be put
+    // back in order, running its ops over consecutive words again
+    BatchGroup *merged = &worker->groups[worker->group_at[pc]];
+    if (merged->num_lanes == worker->end - worker->first) {
+        for (size_t k = 0; k < merged->num_lanes; ++k) {
+            merged->lanes[k] = worker->first + k;
+        }
+        merged->dense = true;
+    }
+}
+
+void remove_group(BatchWorker *worker, size_t group) {
+    mem_free(worker->be->allocator, worker->groups[group].lanes);
+    size_t last = --worker->num_groups;
+    if (group != last) {
+        worker->groups[group] = worker->groups[last];
+        worker->group_at[worker->groups[group].pc] = group;
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef BATCH_EMULATOR_H
+#define BATCH_EMULATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Allocator.h"
+#include "Emulator.h"
+
+// data types
+
+// instances of a batch that are at the same program counter, and run its op
+// together, each operation of the op being a loop over them. The cycles of
+// an instance are only added up when it leaves its group, from the steps of
+// the group since it joined
+typedef struct BatchGroup {
+    uint16_t pc;
+    uint32_t *lanes; // indices of the instances
+    size_t num_lanes;
+    size_t capacity;
+    uint64_t steps;       // ops run by the group
+    uint64_t limit_steps; // steps at which one of its instances reaches the
+                          // cycle limit, UINT64_MAX if none does
+    bool dense; // its lanes are consecutive instances, in order
+} BatchGroup;
+
+// instances of a batch run by one thread, an independent slice of them.
+// Every step runs the op of the group at the lowest program counter, so the
+// groups that took a branch wait at its join for the others, and merge
+typedef struct BatchWorker {
+    struct BatchEmulator *be;
+    size_t first; // first instance of the slice
+    size_t end;   // past its last instance
+    uint64_t max_cycles;
+    BatchGroup *groups;
+    size_t num_groups;
+    size_t groups_capacity;
+    int32_t *group_at; // index of the group at each address, -1 for none
+    uint16_t *out;     // ALU outputs of the lanes of the group run
+    uint16_t *next_pc; // program counters of the lanes after the op
+    uint64_t *joined;  // steps of its group when each instance joined it
+    uint64_t num_steps; // ops run by groups
+    bool out_of_memory;
+} BatchWorker;
+
+// num_instances Hack computers running the same pre-decoded program in
+// lockstep, each with its own registers and RAM. Their state is laid out as
+// structure of arrays, the RAM by address then instance, so that the
+// instances of a group reading the same address read consecutive words
+typedef struct BatchEmulator {
+    const Allocator *allocator;
+    EmulatorOp *ops;
+    size_t num_words; // of the program loaded
+    size_t num_instances;
+    uint16_t *ram; // word addr of instance i at ram[addr*num_instances + i]
+    uint16_t *a;
+    uint16_t *d;
+    uint16_t *pc;
+    uint64_t *cycles; // instructions run by each instance
+    uint8_t *halt_reasons; // HaltReason of each instance, once run
+    uint64_t num_steps;    // ops run by groups in the last run, each running
+                           // it for all its instances
+} BatchEmulator;
+
+
+// constants
+
+// next program counter of a lane that halted in a loop, past every address
+extern const uint16_t halted_pc;
+
+
+// functions
+
+// creates a batch of num_instances emulators with an empty program, taking
+// all its memory from allocator, or from malloc if it is NULL. Returns NULL
+// if there is not enough memory
+BatchEmulator *new_batch_emulator(const Allocator *allocator,
+        size_t num_instances);
+
+// deletes the batch and its program from memory
+void delete_batch_emulator(BatchEmulator *be);
+
+// decodes num_words machine words into the program of the batch, and resets
+// it, returns false if they do not fit in the ROM
+bool load_batch_program(BatchEmulator *be, const uint16_t *words,
+        size_t num_words);
+
+// clears the registers, RAM and cycle counts of every instance, keeping the
+// program
+void reset_batch(BatchEmulator *be);
+
+// returns the RAM word at addr of an instance
+uint16_t *batch_ram_word(BatchEmulator *be, size_t instance, size_t addr);
+
+// runs every instance from its reset state, until it takes a jump that loops
+// forever or max_cycles instructions were run, 0 for no limit,
+// with the instances split between num_threads threads, and the calling
+// thread running the shares of those that cannot start. Instances that never
+// halt, with no limit, keep the others of their thread waiting. Returns
+// false if there was not enough memory
+bool run_batch(BatchEmulator *be, uint64_t max_cycles, long num_threads);
+
+// runs the instances of the worker, returns NULL, as a thread start routine
+void *run_batch_worker(void *worker);
+
+// runs the op of a group for all its lanes, then moves it to the next op, or
+// splits its lanes by their next program counter into the groups there
+void step_group(BatchWorker *worker, size_t group);
+
+// returns the program counter of the lane after the jump of op, whose ALU
+// output is out, or halted_pc if it halts there, placing its pc and halt
+// reason into the batch
+uint16_t jump_target(BatchEmulator *be, const EmulatorOp *op, uint16_t out,
+        size_t lane, uint16_t pc_plus_1);
+
+// computes the ALU outputs of the op of a group into the outputs of the
+// worker, for each of its lanes
+void compute_group_alu(BatchWorker *worker, const BatchGroup *group,
+        const EmulatorOp *op);
+
+// adds a lane to the group at pc, created if there is none, returns false if
+// there is not enough memory
+bool add_lane(BatchWorker *worker, uint16_t pc, uint32_t lane);
+
+// moves a group, that is no longer at its pc in the worker, to pc, merging it
+// into the group there if there is one
+void move_group(BatchWorker *worker, size_t group, uint16_t pc);
+
+// removes a group of the worker, moving the last group in its place
+void remove_group(BatchWorker *worker, size_t group);
+
+#endif
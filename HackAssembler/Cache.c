@@ -0,0 +1,119 @@
+#include "Cache.h"
+#include "Input.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// constants
+const char *const cache_version = "hackasm-1";
+const char *const cache_env_var = "HACKASM_CACHE";
+const uint64_t hash_multiplier = 0x9e3779b97f4a7c15;
+const size_t copy_block_size = 1 << 16;
+
+// numbers the temporary files of the cache entries stored by this process
+atomic_uint num_stored_entries;
+
+uint64_t hash_bytes(const char *data, size_t size, uint64_t seed) {
+    uint64_t hash = seed ^ (size * hash_multiplier);
+    uint64_t block;
+    for (; size >= 8; data += 8, size -= 8) {
+        memcpy(&block, data, 8);
+        hash = (hash ^ block) * hash_multiplier;
+        hash ^= hash >> 29;
+    }
+    block = 0;
+    memcpy(&block, data, size); // remaining bytes
+    hash = (hash ^ block) * hash_multiplier;
+    // final mix, so that every input bit affects every key bit
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool cache_key(const char *in_filename, OutputFormat format, bool optimized,
+        uint64_t *key) {
+    FILE *in_file = fopen(in_filename, "r");
+    if (!in_file) {
+        return false;
+    }
+    InputBuffer input;
+    bool read = open_input(in_file, &input);
+    fclose(in_file);
+    if (!read) {
+        return false;
+    }
+    uint64_t seed = hash_bytes(cache_version, strlen(cache_version),
+            format | (uint64_t)optimized << 32);
+    *key = hash_bytes(input.data, input.size, seed);
+    close_input(&input);
+    return true;
+}
+
+char *cache_entry_path(const char *cache_dir, uint64_t key,
+        OutputFormat format) {
+    const char *extension = format_extensions[format];
+    // '/' + 16 hex digits + '.' + extension + '\0'
+    char *entry_path = malloc(strlen(cache_dir) + strlen(extension) + 19);
+    sprintf(entry_path, "%s/%016llx.%s", cache_dir, (unsigned long long)key,
+            extension);
+    return entry_path;
+}
+
+bool fetch_cached(const char *entry_path, const char *out_filename) {
+    if (access(entry_path, R_OK)) { // cache miss
+        return false;
+    }
+    unlink(out_filename); // never write through a link into the cache
+    return !link(entry_path, out_filename)
+        || copy_file(entry_path, out_filename);
+}
+
+bool store_cached(const char *out_filename, const char *entry_path) {
+    // link or copy to a temporary name first, then rename it into place, so
+    // that concurrent runs never see a partial entry
+    char *tmp_path = malloc(strlen(entry_path) + 48);
+    sprintf(tmp_path, "%s.%ld.%u.tmp", entry_path, (long)getpid(),
+            atomic_fetch_add(&num_stored_entries, 1));
+    unlink(tmp_path);
+    bool stored = (!link(out_filename, tmp_path)
+                   || copy_file(out_filename, tmp_path))
+               && !rename(tmp_path, entry_path);
+    if (!stored) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return stored;
+}
+
+bool copy_file(const char *from_filename, const char *to_filename) {
+    FILE *from_file = fopen(from_filename, "r");
+    if (!from_file) {
+        return false;
+    }
+    FILE *to_file = fopen(to_filename, "w");
+    if (!to_file) {
+        fclose(from_file);
+        return false;
+    }
+    char *block = malloc(copy_block_size);
+    size_t num_read;
+    bool success = block != NULL;
+    while (success
+            && (num_read = fread(block, 1, copy_block_size, from_file)) > 0) {
+        success = fwrite(block, 1, num_read, to_file) == num_read;
+    }
+    success = success && !ferror(from_file);
+    free(block);
+    fclose(from_file);
+    if (fclose(to_file) || !success) {
+        unlink(to_filename);
+        return false;
+    }
+    return true;
+}
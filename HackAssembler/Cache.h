@@ -0,0 +1,47 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Output.h"
+
+// constants
+
+// version of the assembler output, part of every cache key: change it whenever
+// the output for the same input and options changes
+extern const char *const cache_version;
+
+// environment variable naming the cache directory, when -c is not given
+extern const char *const cache_env_var;
+
+
+// functions
+
+// computes a fast 64-bit hash of size bytes of data, 8 bytes at a time
+uint64_t hash_bytes(const char *data, size_t size, uint64_t seed);
+
+// computes the cache key of the contents of in_filename, assembled to the
+// format, and peephole optimized if optimized, returns false if the file
+// cannot be read
+bool cache_key(const char *in_filename, OutputFormat format, bool optimized,
+        uint64_t *key);
+
+// creates the path of the cache entry of key in cache_dir, allocated on the
+// heap
+char *cache_entry_path(const char *cache_dir, uint64_t key,
+        OutputFormat format);
+
+// replaces out_filename with the cache entry at entry_path, hard-linked, or
+// copied if it cannot be linked, returns false if there is no such entry
+bool fetch_cached(const char *entry_path, const char *out_filename);
+
+// adds out_filename to the cache as the entry at entry_path, hard-linked, or
+// copied if it cannot be linked. The entry appears whole, or not at all
+bool store_cached(const char *out_filename, const char *entry_path);
+
+// copies the file from_filename to to_filename, returns false on errors
+bool copy_file(const char *from_filename, const char *to_filename);
+
+#endif
@@ -0,0 +1,395 @@
+#include "ChunkedAssembler.h"
+#include "Lexer.h"
+#include "PredefinedSymbols.h"
+#include "SymbolTable.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// constants
+const size_t min_chunk_size = 1 << 16; // smaller chunks are not worth a task
+const size_t chunks_per_thread = 4;    // to balance uneven chunks
+const size_t chunk_table_size = 128;   // initial symbol table sizes
+const size_t merged_table_size = 1024;
+
+// chunks shared by the threads running a task, each takes the next one until
+// none is left
+typedef struct ChunkQueue {
+    ChunkedAssembly *ca;
+    void (*task)(ChunkedAssembly *, Chunk *);
+    atomic_size_t next_chunk;
+} ChunkQueue;
+
+// thread running the task of a chunk queue
+void *chunk_worker(void *queue_ptr);
+
+bool assemble_chunked(FILE *in_file, const char *filename, long num_threads,
+        ChunkedAssembly **ca_ptr) {
+    ChunkedAssembly *ca = calloc(1, sizeof(*ca));
+    *ca_ptr = ca;
+    if (!ca) {
+        fprintf(stderr, "Error: %s: out of memory\n", filename);
+        return false;
+    }
+    ca->filename = filename;
+    ca->num_threads = num_threads > 0 ? num_threads : 1;
+    if (!open_input(in_file, &ca->input)) {
+        fprintf(stderr, "Error: %s: could not read input\n", filename);
+        ca->num_errors = 1;
+        return false;
+    }
+    if (!split_chunks(ca, ca->num_threads*chunks_per_thread)) {
+        fprintf(stderr, "Error: %s: out of memory\n", filename);
+        ca->num_errors = 1;
+        return false;
+    }
+    for_each_chunk(ca, scan_chunk);
+
+    size_t first_line_num = 1, base_addr = 0;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        ca->chunks[i].first_line_num = first_line_num;
+        ca->chunks[i].base_addr = base_addr;
+        first_line_num += ca->chunks[i].num_lines;
+        base_addr += ca->chunks[i].num_instrs;
+    }
+    merge_symbols(ca);
+
+    if (ca->st) { // otherwise out of memory, already reported
+        for_each_chunk(ca, encode_chunk);
+    }
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        ca->num_errors += ca->chunks[i].as->num_errors
+                        + ca->chunks[i].as->out_of_memory;
+    }
+    return ca->num_errors == 0;
+}
+
+bool write_chunked(ChunkedAssembly *ca, FILE *out_file, OutputFormat format) {
+    if (format != FORMAT_TEXT) {
+        size_t num_words;
+        uint16_t *words = gather_words(ca, &num_words);
+        if (!words) {
+            return false;
+        }
+        bool success = write_words(out_file, format, words, num_words);
+        free(words);
+        return success;
+    }
+    fflush(out_file);
+    ca->out_fd = fileno(out_file);
+    struct stat out_stat;
+    ca->out_offset = lseek(ca->out_fd, 0, SEEK_CUR);
+    if (fstat(ca->out_fd, &out_stat) || !S_ISREG(out_stat.st_mode)
+            || ca->out_offset < 0) { // cannot write at offsets, write in order
+        for (size_t i = 0; i < ca->num_chunks; ++i) {
+            Assembly *as = ca->chunks[i].as;
+            if (!write_text_words(out_file, as->words, as->num_words)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    for_each_chunk(ca, write_chunk);
+    bool success = true;
+    size_t num_words = 0;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        success = success && !ca->chunks[i].write_failed;
+        num_words += ca->chunks[i].num_instrs;
+    }
+    // leave the stream positioned after the output
+    fseeko(out_file, ca->out_offset + num_words*text_instr_size, SEEK_SET);
+    return success;
+}
+
+uint16_t *gather_words(const ChunkedAssembly *ca, size_t *num_words) {
+    *num_words = 0;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        *num_words += ca->chunks[i].as->num_words;
+    }
+    uint16_t *words = malloc((*num_words ? *num_words : 1)*sizeof(*words));
+    if (!words) {
+        return NULL;
+    }
+    size_t addr = 0;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        const Assembly *as = ca->chunks[i].as;
+        if (as->num_words > 0) {
+            memcpy(words + addr, as->words, as->num_words*sizeof(*words));
+            addr += as->num_words;
+        }
+    }
+    return words;
+}
+
+void delete_chunked_assembly(ChunkedAssembly *ca) {
+    if (!ca) {
+        return;
+    }
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        if (ca->chunks[i].symbols) {
+            delete_symbol_table(ca->chunks[i].symbols);
+        }
+        if (ca->chunks[i].as) {
+            delete_assembly(ca->chunks[i].as);
+        }
+        free(ca->chunks[i].labels);
+    }
+    free(ca->chunks);
+    if (ca->st) {
+        delete_symbol_table(ca->st);
+    }
+    if (ca->input.data) {
+        close_input(&ca->input);
+    }
+    free(ca);
+}
+
+bool split_chunks(ChunkedAssembly *ca, size_t max_chunks) {
+    const char *input = ca->input.data;
+    size_t size = ca->input.size;
+    size_t chunk_size = size / max_chunks + 1;
+    if (chunk_size < min_chunk_size) {
+        chunk_size = min_chunk_size;
+    }
+    if (!(ca->chunks = calloc(max_chunks, sizeof(*ca->chunks)))) {
+        return false;
+    }
+    size_t start = 0;
+    while (start < size || ca->num_chunks == 0) {
+        size_t end = start + chunk_size;
+        if (end >= size || ca->num_chunks == max_chunks - 1) {
+            end = size; // last chunk takes the rest
+        } else { // extend to the end of the line
+            const char *line_end = memchr(input + end, '\n', size - end);
+            end = line_end ? (size_t)(line_end - input) + 1 : size;
+        }
+        Chunk *chunk = &ca->chunks[ca->num_chunks++];
+        chunk->input = input + start;
+        chunk->size = end - start;
+        chunk->symbols = new_symbol_table(chunk_table_size,
+                &default_allocator);
+        chunk->as = new_assembly(NULL);
+        if (!chunk->symbols || !chunk->as) {
+            return false;
+        }
+        chunk->as->filename = ca->filename;
+        chunk->as->error_stream = stderr;
+        start = end;
+    }
+    return true;
+}
+
+void for_each_chunk(ChunkedAssembly *ca,
+        void (*task)(ChunkedAssembly *, Chunk *)) {
+    ChunkQueue queue = {.ca = ca, .task = task};
+    atomic_init(&queue.next_chunk, 0);
+    size_t num_threads = ca->num_threads;
+    if (num_threads > ca->num_chunks) {
+        num_threads = ca->num_chunks;
+    }
+    if (num_threads <= 1) { // no need for threads
+        chunk_worker(&queue);
+        return;
+    }
+    pthread_t *threads = malloc(num_threads*sizeof(*threads));
+    size_t num_started = 0;
+    while (threads && num_started < num_threads
+            && !pthread_create(&threads[num_started], NULL, chunk_worker,
+                &queue)) {
+        ++num_started;
+    }
+    if (num_started < num_threads) { // the chunks left run on this thread
+        chunk_worker(&queue);
+    }
+    for (size_t i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+void *chunk_worker(void *queue_ptr) {
+    ChunkQueue *queue = queue_ptr;
+    size_t i;
+    while ((i = atomic_fetch_add(&queue->next_chunk, 1))
+            < queue->ca->num_chunks) {
+        queue->task(queue->ca, &queue->ca->chunks[i]);
+    }
+    return NULL;
+}
+
+void scan_chunk(ChunkedAssembly *ca, Chunk *chunk) {
+    (void)ca;
+    Assembly *as = chunk->as;
+    size_t pos = 0;
+    Field line;
+    while (!as->out_of_memory
+            && next_line(chunk->input, chunk->size, &pos, &line)) {
+        ++chunk->num_lines;
+        line = parse_comments_and_whitespace(line, as);
+        if (line.len == 0) {
+            continue;
+        }
+        if (line.str[0] == '(') { // (label) definition, checked when encoding
+            const char *label_end = memchr(line.str, ')', line.len);
+            if (!label_end) {
+                label_end = line.str + line.len;
+            }
+            size_t key_len = label_end - (line.str+1);
+            if (key_len == 0) {
+                continue;
+            }
+            uint32_t key_offset;
+            if (!grow_array(&default_allocator, &chunk->labels,
+                        chunk->num_labels, &chunk->labels_capacity,
+                        sizeof(*chunk->labels))
+                    || !intern_key(chunk->symbols, line.str+1, key_len,
+                        &key_offset)) {
+                memory_error(as);
+                continue;
+            }
+            chunk->labels[chunk->num_labels++] = (ChunkLabel) {
+                .key_offset = key_offset, .key_len = key_len,
+                .addr = chunk->num_instrs, .line_num = chunk->num_lines - 1};
+            continue;
+        }
+        ++chunk->num_instrs;
+        Field key = {line.str+1, line.len-1};
+        uint32_t value;
+        if (line.str[0] == '@' && key.len > 0
+                && !isdigit((unsigned char)*key.str)
+                && !lookup_predefined(key.str, key.len, &value)
+                && !lookup_key(chunk->symbols, key.str, key.len, &value)) {
+            // first reference in the chunk
+            if (insert_symbol(chunk->symbols, key.str, key.len,
+                        chunk->symbols->num_entries) != INSERT_OK) {
+                memory_error(as);
+            }
+        }
+    }
+}
+
+void merge_symbols(ChunkedAssembly *ca) {
+    ca->st = new_symbol_table(merged_table_size, &default_allocator);
+    if (!ca->st) {
+        memory_error(ca->chunks[0].as);
+        return;
+    }
+    uint32_t value;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        Chunk *chunk = &ca->chunks[i];
+        for (size_t j = 0; j < chunk->num_labels; ++j) {
+            ChunkLabel *label = &chunk->labels[j];
+            const char *key = chunk->symbols->arena + label->key_offset;
+            uint16_t label_addr = chunk->base_addr + label->addr;
+            InsertResult inserted = INSERT_DUPLICATE;
+            if (!lookup_predefined(key, label->key_len, &value)) {
+                inserted = insert_symbol(ca->st, key, label->key_len,
+                        label_addr);
+            }
+            if (inserted == INSERT_NO_MEMORY) {
+                memory_error(chunk->as);
+            } else if (inserted != INSERT_OK) {
+                parse_error(chunk->as, chunk->first_line_num + label->line_num,
+                        "label already defined",
+                        (Field) {key, label->key_len});
+            }
+        }
+    }
+    uint16_t highest_var_addr = 16;
+    const TableEntry **order = NULL;
+    size_t order_capacity = 0;
+    for (size_t i = 0; i < ca->num_chunks; ++i) {
+        SymbolTable *symbols = ca->chunks[i].symbols;
+        // order the entries of the chunk by first appearance
+        if (!grow_array(&default_allocator, &order, symbols->num_entries,
+                    &order_capacity, sizeof(*order))) {
+            memory_error(ca->chunks[i].as);
+            break;
+        }
+        for (size_t j = 0; j < symbols->size; ++j) {
+            if (symbols->table[j].key_len != 0) {
+                order[symbols->table[j].value] = &symbols->table[j];
+            }
+        }
+        for (size_t j = 0; j < symbols->num_entries; ++j) {
+            const char *key = symbols->arena + order[j]->key_offset;
+            if (!lookup_key(ca->st, key, order[j]->key_len, &value)
+                    && insert_symbol(ca->st, key, order[j]->key_len,
+                        highest_var_addr++) != INSERT_OK) {
+                memory_error(ca->chunks[i].as);
+            }
+        }
+    }
+    free(order);
+}
+
+void encode_chunk(ChunkedAssembly *ca, Chunk *chunk) {
+    Assembly *as = chunk->as;
+    // every symbol is resolved in the merged table, which is only read
+    SymbolTable *chunk_st = as->st;
+    as->st = ca->st;
+    size_t pos = 0;
+    Field line;
+    int line_num = chunk->first_line_num - 1;
+    while (!as->out_of_memory
+            && next_line(chunk->input, chunk->size, &pos, &line)) {
+        ++line_num;
+        line = parse_comments_and_whitespace(line, as);
+        const char *asm_instr = line.str;
+        size_t len = line.len;
+        if (len == 0) {
+            continue;
+        }
+        if (asm_instr[0] == '(') { // merged already, only check it is valid
+            if (len < 2 || asm_instr[1] == ')') {
+                parse_error(as, line_num, "invalid label", line);
+            }
+        } else if (asm_instr[0] == '@') { // A instruction
+            uint16_t value;
+            parse_A_instruction(asm_instr, len, line_num, &value, as);
+            append_word(as, value);
+        } else { // C instruction
+            DestToken dest;
+            CompToken comp;
+            JumpToken jump;
+            bool valid = parse_C_instruction(asm_instr, len, line_num,
+                    &comp, &dest, &jump, as);
+            append_word(as, valid ? encode_C_instruction(comp, dest, jump) : 0);
+        }
+    }
+    as->st = chunk_st;
+}
+
+void write_chunk(ChunkedAssembly *ca, Chunk *chunk) {
+    const uint16_t *words = chunk->as->words;
+    size_t num_words = chunk->as->num_words;
+    off_t offset = ca->out_offset + chunk->base_addr*text_instr_size;
+    char *text = malloc(text_block_size*text_instr_size);
+    if (!text) {
+        chunk->write_failed = true;
+        return;
+    }
+    for (size_t i = 0; i < num_words; i += text_block_size) {
+        size_t block_size = num_words - i < text_block_size
+                          ? num_words - i : text_block_size;
+        words_to_text(words + i, block_size, text);
+        size_t num_bytes = block_size*text_instr_size;
+        for (size_t written = 0; written < num_bytes; ) {
+            ssize_t n = pwrite(ca->out_fd, text + written, num_bytes - written,
+                    offset + written);
+            if (n < 0) {
+                chunk->write_failed = true;
+                free(text);
+                return;
+            }
+            written += n;
+        }
+        offset += num_bytes;
+    }
+    free(text);
+}
@@ -0,0 +1,103 @@
+#ifndef CHUNKED_ASSEMBLER_H
+#define CHUNKED_ASSEMBLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "HackAssembler.h"
+#include "Output.h"
+#include "Input.h"
+
+// data types
+
+// (label) defined in a chunk, its name is interned in the arena of the chunk's
+// symbol table
+typedef struct ChunkLabel {
+    uint32_t key_offset;
+    uint32_t key_len;
+    size_t addr;     // address relative to the chunk
+    size_t line_num; // line number relative to the chunk
+} ChunkLabel;
+
+// line-aligned part of the input, scanned and encoded independently of the
+// others
+typedef struct Chunk {
+    const char *input;
+    size_t size;
+    size_t num_lines;
+    size_t num_instrs;
+    size_t first_line_num; // prefix sums of the lines and instructions
+    size_t base_addr;      // of the previous chunks
+    SymbolTable *symbols;  // referenced, valued by order of first appearance
+    ChunkLabel *labels;
+    size_t num_labels;
+    size_t labels_capacity;
+    Assembly *as; // words, scratch buffer and errors of the chunk
+    bool write_failed;
+} Chunk;
+
+// assembly of a single input split into chunks, processed by num_threads
+// threads. Labels of all the chunks and variables are merged into st
+typedef struct ChunkedAssembly {
+    InputBuffer input;
+    const char *filename;
+    Chunk *chunks;
+    size_t num_chunks;
+    long num_threads;
+    SymbolTable *st;
+    size_t num_errors;
+    int out_fd;        // output file, written at
+    off_t out_offset;  // this offset
+} ChunkedAssembly;
+
+
+// functions
+
+// assembles in_file split into line-aligned chunks, in parallel: each chunk
+// counts its instructions and collects its (label) definitions and symbol
+// references, then chunk base addresses are computed by a prefix sum, labels
+// merged, and variables allocated in order of first appearance, and finally
+// the chunks are encoded. The result is the same as that of assemble. Returns
+// false if there were errors, reported for filename
+bool assemble_chunked(FILE *in_file, const char *filename, long num_threads,
+        ChunkedAssembly **ca);
+
+// writes the words of every chunk to out_file in the format. Binary ASCII
+// lines are written in parallel at the precomputed offset of each chunk when
+// out_file is a regular file, otherwise in order. Other formats are written
+// from the words of all the chunks gathered together
+bool write_chunked(ChunkedAssembly *ca, FILE *out_file, OutputFormat format);
+
+// gathers the words of all the chunks into a single array, in order, returns
+// NULL if there is not enough memory
+uint16_t *gather_words(const ChunkedAssembly *ca, size_t *num_words);
+
+// deletes the chunked assembly from memory, if it is not NULL
+void delete_chunked_assembly(ChunkedAssembly *ca);
+
+// splits the input into at most max_chunks chunks at line boundaries, returns
+// false if there is not enough memory for them
+bool split_chunks(ChunkedAssembly *ca, size_t max_chunks);
+
+// runs task on every chunk, on a pool of num_threads threads
+void for_each_chunk(ChunkedAssembly *ca,
+        void (*task)(ChunkedAssembly *, Chunk *));
+
+// counts the lines and instructions of the chunk, and collects its (label)
+// definitions and first references to symbols
+void scan_chunk(ChunkedAssembly *ca, Chunk *chunk);
+
+// adds the labels of all the chunks to the symbol table at their absolute
+// addresses, then allocates variables to the symbols that are neither labels
+// nor predefined, in order of first appearance
+void merge_symbols(ChunkedAssembly *ca);
+
+// encodes the instructions of the chunk into its words, all symbols resolved
+void encode_chunk(ChunkedAssembly *ca, Chunk *chunk);
+
+// writes the words of the chunk as text, at its offset in the output
+void write_chunk(ChunkedAssembly *ca, Chunk *chunk);
+
+#endif
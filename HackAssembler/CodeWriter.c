@@ -0,0 +1,495 @@
+#include "CodeWriter.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Lexer.h"
+#include "OptimizedWriter.h"
+#include "SymbolTable.h"
+
+// constants
+const size_t targets_table_size = 256;
+const uint16_t stack_base = 256;
+const uint16_t pointer_base = 3;
+const uint16_t temp_base = 5;
+const uint16_t frame_size = 5;
+const char *const segment_registers[] = {
+    [SEG_ARGUMENT] = "ARG",
+    [SEG_LOCAL]    = "LCL",
+    [SEG_THIS]     = "THIS",
+    [SEG_THAT]     = "THAT",
+};
+const char *const frame_registers[] = {"LCL", "ARG", "THIS", "THAT"};
+const size_t num_frame_registers =
+    sizeof(frame_registers) / sizeof(*frame_registers);
+const CompToken binary_comps[] = {
+    [VM_ADD] = COMP_D_PLUS_M,
+    [VM_SUB] = COMP_M_MINUS_D,
+    [VM_AND] = COMP_D_AND_M,
+    [VM_OR]  = COMP_D_OR_M,
+};
+const JumpToken compare_jumps[] = {
+    [VM_EQ] = JUMP_JEQ,
+    [VM_GT] = JUMP_JGT,
+    [VM_LT] = JUMP_JLT,
+};
+
+bool init_code_writer(CodeWriter *cw, Assembly *as, FILE *asm_file) {
+    *cw = (CodeWriter) {.as = as, .asm_file = asm_file};
+    cw->targets = new_symbol_table(targets_table_size, as->allocator);
+    return cw->targets != NULL;
+}
+
+void free_code_writer(CodeWriter *cw) {
+    if (cw->targets) {
+        delete_symbol_table(cw->targets);
+    }
+    mem_free(cw->as->allocator, cw->jumps);
+    mem_free(cw->as->allocator, cw->name);
+    *cw = (CodeWriter) {0};
+}
+
+void set_file_name(CodeWriter *cw, const char *filename) {
+    const char *base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    const char *extension = strrchr(base, '.');
+    cw->file_name = (Field) {base, extension ? (size_t)(extension - base)
+                                             : strlen(base)};
+    cw->scope = cw->file_name;
+    cw->num_returns = 0;
+    cw->num_compares = 0;
+    cw->as->filename = filename;
+}
+
+void write_init(CodeWriter *cw) {
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "// bootstrap\n");
+    }
+    write_a_value(cw, stack_base);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    Field sys_init = {"Sys.init", strlen("Sys.init")};
+    if (cw->optimize) {
+        write_shared_call(cw, sys_init, 0);
+    } else {
+        write_call(cw, sys_init, 0);
+    }
+}
+
+bool translate_buffer(CodeWriter *cw, const char *input, size_t size,
+        const char *filename) {
+    size_t num_errors = cw->as->num_errors;
+    set_file_name(cw, filename);
+    VMParser parser;
+    init_vm_parser(&parser, input, size);
+    VMCommand cmd;
+    while (next_command(&parser, &cmd, cw->as) && !cw->as->out_of_memory) {
+        write_command(cw, &cmd);
+    }
+    return cw->as->num_errors == num_errors && !cw->as->out_of_memory;
+}
+
+void write_command(CodeWriter *cw, const VMCommand *cmd) {
+    cw->line_num = cmd->line_num;
+    if (cw->asm_file) { // the command, to follow the translation
+        fprintf(cw->asm_file, "// %s", cmd->type == C_ARITHMETIC
+                ? arithmetic_keywords[cmd->op] : command_keywords[cmd->type]);
+        if (cmd->type == C_PUSH || cmd->type == C_POP) {
+            fprintf(cw->asm_file, " %s %" PRIu16,
+                    segment_keywords[cmd->segment], cmd->index);
+        } else if (cmd->name.str) {
+            fprintf(cw->asm_file, " %.*s", (int)cmd->name.len, cmd->name.str);
+            if (cmd->type == C_FUNCTION || cmd->type == C_CALL) {
+                fprintf(cw->asm_file, " %" PRIu16, cmd->index);
+            }
+        }
+        fputc('\n', cw->asm_file);
+    }
+    if (cw->optimize) {
+        write_optimized_command(cw, cmd);
+        return;
+    }
+    switch (cmd->type) {
+        case C_ARITHMETIC:
+            write_arithmetic(cw, cmd->op);
+            break;
+        case C_PUSH:
+            write_push(cw, cmd->segment, cmd->index);
+            break;
+        case C_POP:
+            write_pop(cw, cmd->segment, cmd->index);
+            break;
+        case C_LABEL:
+            write_label(cw, cmd->name);
+            break;
+        case C_GOTO:
+            write_goto(cw, cmd->name, JUMP_JMP);
+            break;
+        case C_IF:
+            write_goto(cw, cmd->name, JUMP_JNE);
+            break;
+        case C_FUNCTION:
+            write_function(cw, cmd->name, cmd->index);
+            break;
+        case C_CALL:
+            write_call(cw, cmd->name, cmd->index);
+            break;
+        case C_RETURN:
+            write_return(cw);
+            break;
+    }
+}
+
+void write_arithmetic(CodeWriter *cw, ArithmeticOp op) {
+    switch (op) {
+        case VM_NEG:
+        case VM_NOT: // in place, at SP-1
+            write_a_register(cw, "SP");
+            write_c(cw, DEST_A, COMP_M_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_M, op == VM_NEG ? COMP_NEG_M : COMP_NOT_M,
+                    JUMP_NULL);
+            return;
+        case VM_EQ:
+        case VM_GT:
+        case VM_LT: // true is -1, set unless the comparison fails
+            build_unique_name(cw, cw->file_name, "cmp", cw->num_compares++);
+            write_pop_d(cw);
+            write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_D, COMP_M_MINUS_D, JUMP_NULL);
+            write_c(cw, DEST_M, COMP_NEG_1, JUMP_NULL);
+            write_a_name(cw);
+            write_c(cw, DEST_NULL, COMP_D, compare_jumps[op]);
+            write_a_register(cw, "SP");
+            write_c(cw, DEST_A, COMP_M_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_M, COMP_0, JUMP_NULL);
+            write_label_name(cw);
+            return;
+        default: // binary, into the word below the top
+            write_pop_d(cw);
+            write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_M, binary_comps[op], JUMP_NULL);
+            return;
+    }
+}
+
+void write_push(CodeWriter *cw, Segment segment, uint16_t index) {
+    switch (segment) {
+        case SEG_CONSTANT:
+            write_a_value(cw, index);
+            write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+            break;
+        case SEG_STATIC:
+            build_unique_name(cw, cw->file_name, NULL, index);
+            write_a_name(cw);
+            write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+            break;
+        case SEG_POINTER:
+        case SEG_TEMP:
+            write_a_value(cw, (segment == SEG_POINTER ? pointer_base
+                                                      : temp_base) + index);
+            write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+            break;
+        default:
+            write_segment_address(cw, segment, index, DEST_A);
+            write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+            break;
+    }
+    write_push_d(cw);
+}
+
+void write_pop(CodeWriter *cw, Segment segment, uint16_t index) {
+    switch (segment) {
+        case SEG_STATIC:
+            write_pop_d(cw);
+            build_unique_name(cw, cw->file_name, NULL, index);
+            write_a_name(cw);
+            break;
+        case SEG_POINTER:
+        case SEG_TEMP:
+            write_pop_d(cw);
+            write_a_value(cw, (segment == SEG_POINTER ? pointer_base
+                                                      : temp_base) + index);
+            break;
+        default: // the address is kept in R13 while popping
+            write_segment_address(cw, segment, index, DEST_D);
+            write_a_register(cw, "R13");
+            write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+            write_pop_d(cw);
+            write_a_register(cw, "R13");
+            write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+            break;
+    }
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+}
+
+void write_label(CodeWriter *cw, Field label) {
+    build_label_name(cw, label);
+    write_label_name(cw);
+}
+
+void write_goto(CodeWriter *cw, Field label, JumpToken jump) {
+    if (jump != JUMP_JMP) { // on the popped value
+        write_pop_d(cw);
+    }
+    write_label_jump(cw, label, jump);
+}
+
+void write_function(CodeWriter *cw, Field function, uint16_t num_locals) {
+    start_function(cw, function);
+    for (uint16_t i = 0; i < num_locals; ++i) {
+        write_a_register(cw, "SP");
+        write_c(cw, DEST_AM, COMP_M_PLUS_1, JUMP_NULL);
+        write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+        write_c(cw, DEST_M, COMP_0, JUMP_NULL);
+    }
+}
+
+void write_call(CodeWriter *cw, Field function, uint16_t num_args) {
+    uint32_t ret = cw->num_returns++;
+    build_unique_name(cw, cw->scope, "ret", ret);
+    write_a_name(cw);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_push_d(cw);
+    for (size_t i = 0; i < num_frame_registers; ++i) {
+        write_a_register(cw, frame_registers[i]);
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_push_d(cw);
+    }
+    write_a_register(cw, "SP"); // ARG = SP - num_args - 5
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+    write_a_value(cw, num_args + frame_size);
+    write_c(cw, DEST_D, COMP_D_MINUS_A, JUMP_NULL);
+    write_a_register(cw, "ARG");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    write_a_register(cw, "SP"); // LCL = SP
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+    write_a_register(cw, "LCL");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    clear_name(cw);
+    append_name(cw, function.str, function.len);
+    add_jump_target(cw);
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    build_unique_name(cw, cw->scope, "ret", ret);
+    write_label_name(cw);
+}
+
+void write_return(CodeWriter *cw) {
+    write_a_register(cw, "LCL"); // frame in R13
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+    write_a_register(cw, "R13");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    write_a_value(cw, frame_size); // return address in R14
+    write_c(cw, DEST_A, COMP_D_MINUS_A, JUMP_NULL);
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+    write_a_register(cw, "R14");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    write_pop_d(cw); // return value in ARG[0], SP just past it
+    write_a_register(cw, "ARG");
+    write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    write_a_register(cw, "ARG");
+    write_c(cw, DEST_D, COMP_M_PLUS_1, JUMP_NULL);
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    for (size_t i = num_frame_registers; i > 0; --i) { // from THAT, down
+        write_a_register(cw, "R13");
+        write_c(cw, DEST_AM, COMP_M_MINUS_1, JUMP_NULL);
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, frame_registers[i-1]);
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    }
+    write_a_register(cw, "R14");
+    write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+}
+
+bool write_end(CodeWriter *cw) {
+    if (cw->optimize) {
+        flush_stack(cw);
+    }
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "// end\n");
+    }
+    clear_name(cw);
+    append_name(cw, "$end", strlen("$end"));
+    write_label_name(cw);
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    if (cw->optimize) {
+        write_shared_subroutines(cw);
+    }
+    bool defined = true;
+    for (size_t i = 0; i < cw->num_jumps; ++i) {
+        const JumpTarget *jump = &cw->jumps[i];
+        const char *name = cw->targets->arena + jump->name_offset;
+        uint32_t addr;
+        if (!lookup_key(cw->as->st, name, jump->name_len, &addr)) {
+            cw->as->filename = jump->filename;
+            parse_error(cw->as, jump->line_num, "undefined label or function",
+                    (Field) {name, jump->name_len});
+            defined = false;
+        }
+    }
+    return defined && !cw->as->out_of_memory;
+}
+
+bool append_translation(CodeWriter *cw, const CodeWriter *part) {
+    bool success = append_assembly(cw->as, part->as);
+    for (size_t i = 0; i < part->num_jumps; ++i) { // first jumps, in order
+        const JumpTarget *jump = &part->jumps[i];
+        clear_name(cw);
+        append_name(cw, part->targets->arena + jump->name_offset,
+                jump->name_len);
+        cw->as->filename = jump->filename;
+        cw->line_num = jump->line_num;
+        add_jump_target(cw);
+    }
+    cw->uses_call |= part->uses_call;
+    cw->uses_return |= part->uses_return;
+    copy_stack_top(cw, part);
+    return success && !cw->as->out_of_memory;
+}
+
+void start_function(CodeWriter *cw, Field function) {
+    cw->scope = function;
+    cw->num_returns = 0;
+    clear_name(cw);
+    append_name(cw, function.str, function.len);
+    write_label_name(cw);
+}
+
+void write_label_jump(CodeWriter *cw, Field label, JumpToken jump) {
+    build_label_name(cw, label);
+    add_jump_target(cw);
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, jump == JUMP_JMP ? COMP_0 : COMP_D, jump);
+}
+
+void write_segment_address(CodeWriter *cw, Segment segment, uint16_t index,
+        DestToken dest) {
+    write_a_value(cw, index);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_a_register(cw, segment_registers[segment]);
+    write_c(cw, dest, COMP_D_PLUS_M, JUMP_NULL);
+}
+
+void write_push_d(CodeWriter *cw) {
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_AM, COMP_M_PLUS_1, JUMP_NULL);
+    write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+}
+
+void write_pop_d(CodeWriter *cw) {
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_AM, COMP_M_MINUS_1, JUMP_NULL);
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+}
+
+void write_a_value(CodeWriter *cw, uint16_t value) {
+    append_word(cw->as, value);
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "@%" PRIu16 "\n", value);
+    }
+}
+
+void write_a_register(CodeWriter *cw, const char *reg) {
+    uint16_t value;
+    reference_symbol(reg, strlen(reg), cw->line_num, &value, cw->as);
+    append_word(cw->as, value);
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "@%s\n", reg);
+    }
+}
+
+void write_a_name(CodeWriter *cw) {
+    uint16_t value;
+    reference_symbol(cw->name, cw->name_len, cw->line_num, &value, cw->as);
+    append_word(cw->as, value);
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "@%.*s\n", (int)cw->name_len, cw->name);
+    }
+}
+
+void write_c(CodeWriter *cw, DestToken dest, CompToken comp, JumpToken jump) {
+    append_word(cw->as, encode_C_instruction(comp, dest, jump));
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "%s%s%s%s%s\n", dest_mnemonics[dest],
+                dest == DEST_NULL ? "" : "=", comp_mnemonics[comp],
+                jump == JUMP_NULL ? "" : ";", jump_mnemonics[jump]);
+    }
+}
+
+void write_label_name(CodeWriter *cw) {
+    define_label(cw->name, cw->name_len, cw->line_num, cw->as);
+    if (cw->asm_file) {
+        fprintf(cw->asm_file, "(%.*s)\n", (int)cw->name_len, cw->name);
+    }
+}
+
+void add_jump_target(CodeWriter *cw) {
+    uint32_t index;
+    if (lookup_key(cw->targets, cw->name, cw->name_len, &index)) {
+        return; // checked from its first jump
+    }
+    index = cw->num_jumps;
+    uint32_t name_offset = cw->targets->arena_size;
+    if (!grow_array(cw->as->allocator, &cw->jumps, cw->num_jumps,
+                &cw->jumps_capacity, sizeof(*cw->jumps))
+            || insert_symbol(cw->targets, cw->name, cw->name_len, index)
+                != INSERT_OK) {
+        memory_error(cw->as);
+        return;
+    }
+    cw->jumps[cw->num_jumps++] = (JumpTarget) {.name_offset = name_offset,
+        .name_len = cw->name_len, .filename = cw->as->filename,
+        .line_num = cw->line_num};
+}
+
+void build_label_name(CodeWriter *cw, Field label) {
+    clear_name(cw);
+    append_name(cw, cw->scope.str, cw->scope.len);
+    append_name(cw, "$", 1);
+    append_name(cw, label.str, label.len);
+}
+
+void build_unique_name(CodeWriter *cw, Field scope, const char *prefix,
+        uint32_t number) {
+    clear_name(cw);
+    append_name(cw, scope.str, scope.len);
+    if (prefix) {
+        append_name(cw, "$", 1);
+        append_name(cw, prefix, strlen(prefix));
+    }
+    append_name(cw, ".", 1);
+    append_number(cw, number);
+}
+
+void clear_name(CodeWriter *cw) {
+    cw->name_len = 0;
+}
+
+void append_name(CodeWriter *cw, const char *str, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (!grow_array(cw->as->allocator, &cw->name, cw->name_len + len,
+                &cw->name_capacity, sizeof(*cw->name))) {
+        memory_error(cw->as);
+        return;
+    }
+    memcpy(cw->name + cw->name_len, str, len);
+    cw->name_len += len;
+}
+
+void append_number(CodeWriter *cw, uint32_t number) {
+    char digits[16];
+    int len = snprintf(digits, sizeof(digits), "%" PRIu32, number);
+    append_name(cw, digits, len);
+}
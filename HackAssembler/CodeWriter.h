@@ -0,0 +1,185 @@
+#ifndef CODE_WRITER_H
+#define CODE_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+#include "VMParser.h"
+
+// data types
+
+// where the optimized code keeps the top of the stack, the rest of the stack
+// is always in RAM, below SP
+typedef enum StackTop {
+    TOP_IN_MEMORY,     // the whole stack is in RAM
+    TOP_IN_D,          // the top is in D, SP is just past the value below it
+    TOP_CONSTANT,      // the top is a constant, not loaded yet
+    TOP_CONSTANT_ON_D, // the top is a constant, the value below it is in D
+    TOP_COMPARISON     // the top is -1 if the difference of the operands, in
+                       // D, satisfies the top jump, else 0, not computed yet
+} StackTop;
+
+// label or function jumped to, that must be defined once all the files are
+// translated
+typedef struct JumpTarget {
+    uint32_t name_offset; // in the arena of the targets of the writer
+    uint32_t name_len;
+    const char *filename; // of the first jump to it
+    int line_num;
+} JumpTarget;
+
+// translation of VM commands to Hack instructions, encoded straight into the
+// words of an assembly, whose symbol table resolves the labels and functions,
+// and allocates the static variables from address 16
+typedef struct CodeWriter {
+    Assembly *as;
+    FILE *asm_file;     // the instructions are also written to it as text, if
+                        // not NULL
+    Field file_name;    // of the .vm file, without directory and extension
+    Field scope;        // current function, or the file name before any
+    uint32_t num_returns;  // return labels generated in the current scope
+    uint32_t num_compares; // comparison labels generated in the current file
+    SymbolTable *targets;  // names of the jump targets, to their index
+    JumpTarget *jumps;
+    size_t num_jumps;
+    size_t jumps_capacity;
+    char *name; // symbol built from the names of the commands
+    size_t name_len;
+    size_t name_capacity;
+    int line_num; // of the command being translated
+    bool optimize; // cache the stack top, fuse commands, and share the code
+                   // of calls and returns
+    StackTop top;
+    uint16_t top_constant; // of TOP_CONSTANT and TOP_CONSTANT_ON_D
+    JumpToken top_jump;    // of TOP_COMPARISON
+    bool uses_call;        // the shared subroutines are called, and written
+    bool uses_return;      // at the end
+} CodeWriter;
+
+
+// constants
+
+// RAM addresses of the pointer segment, THIS then THAT, and of the temp
+// segment
+extern const uint16_t pointer_base;
+extern const uint16_t temp_base;
+
+// words saved by a call: return address, LCL, ARG, THIS, THAT
+extern const uint16_t frame_size;
+
+// base register of each segment addressed through a pointer, NULL for the
+// others
+extern const char *const segment_registers[];
+
+// registers saved in the frame of a call, in the order they are pushed
+extern const char *const frame_registers[];
+extern const size_t num_frame_registers;
+
+// comp of each binary arithmetic command, of the stack top in D and the word
+// below it in M
+extern const CompToken binary_comps[];
+
+// jump of each comparison, on the difference of its operands
+extern const JumpToken compare_jumps[];
+
+
+// functions
+
+// starts writing the instructions into the words of as, and to asm_file if it
+// is not NULL, returns false if there is not enough memory. The optimize flag
+// of the writer selects the back end of OptimizedWriter.h
+bool init_code_writer(CodeWriter *cw, Assembly *as, FILE *asm_file);
+
+// frees the memory of the writer, but not its assembly
+void free_code_writer(CodeWriter *cw);
+
+// starts the translation of the .vm file filename, whose statics and
+// comparison labels are named after it. Errors are reported for it
+void set_file_name(CodeWriter *cw, const char *filename);
+
+// writes the bootstrap code: SP=256, then call Sys.init
+void write_init(CodeWriter *cw);
+
+// translates every command of the size characters of the .vm file input, named
+// filename, returns false if there were errors
+bool translate_buffer(CodeWriter *cw, const char *input, size_t size,
+        const char *filename);
+
+// translates a single command
+void write_command(CodeWriter *cw, const VMCommand *cmd);
+
+// writes the code of each kind of command
+void write_arithmetic(CodeWriter *cw, ArithmeticOp op);
+void write_push(CodeWriter *cw, Segment segment, uint16_t index);
+void write_pop(CodeWriter *cw, Segment segment, uint16_t index);
+void write_label(CodeWriter *cw, Field label);
+void write_goto(CodeWriter *cw, Field label, JumpToken jump);
+void write_function(CodeWriter *cw, Field function, uint16_t num_locals);
+void write_call(CodeWriter *cw, Field function, uint16_t num_args);
+void write_return(CodeWriter *cw);
+
+// writes the end of the program, a loop on itself where the emulator halts,
+// then checks that every jump target is defined, returns false if one is not.
+// The variables of the assembly are not resolved yet
+bool write_end(CodeWriter *cw);
+
+// appends the translation of the next files by part, a writer of a
+// relocatable assembly, to the translation of the writer, as if it had
+// translated them: their words, labels and references, errors, jump targets,
+// shared subroutines called, and the stack top at their end. The assembly
+// text of part is not copied. Returns false if there were errors
+bool append_translation(CodeWriter *cw, const CodeWriter *part);
+
+// defines the label of the function, and makes it the current scope
+void start_function(CodeWriter *cw, Field function);
+
+// writes a jump to the label of the current scope, on the value of D unless
+// the jump is JUMP_JMP
+void write_label_jump(CodeWriter *cw, Field label, JumpToken jump);
+
+// writes the instructions that place into dest the address of the word index
+// of a segment addressed through its base register
+void write_segment_address(CodeWriter *cw, Segment segment, uint16_t index,
+        DestToken dest);
+
+// writes the instructions that push D onto the stack, or pop it into D
+void write_push_d(CodeWriter *cw);
+void write_pop_d(CodeWriter *cw);
+
+// writes an A instruction of a constant value
+void write_a_value(CodeWriter *cw, uint16_t value);
+
+// writes an A instruction of the predefined symbol register, null terminated
+void write_a_register(CodeWriter *cw, const char *reg);
+
+// writes an A instruction of the symbol built in the name of the writer
+void write_a_name(CodeWriter *cw);
+
+// writes the C instruction dest=comp;jump
+void write_c(CodeWriter *cw, DestToken dest, CompToken comp, JumpToken jump);
+
+// defines the label built in the name of the writer at the current address
+void write_label_name(CodeWriter *cw);
+
+// records the symbol built in the name of the writer as a jump target, that
+// must be defined
+void add_jump_target(CodeWriter *cw);
+
+// builds in the name of the writer the name of a label of the current scope,
+// scope$label
+void build_label_name(CodeWriter *cw, Field label);
+
+// builds in the name of the writer a name unique to the scope, or to the file,
+// scope$prefix.number, or scope.number if prefix is NULL
+void build_unique_name(CodeWriter *cw, Field scope, const char *prefix,
+        uint32_t number);
+
+// empties the name of the writer, then appends to it
+void clear_name(CodeWriter *cw);
+void append_name(CodeWriter *cw, const char *str, size_t len);
+void append_number(CodeWriter *cw, uint32_t number);
+
+#endif
@@ -0,0 +1,265 @@
+#include "DeadCode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SymbolTable.h"
+
+// constants
+const uint32_t no_region = UINT32_MAX; // at the offset of names of no label
+
+bool drop_dead_code_buffer(const char *input, size_t size,
+        const char *filename, Assembly *as, const char *trusted,
+        DeadCodeStats *stats, PeepholeStats *peephole_stats) {
+    *stats = (DeadCodeStats) {0};
+    if (peephole_stats) {
+        *peephole_stats = (PeepholeStats) {0};
+    }
+    if (!assemble_buffer(input, size, filename, as)) {
+        return false;
+    }
+    Program prog;
+    if (!init_program(&prog, as->allocator)
+            || !parse_program(input, size, &prog, as)
+            || !drop_dead_code(&prog, trusted, stats)) {
+        free_program(&prog);
+        memory_error(as);
+        return false;
+    }
+    if (peephole_stats) {
+        peephole_stats->words_before = stats->words_after;
+        while (peephole_pass(&prog, peephole_stats)) {
+            continue;
+        }
+    }
+    assemble_program(&prog, filename, as);
+    free_program(&prog);
+    stats->rom_size = as->num_words;
+    if (peephole_stats) {
+        peephole_stats->words_after = as->num_words;
+    }
+    return as->num_errors == 0 && !as->out_of_memory;
+}
+
+bool drop_dead_code(Program *prog, const char *trusted, DeadCodeStats *stats) {
+    const Allocator *allocator = prog->allocator;
+    CodeRegion *regions = NULL;
+    size_t num_regions = 0;
+    size_t names_size = prog->names->arena_size;
+    uint32_t *label_regions = mem_alloc(allocator,
+            (names_size ? names_size : 1)*sizeof(*label_regions));
+    if (!label_regions
+            || !find_regions(prog, &regions, &num_regions, label_regions)
+            || !mark_reachable(prog, regions, num_regions, label_regions)) {
+        mem_free(allocator, label_regions);
+        mem_free(allocator, regions);
+        return false;
+    }
+    stats->num_labels = num_regions - 1;
+    stats->words_before = prog->num_instrs - stats->num_labels;
+    stats->words_after = stats->words_before;
+    stats->untrusted_line = find_untrusted_jump(prog, regions, num_regions,
+            label_regions, trusted);
+
+    // the names of the labels dropped are gathered first, so that the
+    // program is left whole if there is not enough memory for them
+    size_t names_len = 0;
+    for (size_t r = 1; r < num_regions; ++r) {
+        if (!regions[r].reachable) {
+            names_len += prog->instrs[regions[r].first].name_len + 1;
+        }
+    }
+    bool success = true;
+    if (stats->untrusted_line == 0 && names_len > 0) {
+        if (!(stats->dropped_labels = malloc(names_len))) {
+            success = false;
+        }
+        size_t pos = 0, kept = 0;
+        for (size_t r = 0; success && r < num_regions; ++r) {
+            const CodeRegion *region = &regions[r];
+            if (region->reachable) {
+                memmove(prog->instrs + kept, prog->instrs + region->first,
+                        (region->end - region->first)*sizeof(*prog->instrs));
+                kept += region->end - region->first;
+                continue;
+            }
+            const Instr *label = &prog->instrs[region->first];
+            stats->words_after -= region->end - region->first - 1;
+            memcpy(stats->dropped_labels + pos,
+                    prog->names->arena + label->value, label->name_len);
+            pos += label->name_len;
+            stats->dropped_labels[pos++] = ' ';
+            ++stats->num_dropped;
+        }
+        if (success) {
+            stats->dropped_labels[pos - 1] = '\0';
+            prog->num_instrs = kept;
+        }
+    }
+    mem_free(allocator, label_regions);
+    mem_free(allocator, regions);
+    return success;
+}
+
+bool find_regions(const Program *prog, CodeRegion **regions,
+        size_t *num_regions, uint32_t *label_regions) {
+    size_t capacity = 0;
+    for (size_t i = 0; i < prog->names->arena_size; ++i) {
+        label_regions[i] = no_region;
+    }
+    for (size_t i = 0; i <= prog->num_instrs; ++i) {
+        bool at_label = i < prog->num_instrs
+            && prog->instrs[i].kind == INSTR_LABEL;
+        if (i > 0 && i < prog->num_instrs && !at_label) {
+            continue;
+        }
+        if (i > 0) { // ends the region before
+            CodeRegion *prev = &(*regions)[*num_regions - 1];
+            const Instr *last = &prog->instrs[i - 1];
+            prev->end = i;
+            prev->falls_through = last->kind != INSTR_C
+                || last->jump != JUMP_JMP;
+        }
+        if (i == prog->num_instrs) {
+            break;
+        }
+        if (i == 0 && at_label) { // empty region at the start
+            if (!grow_array(prog->allocator, regions, *num_regions,
+                        &capacity, sizeof(**regions))) {
+                return false;
+            }
+            (*regions)[(*num_regions)++] = (CodeRegion) {.first = 0, .end = 0,
+                .falls_through = true};
+        }
+        if (!grow_array(prog->allocator, regions, *num_regions, &capacity,
+                    sizeof(**regions))) {
+            return false;
+        }
+        if (at_label) {
+            label_regions[prog->instrs[i].value] = *num_regions;
+        }
+        (*regions)[(*num_regions)++] = (CodeRegion) {.first = i};
+    }
+    if (*num_regions == 0) { // empty program
+        if (!grow_array(prog->allocator, regions, 0, &capacity,
+                    sizeof(**regions))) {
+            return false;
+        }
+        (*regions)[(*num_regions)++] = (CodeRegion) {.falls_through = true};
+    }
+    return true;
+}
+
+bool mark_reachable(const Program *prog, CodeRegion *regions,
+        size_t num_regions, const uint32_t *label_regions) {
+    // regions reached but not scanned yet, each pushed once
+    uint32_t *stack = mem_alloc(prog->allocator,
+            num_regions*sizeof(*stack));
+    if (!stack) {
+        return false;
+    }
+    size_t num_stacked = 0;
+    regions[0].reachable = true;
+    stack[num_stacked++] = 0;
+    while (num_stacked > 0) {
+        uint32_t r = stack[--num_stacked];
+        const CodeRegion *region = &regions[r];
+        for (size_t i = region->first; i <= region->end; ++i) {
+            uint32_t target = no_region;
+            if (i == region->end) {
+                target = region->falls_through && r + 1 < num_regions
+                       ? r + 1 : no_region;
+            } else if (prog->instrs[i].kind == INSTR_A_SYMBOL) {
+                target = label_regions[prog->instrs[i].value];
+            }
+            if (target != no_region && !regions[target].reachable) {
+                regions[target].reachable = true;
+                stack[num_stacked++] = target;
+            }
+        }
+    }
+    mem_free(prog->allocator, stack);
+    return true;
+}
+
+int find_untrusted_jump(const Program *prog, const CodeRegion *regions,
+        size_t num_regions, const uint32_t *label_regions,
+        const char *trusted) {
+    for (size_t r = 0; r < num_regions; ++r) {
+        const CodeRegion *region = &regions[r];
+        const Instr *label = r > 0 ? &prog->instrs[region->first] : NULL;
+        if (!region->reachable || (label && is_trusted(trusted,
+                        prog->names->arena + label->value, label->name_len))
+                || (!label && trusted && !strcmp(trusted, "*"))) {
+            continue;
+        }
+        KnownRegisters known = {0};
+        for (size_t i = region->first; i < region->end; ++i) {
+            const Instr *instr = &prog->instrs[i];
+            if (instr->kind == INSTR_C && instr->jump != JUMP_NULL) {
+                const Instr *a = &known.a;
+                bool loaded = known.a_known
+                    && ((a->kind == INSTR_A_SYMBOL
+                            && label_regions[a->value] != no_region)
+                        || (a->kind == INSTR_A_VALUE && a->value == 0));
+                if (!loaded) {
+                    return instr->line_num;
+                }
+            }
+            update_known(&known, instr);
+        }
+    }
+    return 0;
+}
+
+bool is_trusted(const char *trusted, const char *name, size_t len) {
+    if (!trusted) {
+        return false;
+    }
+    if (!strcmp(trusted, "*")) {
+        return true;
+    }
+    const char *start = trusted;
+    while (true) {
+        const char *end = strchr(start, ',');
+        size_t trusted_len = end ? (size_t)(end - start) : strlen(start);
+        if (trusted_len == len && !memcmp(start, name, len)) {
+            return true;
+        }
+        if (!end) {
+            return false;
+        }
+        start = end + 1;
+    }
+}
+
+void print_dead_code_stats(FILE *stream, const char *filename,
+        const DeadCodeStats *stats) {
+    filename = filename ? filename : "stdin";
+    if (stats->untrusted_line > 0) {
+        fprintf(stream, "%s: no dead code dropped, line %d jumps to a "
+                "computed address; trust the label before it with "
+                "--dead-code=label, or all with --dead-code='*'\n", filename,
+                stats->untrusted_line);
+        return;
+    }
+    flockfile(stream);
+    fprintf(stream, "%s: dead code dropped %zu of %zu words, %zu of %zu "
+            "labels, ROM size %zu words", filename,
+            stats->words_before - stats->words_after, stats->words_before,
+            stats->num_dropped, stats->num_labels, stats->rom_size);
+    if (stats->num_dropped > 0) {
+        fprintf(stream, ": %s", stats->dropped_labels);
+    }
+    fputc('\n', stream);
+    funlockfile(stream);
+}
+
+void free_dead_code_stats(DeadCodeStats *stats) {
+    free(stats->dropped_labels);
+    stats->dropped_labels = NULL;
+}
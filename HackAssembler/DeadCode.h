@@ -0,0 +1,90 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+#include "Peephole.h"
+
+// data types
+
+// instructions of a program from a label definition, or from its start, up to
+// the next label definition
+typedef struct CodeRegion {
+    size_t first; // index of its first instruction, its label but for the
+                  // region at the start
+    size_t end;   // past its last instruction
+    bool falls_through; // into the next region, not ending with a jump that
+                        // is always taken
+    bool reachable;
+} CodeRegion;
+
+// labels and words dropped by the dead code elimination of a program
+typedef struct DeadCodeStats {
+    size_t words_before;
+    size_t words_after;
+    size_t rom_size; // words assembled in the end, after the peephole rewrites
+                     // if any
+    size_t num_labels;
+    size_t num_dropped;   // labels dropped, with the code after them
+    char *dropped_labels; // their names, separated by spaces, freed with
+                          // free_dead_code_stats
+    int untrusted_line;   // of the first reachable jump to a computed address
+                          // after a label not trusted, 0 if none. No code is
+                          // dropped then
+} DeadCodeStats;
+
+
+// functions
+
+// assembles the size characters of input into the words of as like
+// assemble_buffer, then drops the label regions that cannot be reached from
+// address 0, by falling through or by a reference to their label, and
+// assembles what is left again, recomputing the label addresses. A jump to
+// an address computed otherwise than by loading a label might reach any
+// region, so nothing is dropped if a reachable one follows a label that is
+// not in trusted, a list of labels separated by commas, or "*" for all, NULL
+// for none. The rewrites of the peephole optimizer are also applied if
+// peephole_stats is not NULL, and counted into it
+bool drop_dead_code_buffer(const char *input, size_t size,
+        const char *filename, Assembly *as, const char *trusted,
+        DeadCodeStats *stats, PeepholeStats *peephole_stats);
+
+// drops the unreachable label regions of the program, unless there is a
+// jump to a computed address after a label not trusted, counting them into
+// stats. Returns false if there is not enough memory
+bool drop_dead_code(Program *prog, const char *trusted, DeadCodeStats *stats);
+
+// splits the instructions of the program into label regions, placing the
+// region of each label at the offset of its name in label_regions, returns
+// false if there is not enough memory
+bool find_regions(const Program *prog, CodeRegion **regions,
+        size_t *num_regions, uint32_t *label_regions);
+
+// marks the regions reachable from the first one, returns false if there is
+// not enough memory
+bool mark_reachable(const Program *prog, CodeRegion *regions,
+        size_t num_regions, const uint32_t *label_regions);
+
+// returns the line of the first jump to a computed address in a reachable
+// region whose label is not trusted, 0 if there is none. A jump right after
+// loading a label, or address 0, is not computed
+int find_untrusted_jump(const Program *prog, const CodeRegion *regions,
+        size_t num_regions, const uint32_t *label_regions,
+        const char *trusted);
+
+// returns whether the label name of len characters is in trusted
+bool is_trusted(const char *trusted, const char *name, size_t len);
+
+// prints the words and labels dropped for the file filename, or why none
+// were
+void print_dead_code_stats(FILE *stream, const char *filename,
+        const DeadCodeStats *stats);
+
+// frees the names of the labels dropped
+void free_dead_code_stats(DeadCodeStats *stats);
+
+#endif
@@ -0,0 +1,347 @@
+#include "Emulator.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Input.h"
+
+// constants
+const size_t rom_size = 32768;
+const size_t ram_size = 32768;
+const uint16_t addr_mask = 0x7fff;
+const uint16_t c_instr_bit = 0x8000;
+const int word_bits = 16;
+
+// ALU control bits of the comp bits
+const uint8_t alu_a = 0x40;  // M rather than A as the y input
+const uint8_t alu_zx = 0x20; // zero x
+const uint8_t alu_nx = 0x10; // negate x
+const uint8_t alu_zy = 0x08; // zero y
+const uint8_t alu_ny = 0x04; // negate y
+const uint8_t alu_f = 0x02;  // x + y rather than x & y
+const uint8_t alu_no = 0x01; // negate the output
+
+const uint8_t dest_a = 0x4;
+const uint8_t dest_d = 0x2;
+const uint8_t dest_m = 0x1;
+
+const uint8_t jump_lt = 0x4;
+const uint8_t jump_eq = 0x2;
+const uint8_t jump_gt = 0x1;
+
+Emulator *new_emulator(const Allocator *allocator) {
+    if (!allocator) {
+        allocator = &default_allocator;
+    }
+    Emulator *em = mem_calloc(allocator, 1, sizeof(*em));
+    if (!em) {
+        return NULL;
+    }
+    em->allocator = allocator;
+    em->ops = mem_alloc(allocator, rom_size*sizeof(*em->ops));
+    em->ram = mem_alloc(allocator, ram_size*sizeof(*em->ram));
+    if (!em->ops || !em->ram) {
+        delete_emulator(em);
+        return NULL;
+    }
+    load_program(em, NULL, 0);
+    return em;
+}
+
+void delete_emulator(Emulator *em) {
+    if (!em) {
+        return;
+    }
+    mem_free(em->allocator, em->ops);
+    mem_free(em->allocator, em->ram);
+    mem_free(em->allocator, em);
+}
+
+bool load_program(Emulator *em, const uint16_t *words, size_t num_words) {
+    if (num_words > rom_size) {
+        return false;
+    }
+    decode_program(em->ops, words, num_words);
+    em->num_words = num_words;
+    reset_emulator(em);
+    return true;
+}
+
+void decode_program(EmulatorOp *ops, const uint16_t *words, size_t num_words) {
+    for (size_t i = 0; i < rom_size; ++i) {
+        decode_instruction(i < num_words ? words[i] : 0, &ops[i]);
+    }
+    for (size_t i = 1; i < num_words; ++i) {
+        EmulatorOp *op = &ops[i];
+        const EmulatorOp *prev = &ops[i - 1];
+        op->halts = op->kind != OP_LOAD && op->dest == 0 && op->jump != 0
+            && prev->kind == OP_LOAD && prev->value == i - 1;
+    }
+}
+
+void reset_emulator(Emulator *em) {
+    memset(em->ram, 0, ram_size*sizeof(*em->ram));
+    em->a = 0;
+    em->d = 0;
+    em->pc = 0;
+    em->cycles = 0;
+}
+
+void decode_instruction(uint16_t word, EmulatorOp *op) {
+    *op = (EmulatorOp) {0};
+    if (!(word & c_instr_bit)) {
+        op->kind = OP_LOAD;
+        op->value = word;
+        return;
+    }
+    op->comp = (word >> 6) & 0x7f;
+    op->dest = (word >> 3) & 0x7;
+    op->jump = word & 0x7;
+    CompToken comp;
+    op->kind = lookup_comp_token(op->comp, &comp) ? comp : OP_ALU;
+}
+
+bool lookup_comp_token(uint8_t comp, CompToken *token) {
+    for (int t = COMP_0; t <= COMP_D_OR_M; ++t) {
+        if (comp_bits[t] == comp) {
+            *token = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// M register, the RAM word addressed by A
+#define M ram[a & addr_mask]
+
+// runs the next op, or stops if the cycle limit is reached
+#define NEXT() do { \
+        if (remaining == 0) { \
+            goto cycle_limit; \
+        } \
+        --remaining; \
+        op = &ops[pc]; \
+        goto *handlers[op->kind]; \
+    } while (0)
+
+// stores the output of a C instruction into its dest registers, then jumps to
+// the address that was in A if the jump condition holds on the output. M is
+// written at the A from before the instruction
+#define STORE_AND_JUMP(out_expr) do { \
+        uint16_t out = (out_expr); \
+        uint16_t target = a; \
+        if (op->dest & dest_m) { \
+            M = out; \
+        } \
+        if (op->dest & dest_d) { \
+            d = out; \
+        } \
+        if (op->dest & dest_a) { \
+            a = out; \
+        } \
+        uint8_t sign = (int16_t)out < 0 ? jump_lt : out ? jump_gt : jump_eq; \
+        if (op->jump & sign) { \
+            pc = target & addr_mask; \
+            if (op->halts) { \
+                goto loop; \
+            } \
+        } else { \
+            pc = (pc + 1) & addr_mask; \
+        } \
+        NEXT(); \
+    } while (0)
+
+HaltReason run_emulator(Emulator *em, uint64_t max_cycles) {
+    // one handler per kind of op, indexed by its kind
+    static const void *const handlers[NUM_OP_KINDS] = {
+        [COMP_0]         = &&comp_0,
+        [COMP_1]         = &&comp_1,
+        [COMP_NEG_1]     = &&comp_neg_1,
+        [COMP_D]         = &&comp_d,
+        [COMP_A]         = &&comp_a,
+        [COMP_M]         = &&comp_m,
+        [COMP_NOT_D]     = &&comp_not_d,
+        [COMP_NOT_A]     = &&comp_not_a,
+        [COMP_NOT_M]     = &&comp_not_m,
+        [COMP_NEG_D]     = &&comp_neg_d,
+        [COMP_NEG_A]     = &&comp_neg_a,
+        [COMP_NEG_M]     = &&comp_neg_m,
+        [COMP_D_PLUS_1]  = &&comp_d_plus_1,
+        [COMP_A_PLUS_1]  = &&comp_a_plus_1,
+        [COMP_M_PLUS_1]  = &&comp_m_plus_1,
+        [COMP_D_MINUS_1] = &&comp_d_minus_1,
+        [COMP_A_MINUS_1] = &&comp_a_minus_1,
+        [COMP_M_MINUS_1] = &&comp_m_minus_1,
+        [COMP_D_PLUS_A]  = &&comp_d_plus_a,
+        [COMP_D_PLUS_M]  = &&comp_d_plus_m,
+        [COMP_D_MINUS_A] = &&comp_d_minus_a,
+        [COMP_D_MINUS_M] = &&comp_d_minus_m,
+        [COMP_A_MINUS_D] = &&comp_a_minus_d,
+        [COMP_M_MINUS_D] = &&comp_m_minus_d,
+        [COMP_D_AND_A]   = &&comp_d_and_a,
+        [COMP_D_AND_M]   = &&comp_d_and_m,
+        [COMP_D_OR_A]    = &&comp_d_or_a,
+        [COMP_D_OR_M]    = &&comp_d_or_m,
+        [OP_ALU]         = &&alu,
+        [OP_LOAD]        = &&load,
+    };
+    const EmulatorOp *ops = em->ops;
+    const EmulatorOp *op;
+    uint16_t *ram = em->ram;
+    uint16_t a = em->a;
+    uint16_t d = em->d;
+    uint16_t pc = em->pc;
+    uint64_t budget = max_cycles ? max_cycles : UINT64_MAX;
+    uint64_t remaining = budget;
+    HaltReason reason;
+    NEXT();
+
+load:
+    a = op->value;
+    pc = (pc + 1) & addr_mask;
+    NEXT();
+comp_0:         STORE_AND_JUMP(0);
+comp_1:         STORE_AND_JUMP(1);
+comp_neg_1:     STORE_AND_JUMP(0xffff);
+comp_d:         STORE_AND_JUMP(d);
+comp_a:         STORE_AND_JUMP(a);
+comp_m:         STORE_AND_JUMP(M);
+comp_not_d:     STORE_AND_JUMP(~d);
+comp_not_a:     STORE_AND_JUMP(~a);
+comp_not_m:     STORE_AND_JUMP(~M);
+comp_neg_d:     STORE_AND_JUMP(-d);
+comp_neg_a:     STORE_AND_JUMP(-a);
+comp_neg_m:     STORE_AND_JUMP(-M);
+comp_d_plus_1:  STORE_AND_JUMP(d + 1);
+comp_a_plus_1:  STORE_AND_JUMP(a + 1);
+comp_m_plus_1:  STORE_AND_JUMP(M + 1);
+comp_d_minus_1: STORE_AND_JUMP(d - 1);
+comp_a_minus_1: STORE_AND_JUMP(a - 1);
+comp_m_minus_1: STORE_AND_JUMP(M - 1);
+comp_d_plus_a:  STORE_AND_JUMP(d + a);
+comp_d_plus_m:  STORE_AND_JUMP(d + M);
+comp_d_minus_a: STORE_AND_JUMP(d - a);
+comp_d_minus_m: STORE_AND_JUMP(d - M);
+comp_a_minus_d: STORE_AND_JUMP(a - d);
+comp_m_minus_d: STORE_AND_JUMP(M - d);
+comp_d_and_a:   STORE_AND_JUMP(d & a);
+comp_d_and_m:   STORE_AND_JUMP(d & M);
+comp_d_or_a:    STORE_AND_JUMP(d | a);
+comp_d_or_m:    STORE_AND_JUMP(d | M);
+alu:            STORE_AND_JUMP(compute_alu(op->comp, d, a, M));
+
+loop:
+    reason = HALT_LOOP;
+    goto halt;
+cycle_limit:
+    reason = HALT_CYCLE_LIMIT;
+halt:
+    em->a = a;
+    em->d = d;
+    em->pc = pc;
+    em->cycles += budget - remaining;
+    return reason;
+}
+
+#undef M
+#undef NEXT
+#undef STORE_AND_JUMP
+
+uint16_t compute_alu(uint8_t comp, uint16_t d, uint16_t a, uint16_t m) {
+    uint16_t x = d;
+    uint16_t y = comp & alu_a ? m : a;
+    if (comp & alu_zx) {
+        x = 0;
+    }
+    if (comp & alu_nx) {
+        x = ~x;
+    }
+    if (comp & alu_zy) {
+        y = 0;
+    }
+    if (comp & alu_ny) {
+        y = ~y;
+    }
+    uint16_t out = comp & alu_f ? x + y : x & y;
+    return comp & alu_no ? ~out : out;
+}
+
+bool parse_hack_text(const char *text, size_t size, uint16_t *words,
+        size_t *num_words, size_t *bad_line) {
+    *num_words = 0;
+    size_t pos = 0;
+    size_t line_num = 0;
+    Field line;
+    while (next_line(text, size, &pos, &line)) {
+        ++line_num;
+        if (line.len > 0 && line.str[line.len - 1] == '\r') {
+            --line.len;
+        }
+        if (line.len == 0) {
+            continue;
+        }
+        if (line.len != (size_t)word_bits || *num_words == rom_size) {
+            *bad_line = line_num;
+            return false;
+        }
+        uint16_t word = 0;
+        for (int i = 0; i < word_bits; ++i) {
+            if (line.str[i] != '0' && line.str[i] != '1') {
+                *bad_line = line_num;
+                return false;
+            }
+            word = word << 1 | (line.str[i] - '0');
+        }
+        words[(*num_words)++] = word;
+    }
+    return true;
+}
+
+bool read_program(const char *filename, uint16_t *words, size_t *num_words,
+        FILE *error_stream) {
+    FILE *in_file = fopen(filename, "r");
+    InputBuffer input;
+    if (!in_file || !open_input(in_file, &input)) {
+        fprintf(error_stream, "Error: could not open file for reading: %s\n",
+                filename);
+        if (in_file) {
+            fclose(in_file);
+        }
+        return false;
+    }
+    bool success = false;
+    const char *extension = strrchr(filename, '.');
+    if (extension && !strcmp(extension, ".asm")) {
+        Assembly *as = new_assembly(NULL);
+        if (!as) {
+            fprintf(error_stream, "Error: out of memory\n");
+        } else {
+            as->error_stream = error_stream;
+            success = assemble_buffer(input.data, input.size, filename, as);
+            if (success && as->num_words > rom_size) {
+                fprintf(error_stream, "Error: %s: program does not fit in "
+                        "ROM\n", filename);
+                success = false;
+            }
+            if (success) {
+                memcpy(words, as->words, as->num_words*sizeof(*words));
+                *num_words = as->num_words;
+            }
+            delete_assembly(as);
+        }
+    } else {
+        size_t bad_line;
+        success = parse_hack_text(input.data, input.size, words, num_words,
+                &bad_line);
+        if (!success) {
+            fprintf(error_stream, "Error: %s:%zu: not a machine word, or past "
+                    "the end of ROM\n", filename, bad_line);
+        }
+    }
+    close_input(&input);
+    fclose(in_file);
+    return success;
+}
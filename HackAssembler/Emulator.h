@@ -0,0 +1,121 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Allocator.h"
+#include "HackAssembler.h"
+
+// data types
+
+// kinds of decoded instructions, past the comp tokens of C instructions
+enum {
+    OP_ALU = COMP_D_OR_M + 1, // C instruction with comp bits of no token
+    OP_LOAD,                  // A instruction
+    NUM_OP_KINDS
+};
+
+// machine word decoded once into the handler that runs it, and its operands
+typedef struct EmulatorOp {
+    uint16_t value; // loaded into A, by an A instruction
+    uint8_t kind;   // OP_LOAD, OP_ALU or the CompToken of a C instruction
+    uint8_t comp;   // comp bits, run by the ALU for OP_ALU
+    uint8_t dest;   // dest bits, A = 4, D = 2, M = 1
+    uint8_t jump;   // jump bits, taken if out < 0 = 4, == 0 = 2, > 0 = 1
+    bool halts;     // jump to the @ right before it, that changes nothing,
+                    // so it loops forever once taken
+} EmulatorOp;
+
+// why the emulator stopped running
+typedef enum HaltReason {
+    HALT_LOOP,       // took a jump that loops forever
+    HALT_CYCLE_LIMIT // ran the maximum number of instructions
+} HaltReason;
+
+// Hack computer running a pre-decoded program, with every ROM address decoded,
+// words past the program being 0, and a RAM of 32K words, that holds the
+// screen and keyboard maps. Addresses and the program counter wrap at 15 bits
+typedef struct Emulator {
+    const Allocator *allocator;
+    EmulatorOp *ops;
+    size_t num_words; // of the program loaded
+    uint16_t *ram;
+    uint16_t a;
+    uint16_t d;
+    uint16_t pc;
+    uint64_t cycles; // instructions run since the emulator was reset
+} Emulator;
+
+
+// constants
+
+// number of words of ROM and of RAM
+extern const size_t rom_size;
+extern const size_t ram_size;
+
+// mask of the 15 bits of addresses
+extern const uint16_t addr_mask;
+
+// dest bits
+extern const uint8_t dest_a;
+extern const uint8_t dest_d;
+extern const uint8_t dest_m;
+
+// jump bits, by the sign of the ALU output
+extern const uint8_t jump_lt;
+extern const uint8_t jump_eq;
+extern const uint8_t jump_gt;
+
+
+// functions
+
+// creates an emulator with an empty program, taking all its memory from
+// allocator, or from malloc if it is NULL. Returns NULL if there is not
+// enough memory
+Emulator *new_emulator(const Allocator *allocator);
+
+// deletes the emulator and its program from memory
+void delete_emulator(Emulator *em);
+
+// decodes num_words machine words into the program of the emulator, and resets
+// it, returns false if they do not fit in the ROM
+bool load_program(Emulator *em, const uint16_t *words, size_t num_words);
+
+// clears the registers, RAM and cycle count of the emulator, keeping its
+// program
+void reset_emulator(Emulator *em);
+
+// decodes num_words machine words, that fit in the ROM, into rom_size ops,
+// marking the jumps that loop forever
+void decode_program(EmulatorOp *ops, const uint16_t *words, size_t num_words);
+
+// decodes a machine word into its op, not knowing the ops around it
+void decode_instruction(uint16_t word, EmulatorOp *op);
+
+// maps comp bits to their token, returns false if they have none
+bool lookup_comp_token(uint8_t comp, CompToken *token);
+
+// runs the program from the current state, until it takes a jump that loops
+// forever or max_cycles instructions were run, 0 for no limit. Dispatches
+// through a table of handlers with computed goto, a GNU extension
+HaltReason run_emulator(Emulator *em, uint64_t max_cycles);
+
+// computes the ALU output of the comp bits, for inputs D, and A or M
+uint16_t compute_alu(uint8_t comp, uint16_t d, uint16_t a, uint16_t m);
+
+// parses the binary ASCII lines of a .hack file of size characters into words,
+// which must hold rom_size words. Returns false if a line is not 16 binary
+// digits, placing its number into bad_line, or if there are too many lines
+bool parse_hack_text(const char *text, size_t size, uint16_t *words,
+        size_t *num_words, size_t *bad_line);
+
+// reads the program of the file filename into words, which must hold rom_size
+// words, assembling it in memory if it is a .asm file, or parsing it as a
+// .hack file otherwise. Returns false on errors, printed to error_stream
+bool read_program(const char *filename, uint16_t *words, size_t *num_words,
+        FILE *error_stream);
+
+#endif
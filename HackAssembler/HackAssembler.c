@@ -1,4 +1,7 @@
 #include "HackAssembler.h"
+#include "Input.h"
+#include "Lexer.h"
+#include "PredefinedSymbols.h"
 #include "SymbolTable.h"
 
 #include <stdlib.h>
@@ -6,240 +9,587 @@
 
 
 // constants
-const size_t buf_size = 128; // maximum line length = 126 + '\n' + '\0'
-const size_t instr_size = 18; // 16 bits + '\n' + '\0'
+const size_t text_instr_size = 17;
+const size_t text_block_size = 4096;
 const size_t table_size = 128; // initial symbol table size
 
-void assemble_file(FILE *in_file, FILE *out_file) {
-    SymbolTable *st = initial_symbol_table(table_size);
-    read_label_symbols(in_file, st);
-    rewind(in_file);
+bool assemble_file(FILE *in_file, FILE *out_file) {
+    Assembly *as = new_assembly(NULL);
+    if (!as) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    as->error_stream = stderr;
+    bool success = assemble(in_file, NULL, as);
+    if (success && !write_text_words(out_file, as->words, as->num_words)) {
+        fprintf(stderr, "Error: could not write output\n");
+        success = false;
+    }
+    delete_assembly(as);
+    return success;
+}
 
-    char asm_instr[buf_size];
-    char bin_instr[instr_size];
-    bin_instr[instr_size-2] = '\n';
-    bin_instr[instr_size-1] = '\0';
+bool assemble(FILE *in_file, const char *filename, Assembly *as) {
+    InputBuffer input;
+    if (!open_input(in_file, &input)) {
+        reset_assembly(as);
+        as->filename = filename;
+        parse_error(as, 0, "could not read input", (Field) {NULL, 0});
+        return false;
+    }
+    bool success = assemble_buffer(input.data, input.size, filename, as);
+    close_input(&input);
+    return success;
+}
+
+bool assemble_buffer(const char *input, size_t size, const char *filename,
+        Assembly *as) {
+    reset_assembly(as);
+    as->filename = filename;
+    read_instructions(input, size, as);
+    if (!as->out_of_memory && !as->relocatable) { // variables linked later
+        resolve_variables(as);
+    }
+    return as->num_errors == 0 && !as->out_of_memory;
+}
+
+Assembly *new_assembly(const Allocator *allocator) {
+    if (!allocator) {
+        allocator = &default_allocator;
+    }
+    Assembly *as = mem_calloc(allocator, 1, sizeof(*as));
+    if (!as) {
+        return NULL;
+    }
+    as->allocator = allocator;
+    as->st = new_symbol_table(table_size, allocator);
+    as->pending_st = new_symbol_table(table_size, allocator);
+    if (!as->st || !as->pending_st) {
+        delete_assembly(as);
+        return NULL;
+    }
+    return as;
+}
+
+void reset_assembly(Assembly *as) {
+    clear_symbol_table(as->st);
+    clear_symbol_table(as->pending_st);
+    as->num_pending = 0;
+    as->num_fixups = 0;
+    as->num_words = 0;
+    as->words_base = 0;
+    as->filename = NULL;
+    for (size_t i = 0; i < as->num_errors; ++i) {
+        mem_free(as->allocator, as->errors[i].value);
+    }
+    as->num_errors = 0;
+    as->out_of_memory = false;
+}
+
+void delete_assembly(Assembly *as) {
+    const Allocator *allocator = as->allocator;
+    if (as->st) {
+        delete_symbol_table(as->st);
+    }
+    if (as->pending_st) {
+        delete_symbol_table(as->pending_st);
+    }
+    for (size_t i = 0; i < as->num_errors; ++i) {
+        mem_free(allocator, as->errors[i].value);
+    }
+    mem_free(allocator, as->errors);
+    mem_free(allocator, as->pending);
+    mem_free(allocator, as->fixups);
+    mem_free(allocator, as->words);
+    mem_free(allocator, as->scratch);
+    mem_free(allocator, as);
+}
+
+void read_instructions(const char *input, size_t size, Assembly *as) {
+    size_t pos = 0;
+    Field line;
     int line_num = 0;
-    while (fgets(asm_instr, buf_size, in_file)) {
-        ++line_num;
-        bool skip_line = parse_comments_and_whitespace(asm_instr);
-        if (skip_line || asm_instr[0] == '(') {
+    while (!as->out_of_memory && next_line(input, size, &pos, &line)) {
+        assemble_line(line, ++line_num, as);
+    }
+}
+
+void assemble_line(Field line, int line_num, Assembly *as) {
+    line = parse_comments_and_whitespace(line, as);
+    const char *asm_instr = line.str;
+    size_t len = line.len;
+    if (len == 0) { // nothing left, skip line
+        return;
+    }
+    // on errors, parsing goes on to report them all, and a placeholder
+    // word keeps the following addresses right
+    if (asm_instr[0] == '(') { // (label) definition
+        parse_label(asm_instr, len, line_num, as);
+    } else if (asm_instr[0] == '@') { // A instruction
+        uint16_t value;
+        parse_A_instruction(asm_instr, len, line_num, &value, as);
+        append_word(as, value);
+    } else { // C instruction
+        DestToken dest;
+        CompToken comp;
+        JumpToken jump;
+        bool valid = parse_C_instruction(asm_instr, len, line_num,
+                &comp, &dest, &jump, as);
+        append_word(as, valid ? encode_C_instruction(comp, dest, jump) : 0);
+    }
+}
+
+void resolve_variables(Assembly *as) {
+    uint16_t highest_var_addr = 16;
+    for (size_t i = 0; i < as->num_pending; ++i) {
+        PendingSymbol *ps = &as->pending[i];
+        if (ps->resolved) { // defined later as a (label)
             continue;
         }
-        if (asm_instr[0] == '@') { // A instruction
-            uint16_t value;
-            parse_A_instruction(asm_instr, line_num, &value, st);
-            interpret_A_instruction(value, bin_instr);
-        } else { // C instruction
-            DestToken dest;
-            CompToken comp;
-            JumpToken jump;
-            parse_C_instruction(asm_instr, line_num, &comp, &dest, &jump);
-            interpret_C_instruction(comp, dest, jump, bin_instr);
+        patch_fixups(as, ps, highest_var_addr++);
+    }
+}
+
+void patch_fixups(Assembly *as, PendingSymbol *ps, uint16_t value) {
+    for (size_t f = ps->first_fixup; f != NO_FIXUP; f = as->fixups[f].next) {
+        size_t addr = as->fixups[f].instr_addr;
+        if (addr >= as->words_base) {
+            as->words[addr - as->words_base] = value;
+        } else if (as->patch_taken) {
+            as->patch_taken(as->patch_context, addr, value);
         }
-        fputs(bin_instr, out_file); // write instruction to file
     }
+    ps->resolved = true;
 }
 
-void read_label_symbols(FILE *in_file, SymbolTable *st) {
-    char asm_instr[buf_size];
-    char key[buf_size];
-    uint16_t instr_addr = 0;
-    while (fgets(asm_instr, buf_size, in_file)) {
-        bool skip_line = parse_comments_and_whitespace(asm_instr);
-        if (skip_line) {
-            continue;
+bool grow_array(const Allocator *allocator, void *array_ptr, size_t size,
+        size_t *capacity, size_t elem_size) {
+    if (size < *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity ? 2*(*capacity) : 1024;
+    while (new_capacity <= size) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > SIZE_MAX / elem_size) {
+        return false;
+    }
+    // array_ptr points to an array pointer of any type, copied as bytes
+    void *array;
+    memcpy(&array, array_ptr, sizeof(array));
+    array = mem_realloc(allocator, array, new_capacity*elem_size);
+    if (!array) {
+        return false;
+    }
+    memcpy(array_ptr, &array, sizeof(array));
+    *capacity = new_capacity;
+    return true;
+}
+
+void append_word(Assembly *as, uint16_t word) {
+    if (!grow_array(as->allocator, &as->words, as->num_words - as->words_base,
+                &as->words_capacity, sizeof(*as->words))) {
+        memory_error(as);
+        return;
+    }
+    as->words[as->num_words++ - as->words_base] = word;
+}
+
+void take_words(Assembly *as, size_t addr) {
+    memmove(as->words, as->words + (addr - as->words_base),
+            (as->num_words - addr)*sizeof(*as->words));
+    as->words_base = addr;
+}
+
+bool append_assembly(Assembly *as, const Assembly *part) {
+    size_t num_errors = as->num_errors;
+    as->filename = part->filename;
+    for (size_t i = 0; i < part->num_errors; ++i) { // in the order found
+        const AssemblyError *error = &part->errors[i];
+        parse_error(as, error->line_num, error->message, (Field) {error->value,
+                error->value ? strlen(error->value) : 0});
+    }
+    if (part->out_of_memory) {
+        memory_error(as);
+    }
+    size_t base = as->num_words;
+    // pending symbols of the part, by index, the order they appeared in
+    const TableEntry **pending = mem_alloc(as->allocator,
+            (part->num_pending + 1)*sizeof(*pending));
+    if (!pending || !grow_array(as->allocator, &as->words,
+                base - as->words_base + part->num_words, &as->words_capacity,
+                sizeof(*as->words))) {
+        mem_free(as->allocator, pending);
+        memory_error(as);
+        return false;
+    }
+    if (part->num_words > 0) {
+        memcpy(as->words + (base - as->words_base), part->words,
+                part->num_words*sizeof(*as->words));
+    }
+    as->num_words += part->num_words;
+    for (size_t i = 0; i < part->st->size; ++i) {
+        const TableEntry *entry = &part->st->table[i];
+        if (entry->key_len != 0) {
+            define_label_at(part->st->arena + entry->key_offset,
+                    entry->key_len, base + entry->value, 0, as);
         }
-        if (1 > sscanf(asm_instr, "(%[^)])", key)) {
-            ++instr_addr; // regular instruction, increment current instruction
-        } else { // found (label)
-            insert_symbol(st, key, instr_addr); 
+    }
+    for (size_t i = 0; i < part->pending_st->size; ++i) {
+        const TableEntry *entry = &part->pending_st->table[i];
+        if (entry->key_len != 0) {
+            pending[entry->value] = entry;
+        }
+    }
+    // symbols first referenced by the part become pending in as in the same
+    // order, so variables are allocated as if it had been assembled into as
+    for (size_t i = 0; i < part->num_pending; ++i) {
+        const char *key = part->pending_st->arena + pending[i]->key_offset;
+        uint32_t value;
+        bool defined = lookup_key(as->st, key, pending[i]->key_len, &value);
+        for (size_t f = part->pending[i].first_fixup; f != NO_FIXUP;
+                f = part->fixups[f].next) {
+            size_t addr = base + part->fixups[f].instr_addr;
+            if (defined) {
+                as->words[addr - as->words_base] = value;
+            } else {
+                add_fixup_at(as, key, pending[i]->key_len, 0, addr);
+            }
         }
     }
+    mem_free(as->allocator, pending);
+    return as->num_errors == num_errors && !as->out_of_memory;
 }
 
-bool parse_comments_and_whitespace(char *asm_instr) {
-    char *comment_beginning = strstr(asm_instr, "//");
-    if (comment_beginning) {
-        *comment_beginning = '\0'; // terminate line at comment beginning
+Field parse_comments_and_whitespace(Field line, Assembly *as) {
+    const char *beginning = NULL; // first non-space character
+    const char *end = line.str;   // past the last non-space character
+    bool inner_space = false;
+    for (const char *c = line.str; c != line.str + line.len; ++c) {
+        if (*c == '/' && c+1 != line.str + line.len && c[1] == '/') {
+            break; // line ends at comment beginning
+        }
+        if (isspace((unsigned char)*c)) {
+            continue;
+        }
+        if (!beginning) {
+            beginning = c;
+        } else if (end != c) { // space between non-space characters
+            inner_space = true;
+        }
+        end = c + 1;
+    }
+    if (!beginning) { // there's nothing left
+        return (Field) {line.str, 0};
     }
-    // strip spaces from instruction
-    for (size_t i = 0, j = 0; asm_instr[j] != '\0'; ++i) {
-        if (!isspace(asm_instr[i])) {
-            asm_instr[j++] = asm_instr[i];
+    if (!inner_space) { // view of the line, no copy needed
+        return (Field) {beginning, end - beginning};
+    }
+    // strip inner spaces into the scratch buffer
+    if (!grow_array(as->allocator, &as->scratch, end - beginning,
+                &as->scratch_capacity, 1)) {
+        memory_error(as);
+        return (Field) {line.str, 0};
+    }
+    size_t len = 0;
+    for (const char *c = beginning; c != end; ++c) {
+        if (!isspace((unsigned char)*c)) {
+            as->scratch[len++] = *c;
         }
     }
-    if (*asm_instr)
+    return (Field) {as->scratch, len};
+}
+
+bool parse_label(const char *asm_instr, size_t len, int line_num,
+        Assembly *as) {
+    const char *label_end = memchr(asm_instr, ')', len);
+    if (!label_end) {
+        label_end = asm_instr + len;
+    }
+    size_t key_len = label_end - (asm_instr+1);
+    if (key_len == 0) {
+        parse_error(as, line_num, "invalid label", (Field) {asm_instr, len});
         return false;
-    else
-        return true; // there's nothing left, skip line
-}
-
-void parse_A_instruction(const char *asm_instr, int line_num, uint16_t *value,
-        SymbolTable *st) {
-    static uint16_t highest_var_addr = 16;
-    uint16_t value_tmp;
-    char key[buf_size];
-    if (1 == sscanf(asm_instr, "@%" SCNu16, &value_tmp)) {
-        if (value_tmp >> 15) {
-            parse_error(line_num, "value should be 15-bits", asm_instr);
-        }
-        ;
-    } else if (1 == sscanf(asm_instr, "@%s", key)) {
-        if (lookup_key(st, key, &value_tmp)) {
-            ;
-        } else {
-            value_tmp = highest_var_addr++;
-            insert_symbol(st, key, value_tmp);
+    }
+    return define_label(asm_instr+1, key_len, line_num, as);
+}
+
+bool define_label(const char *key, size_t key_len, int line_num,
+        Assembly *as) {
+    return define_label_at(key, key_len, as->num_words, line_num, as);
+}
+
+bool define_label_at(const char *key, size_t key_len, size_t addr,
+        int line_num, Assembly *as) {
+    uint16_t label_addr = addr;
+    uint32_t predefined_value;
+    InsertResult inserted = INSERT_DUPLICATE;
+    if (!lookup_predefined(key, key_len, &predefined_value)) {
+        inserted = insert_symbol(as->st, key, key_len, label_addr);
+    }
+    if (inserted == INSERT_NO_MEMORY) {
+        memory_error(as);
+        return false;
+    }
+    if (inserted != INSERT_OK) {
+        parse_error(as, line_num, "label already defined",
+                (Field) {key, key_len});
+        return false;
+    }
+    uint32_t pending_idx;
+    if (lookup_key(as->pending_st, key, key_len, &pending_idx)) {
+        patch_fixups(as, &as->pending[pending_idx], label_addr); // forward refs
+    }
+    return true;
+}
+
+bool add_fixup(Assembly *as, const char *key, size_t len, int line_num) {
+    return add_fixup_at(as, key, len, line_num, as->num_words);
+}
+
+bool add_fixup_at(Assembly *as, const char *key, size_t len, int line_num,
+        size_t addr) {
+    if (!grow_array(as->allocator, &as->fixups, as->num_fixups,
+                &as->fixups_capacity, sizeof(*as->fixups))) {
+        memory_error(as);
+        return false;
+    }
+    size_t fixup_idx = as->num_fixups++;
+    as->fixups[fixup_idx].instr_addr = addr;
+    as->fixups[fixup_idx].next = NO_FIXUP;
+
+    uint32_t pending_idx;
+    if (!add_pending(as, key, len, line_num, &pending_idx)) {
+        return false;
+    }
+    PendingSymbol *ps = &as->pending[pending_idx];
+    if (ps->last_fixup == NO_FIXUP) {
+        ps->first_fixup = fixup_idx;
+    } else { // chain to last
+        as->fixups[ps->last_fixup].next = fixup_idx;
+    }
+    ps->last_fixup = fixup_idx;
+    return true;
+}
+
+bool add_pending(Assembly *as, const char *key, size_t len, int line_num,
+        uint32_t *pending_idx) {
+    if (lookup_key(as->pending_st, key, len, pending_idx)) {
+        return true;
+    }
+    if (as->num_pending > UINT32_MAX) {
+        parse_error(as, line_num, "too many undefined symbols",
+                (Field) {key, len});
+        return false;
+    }
+    if (!grow_array(as->allocator, &as->pending, as->num_pending,
+                &as->pending_capacity, sizeof(*as->pending))
+            || insert_symbol(as->pending_st, key, len, as->num_pending)
+               != INSERT_OK) {
+        memory_error(as);
+        return false;
+    }
+    *pending_idx = as->num_pending++;
+    as->pending[*pending_idx] = (PendingSymbol) {
+        .first_fixup = NO_FIXUP, .last_fixup = NO_FIXUP, .resolved = false};
+    return true;
+}
+
+bool parse_A_instruction(const char *asm_instr, size_t len, int line_num,
+        uint16_t *value, Assembly *as) {
+    uint16_t value_tmp = 0;
+    Field key = {asm_instr+1, len-1}; // the rest of the line
+    bool valid = true;
+    if (key.len == 0) {
+        parse_error(as, line_num, "missing value or symbol",
+                (Field) {asm_instr, len});
+        valid = false;
+    } else if (isdigit((unsigned char)*key.str)) {
+        if (!lex_value(key, &value_tmp)) {
+            parse_error(as, line_num, "value should be 15-bits", key);
+            valid = false;
         }
+    } else {
+        valid = reference_symbol(key.str, key.len, line_num, &value_tmp, as);
     }
     *value = value_tmp;
+    return valid;
 }
 
-void parse_C_instruction(const char *asm_instr, int line_num,
-        CompToken *comp, DestToken *dest, JumpToken *jump) {
-    char dest_str[buf_size] = "";
-    char comp_str[buf_size] = "";
-    char jump_str[buf_size] = "";
-    if (3 == sscanf(asm_instr, "%[^=]=%[^;];%s", dest_str, comp_str, jump_str)) {
-    } else if (2 == sscanf(asm_instr, "%[^;];%s", comp_str, jump_str)) {
-        *dest_str = '\0';
-    } else if (2 == sscanf(asm_instr, "%[^=]=%s", dest_str, comp_str)) {
-        *jump_str = '\0';
-    } else {
-        strcpy(comp_str, asm_instr);
-        *dest_str = '\0';
-        *jump_str = '\0';
-    }
-    // printf("dest: %s, comp: %s, jump: %s\n", dest_str, comp_str, jump_str);
-    if      (!strcmp(dest_str, ""))    *dest = DEST_NULL;
-    else if (!strcmp(dest_str, "M"))   *dest = DEST_M;
-    else if (!strcmp(dest_str, "D"))   *dest = DEST_D;
-    else if (!strcmp(dest_str, "MD"))  *dest = DEST_MD;
-    else if (!strcmp(dest_str, "A"))   *dest = DEST_A;
-    else if (!strcmp(dest_str, "AM"))  *dest = DEST_AM;
-    else if (!strcmp(dest_str, "AD"))  *dest = DEST_AD;
-    else if (!strcmp(dest_str, "AMD")) *dest = DEST_AMD;
-    else parse_error(line_num, "unknown dest token", dest_str);
-
-    if      (!strcmp(comp_str, "0"))   *comp = COMP_0;
-    else if (!strcmp(comp_str, "1"))   *comp = COMP_1;
-    else if (!strcmp(comp_str, "-1"))  *comp = COMP_NEG_1;
-    else if (!strcmp(comp_str, "D"))   *comp = COMP_D;
-    else if (!strcmp(comp_str, "A"))   *comp = COMP_A;
-    else if (!strcmp(comp_str, "M"))   *comp = COMP_M;
-    else if (!strcmp(comp_str, "!D"))  *comp = COMP_NOT_D;
-    else if (!strcmp(comp_str, "!A"))  *comp = COMP_NOT_A;
-    else if (!strcmp(comp_str, "!M"))  *comp = COMP_NOT_M;
-    else if (!strcmp(comp_str, "-D"))  *comp = COMP_NEG_D;
-    else if (!strcmp(comp_str, "-A"))  *comp = COMP_NEG_A;
-    else if (!strcmp(comp_str, "-M"))  *comp = COMP_NEG_M;
-    else if (!strcmp(comp_str, "D+1")) *comp = COMP_D_PLUS_1;
-    else if (!strcmp(comp_str, "A+1")) *comp = COMP_A_PLUS_1;
-    else if (!strcmp(comp_str, "M+1")) *comp = COMP_M_PLUS_1;
-    else if (!strcmp(comp_str, "D-1")) *comp = COMP_D_MINUS_1;
-    else if (!strcmp(comp_str, "A-1")) *comp = COMP_A_MINUS_1;
-    else if (!strcmp(comp_str, "M-1")) *comp = COMP_M_MINUS_1;
-    else if (!strcmp(comp_str, "D+A")) *comp = COMP_D_PLUS_A;
-    else if (!strcmp(comp_str, "D+M")) *comp = COMP_D_PLUS_M;
-    else if (!strcmp(comp_str, "D-A")) *comp = COMP_D_MINUS_A;
-    else if (!strcmp(comp_str, "D-M")) *comp = COMP_D_MINUS_M;
-    else if (!strcmp(comp_str, "A-D")) *comp = COMP_A_MINUS_D;
-    else if (!strcmp(comp_str, "M-D")) *comp = COMP_M_MINUS_D;
-    else if (!strcmp(comp_str, "D&A")) *comp = COMP_D_AND_A;
-    else if (!strcmp(comp_str, "D&M")) *comp = COMP_D_AND_M;
-    else if (!strcmp(comp_str, "D|A")) *comp = COMP_D_OR_A;
-    else if (!strcmp(comp_str, "D|M")) *comp = COMP_D_OR_M;
-    else parse_error(line_num, "unknown comp token", comp_str);
-
-    if      (!strcmp(jump_str, ""))    *jump = JUMP_NULL;
-    else if (!strcmp(jump_str, "JGT")) *jump = JUMP_JGT;
-    else if (!strcmp(jump_str, "JEQ")) *jump = JUMP_JEQ;
-    else if (!strcmp(jump_str, "JGE")) *jump = JUMP_JGE;
-    else if (!strcmp(jump_str, "JLT")) *jump = JUMP_JLT;
-    else if (!strcmp(jump_str, "JNE")) *jump = JUMP_JNE;
-    else if (!strcmp(jump_str, "JLE")) *jump = JUMP_JLE;
-    else if (!strcmp(jump_str, "JMP")) *jump = JUMP_JMP;
-    else parse_error(line_num, "unknown jump token", jump_str);
-}
-
-void interpret_A_instruction(uint16_t value, char *bin_instr) {
-    uint16_t mask = 1 << 15; // 1000 0000 0000 0000
-    for (; mask != 0; mask >>= 1) {
-        *bin_instr++ = ((value & mask) == mask) ? '1' : '0';
+bool reference_symbol(const char *key, size_t len, int line_num,
+        uint16_t *value, Assembly *as) {
+    uint32_t symbol_value;
+    if (lookup_predefined(key, len, &symbol_value)
+            || (!as->relocatable
+                && lookup_key(as->st, key, len, &symbol_value))) {
+        *value = symbol_value;
+        return true;
+    }
+    *value = 0; // not defined yet, or to be relocated
+    return add_fixup(as, key, len, line_num);
+}
+
+bool parse_C_instruction(const char *asm_instr, size_t len, int line_num,
+        CompToken *comp, DestToken *dest, JumpToken *jump, Assembly *as) {
+    Field dest_field, comp_field, jump_field;
+    split_C_instruction(asm_instr, len, &dest_field, &comp_field, &jump_field);
+    bool valid = true;
+    if (!lex_dest(dest_field, dest)) {
+        parse_error(as, line_num, "unknown dest token", dest_field);
+        valid = false;
+    }
+    if (!lex_comp(comp_field, comp)) {
+        parse_error(as, line_num, "unknown comp token", comp_field);
+        valid = false;
     }
+    if (!lex_jump(jump_field, jump)) {
+        parse_error(as, line_num, "unknown jump token", jump_field);
+        valid = false;
+    }
+    return valid;
 }
 
 // constants
-const int num_op_bits = 3;
 const int num_comp_bits = 7;
 const int num_dest_bits = 3;
 const int num_jump_bits = 3;
+const uint16_t c_instr_op = 0x7; // 111
+
+const uint16_t comp_bits[] = {
+    [COMP_0]         = 0x2a, // 0101010
+    [COMP_1]         = 0x3f, // 0111111
+    [COMP_NEG_1]     = 0x3a, // 0111010
+    [COMP_D]         = 0x0c, // 0001100
+    [COMP_A]         = 0x30, // 0110000
+    [COMP_M]         = 0x70, // 1110000
+    [COMP_NOT_D]     = 0x0d, // 0001101
+    [COMP_NOT_A]     = 0x31, // 0110001
+    [COMP_NOT_M]     = 0x71, // 1110001
+    [COMP_NEG_D]     = 0x0f, // 0001111
+    [COMP_NEG_A]     = 0x33, // 0110011
+    [COMP_NEG_M]     = 0x73, // 1110011
+    [COMP_D_PLUS_1]  = 0x1f, // 0011111
+    [COMP_A_PLUS_1]  = 0x37, // 0110111
+    [COMP_M_PLUS_1]  = 0x77, // 1110111
+    [COMP_D_MINUS_1] = 0x0e, // 0001110
+    [COMP_A_MINUS_1] = 0x32, // 0110010
+    [COMP_M_MINUS_1] = 0x72, // 1110010
+    [COMP_D_PLUS_A]  = 0x02, // 0000010
+    [COMP_D_PLUS_M]  = 0x42, // 1000010
+    [COMP_D_MINUS_A] = 0x13, // 0010011
+    [COMP_D_MINUS_M] = 0x53, // 1010011
+    [COMP_A_MINUS_D] = 0x07, // 0000111
+    [COMP_M_MINUS_D] = 0x47, // 1000111
+    [COMP_D_AND_A]   = 0x00, // 0000000
+    [COMP_D_AND_M]   = 0x40, // 1000000
+    [COMP_D_OR_A]    = 0x15, // 0010101
+    [COMP_D_OR_M]    = 0x55, // 1010101
+};
+
+const uint16_t dest_bits[] = {
+    [DEST_NULL] = 0x0, [DEST_M]  = 0x1, [DEST_D]  = 0x2, [DEST_MD]  = 0x3,
+    [DEST_A]    = 0x4, [DEST_AM] = 0x5, [DEST_AD] = 0x6, [DEST_AMD] = 0x7,
+};
+
+const uint16_t jump_bits[] = {
+    [JUMP_NULL] = 0x0, [JUMP_JGT] = 0x1, [JUMP_JEQ] = 0x2, [JUMP_JGE] = 0x3,
+    [JUMP_JLT]  = 0x4, [JUMP_JNE] = 0x5, [JUMP_JLE] = 0x6, [JUMP_JMP] = 0x7,
+};
+
+uint16_t encode_C_instruction(CompToken comp, DestToken dest, JumpToken jump) {
+    return c_instr_op << (num_comp_bits + num_dest_bits + num_jump_bits)
+         | comp_bits[comp] << (num_dest_bits + num_jump_bits)
+         | dest_bits[dest] << num_jump_bits
+         | jump_bits[jump];
+}
+
+// binary ASCII digits of each byte value, most significant bit first
+#define BIT_CHAR(n, b) ('0' + (((n) >> (b)) & 1))
+#define BYTE_TEXT(n) {BIT_CHAR(n, 7), BIT_CHAR(n, 6), BIT_CHAR(n, 5), \
+    BIT_CHAR(n, 4), BIT_CHAR(n, 3), BIT_CHAR(n, 2), BIT_CHAR(n, 1), \
+    BIT_CHAR(n, 0)}
+#define BYTE_TEXT_4(n) BYTE_TEXT(n), BYTE_TEXT(n+1), BYTE_TEXT(n+2), \
+    BYTE_TEXT(n+3)
+#define BYTE_TEXT_16(n) BYTE_TEXT_4(n), BYTE_TEXT_4(n+4), BYTE_TEXT_4(n+8), \
+    BYTE_TEXT_4(n+12)
+const char byte_text[256][8] = {
+    BYTE_TEXT_16(0),   BYTE_TEXT_16(16),  BYTE_TEXT_16(32),  BYTE_TEXT_16(48),
+    BYTE_TEXT_16(64),  BYTE_TEXT_16(80),  BYTE_TEXT_16(96),  BYTE_TEXT_16(112),
+    BYTE_TEXT_16(128), BYTE_TEXT_16(144), BYTE_TEXT_16(160), BYTE_TEXT_16(176),
+    BYTE_TEXT_16(192), BYTE_TEXT_16(208), BYTE_TEXT_16(224), BYTE_TEXT_16(240),
+};
+
+void words_to_text(const uint16_t *words, size_t num_words, char *text) {
+    for (size_t i = 0; i < num_words; ++i) {
+        memcpy(text, byte_text[words[i] >> 8], 8);
+        memcpy(text + 8, byte_text[words[i] & 0xff], 8);
+        text[16] = '\n';
+        text += text_instr_size;
+    }
+}
 
-void interpret_C_instruction(CompToken comp, DestToken dest, JumpToken jump,
-        char *bin_instr) {
-    memcpy(bin_instr, "111", num_op_bits);
-    bin_instr += num_op_bits;
-    switch (comp) {
-        case COMP_0:         memcpy(bin_instr, "0101010", num_comp_bits); break;
-        case COMP_1:         memcpy(bin_instr, "0111111", num_comp_bits); break;
-        case COMP_NEG_1:     memcpy(bin_instr, "0111010", num_comp_bits); break;
-        case COMP_D:         memcpy(bin_instr, "0001100", num_comp_bits); break;
-        case COMP_A:         memcpy(bin_instr, "0110000", num_comp_bits); break;
-        case COMP_M:         memcpy(bin_instr, "1110000", num_comp_bits); break;
-        case COMP_NOT_D:     memcpy(bin_instr, "0001101", num_comp_bits); break;
-        case COMP_NOT_A:     memcpy(bin_instr, "0110001", num_comp_bits); break;
-        case COMP_NOT_M:     memcpy(bin_instr, "1110001", num_comp_bits); break;
-        case COMP_NEG_D:     memcpy(bin_instr, "0001111", num_comp_bits); break;
-        case COMP_NEG_A:     memcpy(bin_instr, "0110011", num_comp_bits); break;
-        case COMP_NEG_M:     memcpy(bin_instr, "1110011", num_comp_bits); break;
-        case COMP_D_PLUS_1:  memcpy(bin_instr, "0011111", num_comp_bits); break;
-        case COMP_A_PLUS_1:  memcpy(bin_instr, "0110111", num_comp_bits); break;
-        case COMP_M_PLUS_1:  memcpy(bin_instr, "1110111", num_comp_bits); break;
-        case COMP_D_MINUS_1: memcpy(bin_instr, "0001110", num_comp_bits); break;
-        case COMP_A_MINUS_1: memcpy(bin_instr, "0110010", num_comp_bits); break;
-        case COMP_M_MINUS_1: memcpy(bin_instr, "1110010", num_comp_bits); break;
-        case COMP_D_PLUS_A:  memcpy(bin_instr, "0000010", num_comp_bits); break;
-        case COMP_D_PLUS_M:  memcpy(bin_instr, "1000010", num_comp_bits); break;
-        case COMP_D_MINUS_A: memcpy(bin_instr, "0010011", num_comp_bits); break;
-        case COMP_D_MINUS_M: memcpy(bin_instr, "1010011", num_comp_bits); break;
-        case COMP_A_MINUS_D: memcpy(bin_instr, "0000111", num_comp_bits); break;
-        case COMP_M_MINUS_D: memcpy(bin_instr, "1000111", num_comp_bits); break;
-        case COMP_D_AND_A:   memcpy(bin_instr, "0000000", num_comp_bits); break;
-        case COMP_D_AND_M:   memcpy(bin_instr, "1000000", num_comp_bits); break;
-        case COMP_D_OR_A:    memcpy(bin_instr, "0010101", num_comp_bits); break;
-        case COMP_D_OR_M:    memcpy(bin_instr, "1010101", num_comp_bits); break;
-    }
-    bin_instr += num_comp_bits;
-
-    switch (dest) {
-        case DEST_NULL: memcpy(bin_instr, "000", num_dest_bits); break;
-        case DEST_M:    memcpy(bin_instr, "001", num_dest_bits); break;
-        case DEST_D:    memcpy(bin_instr, "010", num_dest_bits); break;
-        case DEST_MD:   memcpy(bin_instr, "011", num_dest_bits); break;
-        case DEST_A:    memcpy(bin_instr, "100", num_dest_bits); break;
-        case DEST_AM:   memcpy(bin_instr, "101", num_dest_bits); break;
-        case DEST_AD:   memcpy(bin_instr, "110", num_dest_bits); break;
-        case DEST_AMD:  memcpy(bin_instr, "111", num_dest_bits); break;
-    }
-    bin_instr += num_dest_bits;
-
-    switch (jump) {
-
-        case JUMP_NULL: memcpy(bin_instr, "000", num_jump_bits); break;
-        case JUMP_JGT:  memcpy(bin_instr, "001", num_jump_bits); break;
-        case JUMP_JEQ:  memcpy(bin_instr, "010", num_jump_bits); break;
-        case JUMP_JGE:  memcpy(bin_instr, "011", num_jump_bits); break;
-        case JUMP_JLT:  memcpy(bin_instr, "100", num_jump_bits); break;
-        case JUMP_JNE:  memcpy(bin_instr, "101", num_jump_bits); break;
-        case JUMP_JLE:  memcpy(bin_instr, "110", num_jump_bits); break;
-        case JUMP_JMP:  memcpy(bin_instr, "111", num_jump_bits); break;
-    }
-}
-
-void parse_error(int line_num, const char *error_msg, const char *error_val) {
-    fprintf(stderr, "Error: parsing line %d: %s: %s\n",
-            line_num, error_msg, error_val);
-    exit(EXIT_FAILURE);
+bool write_text_words(FILE *out_file, const uint16_t *words, size_t num_words) {
+    char *text = malloc(text_block_size*text_instr_size);
+    if (!text) {
+        return false;
+    }
+    bool success = true;
+    for (size_t i = 0; success && i < num_words; i += text_block_size) {
+        size_t block_size = num_words - i < text_block_size
+                          ? num_words - i : text_block_size;
+        words_to_text(words + i, block_size, text);
+        success = fwrite(text, text_instr_size, block_size, out_file)
+            == block_size;
+    }
+    free(text);
+    return success;
+}
+
+void parse_error(Assembly *as, int line_num, const char *error_msg,
+        Field error_val) {
+    if (as->error_stream) {
+        print_error(as->error_stream, as->filename, line_num, error_msg,
+                error_val);
+    }
+    char *value = NULL;
+    if (!grow_array(as->allocator, &as->errors, as->num_errors,
+                &as->errors_capacity, sizeof(*as->errors))
+            || (error_val.str
+                && !(value = mem_alloc(as->allocator, error_val.len + 1)))) {
+        memory_error(as); // the assembly fails, even if it is not recorded
+        return;
+    }
+    if (value) {
+        memcpy(value, error_val.str, error_val.len);
+        value[error_val.len] = '\0';
+    }
+    as->errors[as->num_errors++] = (AssemblyError) {
+        .line_num = line_num, .message = error_msg, .value = value};
 }
 
+void print_error(FILE *stream, const char *filename, int line_num,
+        const char *error_msg, Field error_val) {
+    flockfile(stream); // keep the message whole when assembling in parallel
+    if (filename) {
+        fprintf(stream, "Error: %s: ", filename);
+    } else {
+        fprintf(stream, "Error: ");
+    }
+    if (line_num > 0) {
+        fprintf(stream, "parsing line %d: ", line_num);
+    }
+    fprintf(stream, "%s", error_msg);
+    if (error_val.str) {
+        fprintf(stream, ": %.*s", (int)error_val.len, error_val.str);
+    }
+    fputc('\n', stream);
+    funlockfile(stream);
+}
+
+void memory_error(Assembly *as) {
+    if (!as->out_of_memory && as->error_stream) {
+        print_error(as->error_stream, as->filename, 0, "out of memory",
+                (Field) {NULL, 0});
+    }
+    as->out_of_memory = true;
+}
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "Allocator.h"
+
 // forward declaration of SymbolTable
 struct SymbolTable;
 typedef struct SymbolTable SymbolTable;
@@ -12,6 +14,12 @@ typedef struct SymbolTable SymbolTable;
 
 // data types
 
+// view of a line of the input, or of a field in it, not null terminated
+typedef struct Field {
+    const char *str;
+    size_t len;
+} Field;
+
 // comp tokens for C instruction
 typedef enum CompToken {
     COMP_0,         COMP_1,         COMP_NEG_1,
@@ -36,38 +44,221 @@ typedef enum JumpToken {
     JUMP_JGT, JUMP_JEQ, JUMP_JGE, JUMP_JLT, JUMP_JNE, JUMP_JLE, JUMP_JMP
 } JumpToken;
 
+// marks the end of a chain of fixups
+#define NO_FIXUP SIZE_MAX
+
+// instruction referencing a symbol that was not defined yet, chained to the
+// other fixups of the same symbol
+typedef struct Fixup {
+    size_t instr_addr; // address of the instruction word to patch
+    size_t next;       // index of the next fixup of the same symbol
+} Fixup;
+
+// symbol referenced before its definition, heads a chain of fixups that are
+// patched with its address once it is known
+typedef struct PendingSymbol {
+    size_t first_fixup;
+    size_t last_fixup;
+    bool resolved;
+} PendingSymbol;
+
+// error found while assembling, the value is a null terminated copy of the
+// offending text, or NULL if there is none
+typedef struct AssemblyError {
+    int line_num; // 0 if the error is not tied to a line
+    const char *message;
+    char *value;
+} AssemblyError;
+
+// state of a single-pass assembly: instructions are encoded once into the
+// word array, and forward references are backpatched when the (label) is
+// seen, or allocated as variables at the end of the input. It is the context
+// of the library: assemblies share no state, and can be used from any thread
+typedef struct Assembly {
+    const Allocator *allocator; // all the memory of the assembly comes from it
+    SymbolTable *st;         // labels, predefined symbols are looked up first
+    SymbolTable *pending_st; // names of pending symbols, to their index
+    PendingSymbol *pending;
+    size_t num_pending;
+    size_t pending_capacity;
+    Fixup *fixups;
+    size_t num_fixups;
+    size_t fixups_capacity;
+    uint16_t *words;      // from the address words_base
+    size_t num_words;     // address of the next word
+    size_t words_capacity;
+    size_t words_base;    // 0 unless words were taken out, see take_words
+    void (*patch_taken)(void *context, size_t addr, uint16_t value);
+    void *patch_context;  // of patch_taken, that patches the words taken out
+    char *scratch; // instruction stripped of inner whitespace
+    size_t scratch_capacity;
+    const char *filename; // named in error messages, if not NULL
+    AssemblyError *errors;
+    size_t num_errors;
+    size_t errors_capacity;
+    FILE *error_stream; // errors are also printed to it, if not NULL
+    bool out_of_memory; // the assembly is incomplete, and failed
+    bool relocatable;   // every symbol reference is left as a fixup, and no
+                        // variables are allocated, to write an object
+} Assembly;
+
+
+// constants
+
+// machine code bits of each token, indexed by the token
+extern const uint16_t comp_bits[];
+extern const uint16_t dest_bits[];
+extern const uint16_t jump_bits[];
+
+// characters of a word as a binary ASCII line, 16 bits + '\n'
+extern const size_t text_instr_size;
+
+// words converted to text per write
+extern const size_t text_block_size;
+
 
 // functions
 
 // translates the Hack assembly instructions in in_file, to binary ASCII
-// instructions in out_file
-void assemble_file(FILE *in_file, FILE *out_file);
+// instructions in out_file, returns false if there were errors, then nothing
+// is written
+bool assemble_file(FILE *in_file, FILE *out_file);
+
+// assembles the instructions in in_file into the words of as, which is reset
+// first so it can be reused, returns false if there were errors. Errors are
+// reported for the file filename, which may be NULL
+bool assemble(FILE *in_file, const char *filename, Assembly *as);
+
+// assembles the size characters of input into the words of as, like assemble.
+// The input need not be null terminated, and is not kept
+bool assemble_buffer(const char *input, size_t size, const char *filename,
+        Assembly *as);
+
+// creates a new assembly, with no labels and no instructions, taking all its
+// memory from allocator, or from malloc if it is NULL. Errors are collected,
+// and not printed. Returns NULL if there is not enough memory
+Assembly *new_assembly(const Allocator *allocator);
+
+// clears the labels, instructions and errors of the assembly, keeping its
+// allocated memory for reuse
+void reset_assembly(Assembly *as);
+
+// deletes the assembly and all its instructions from memory
+void delete_assembly(Assembly *as);
+
+// reads the whole input of size characters in a single pass, encoding each
+// instruction into the assembly words and backpatching forward references
+void read_instructions(const char *input, size_t size, Assembly *as);
+
+// assembles a single line of the input, numbered line_num
+void assemble_line(Field line, int line_num, Assembly *as);
+
+// allocates variable addresses, starting at 16, to the symbols still pending
+// at the end of the input, in order of first appearance, and patches them
+void resolve_variables(Assembly *as);
+
+// patches every instruction in the chain of fixups of the pending symbol with
+// its value, and marks it as resolved
+void patch_fixups(Assembly *as, PendingSymbol *ps, uint16_t value);
+
+// doubles the capacity of the array of elements of elem_size, pointed to by
+// array_ptr, if it is full, moving it with the allocator. Returns false,
+// leaving the array unchanged, if there is not enough memory
+bool grow_array(const Allocator *allocator, void *array_ptr, size_t size,
+        size_t *capacity, size_t elem_size);
+
+// appends an instruction word to the assembly
+void append_word(Assembly *as, uint16_t word);
+
+// takes the words before the address addr out of the words array, which then
+// starts at addr, for streams that write them out as they go. Fixups of the
+// words taken out are patched through the patch_taken function, if set
+void take_words(Assembly *as, size_t addr);
+
+// appends the words of part, a relocatable assembly of the next instructions
+// of as, as if they had been assembled into as: its labels are defined at
+// their addresses from the current one, and its references to symbols are
+// resolved to the labels of as, or recorded as fixups of as. Its errors are
+// collected into as, and printed to its error stream. Returns false if part
+// had errors, or if there were errors appending it
+bool append_assembly(Assembly *as, const Assembly *part);
+
+// strips comments and whitespace from the line, in a single scan, returns the
+// remaining instruction, empty if the line should be skipped. The instruction
+// is a view into the line, unless it has inner whitespace, then it is copied
+// without it into the scratch buffer of the assembly, grown if needed
+Field parse_comments_and_whitespace(Field line, Assembly *as);
+
+// parses a (label) definition, adding it to the symbol table and patching any
+// previous references to it, returns false on errors
+bool parse_label(const char *asm_instr, size_t len, int line_num,
+        Assembly *as);
+
+// defines the label key of key_len characters at the current address, and
+// patches the previous references to it, returns false on errors
+bool define_label(const char *key, size_t key_len, int line_num,
+        Assembly *as);
+
+// defines the label key of key_len characters at the address addr, like
+// define_label
+bool define_label_at(const char *key, size_t key_len, size_t addr,
+        int line_num, Assembly *as);
+
+// places into value the value of the symbol key of len characters, referenced
+// by the instruction at the current address, or 0 if it is not defined yet,
+// then the reference is recorded as a fixup. Returns false on errors
+bool reference_symbol(const char *key, size_t len, int line_num,
+        uint16_t *value, Assembly *as);
+
+// records a reference to the undefined symbol key by the instruction at the
+// current address, to be patched once the symbol is resolved
+bool add_fixup(Assembly *as, const char *key, size_t len, int line_num);
+
+// records a reference to the undefined symbol key by the instruction at the
+// address addr, like add_fixup
+bool add_fixup_at(Assembly *as, const char *key, size_t len, int line_num,
+        size_t addr);
+
+// adds the undefined symbol key to the pending symbols, with no fixup yet, if
+// it is not pending already, and places its index in *pending_idx. Variables
+// are allocated in the order they were added. Returns false on errors
+bool add_pending(Assembly *as, const char *key, size_t len, int line_num,
+        uint32_t *pending_idx);
+
+// parses an instruction of type A, places the result into value, returns false
+// on errors. Symbols not yet defined are recorded as a fixup of the instruction
+// at the current address
+bool parse_A_instruction(const char *asm_instr, size_t len, int line_num,
+        uint16_t *value, Assembly *as);
 
-// reads the whole file and adds (label) symbols to the symbol table
-void read_label_symbols(FILE *in_file, SymbolTable *st);
 
-// 
-bool parse_comments_and_whitespace(char *asm_instr);
+// parses an instruction of type C of len characters, placing the tokens into
+// comp, dest, and jump, returns false on errors
+bool parse_C_instruction(const char *asm_instr, size_t len, int line_num,
+        CompToken *comp, DestToken *dest, JumpToken *jump, Assembly *as);
 
-// parses an instruction of type A, reading and writing the symbol table if
-// needed, places the result into value
-void parse_A_instruction(const char *asm_instr, int line_num, uint16_t *value,
-        SymbolTable *st);
+// collects an error in parsing into the assembly, and prints it to its error
+// stream. Parsing goes on, to report all the errors of the file
+void parse_error(Assembly *as, int line_num, const char *error_msg,
+        Field error_val);
 
+// prints the error to the stream, named for the file filename if not NULL
+void print_error(FILE *stream, const char *filename, int line_num,
+        const char *error_msg, Field error_val);
 
-// parses an instruction of type C, placing the tokens into comp, dest, and jump
-void parse_C_instruction(const char *asm_instr, int line_num,
-        CompToken *comp, DestToken *dest, JumpToken *jump);
+// marks the assembly as failed for lack of memory, reported once
+void memory_error(Assembly *as);
 
-// signals an error in parsing, aborts program execution
-void parse_error(int line_num, const char *error_msg, const char *error_val);
+// encodes the C instruction tokens into their machine word, from the tables
+// of bits of each token
+uint16_t encode_C_instruction(CompToken comp, DestToken dest, JumpToken jump);
 
-// translates the A instruction value to its binary representation
-void interpret_A_instruction(uint16_t value, char *bin_instr);
+// converts num_words machine words to binary ASCII lines, 16 bits + '\n' each,
+// written to text, a byte at a time from a lookup table
+void words_to_text(const uint16_t *words, size_t num_words, char *text);
 
-// interprets the C instruction tokens, and constructs the corresponding binary
-// string instruction
-void interpret_C_instruction(CompToken comp, DestToken dest, JumpToken jump,
-        char *bin_instr);
+// writes the machine words as binary ASCII lines to out_file, converting them
+// in blocks, returns false if there is not enough memory or the write failed
+bool write_text_words(FILE *out_file, const uint16_t *words, size_t num_words);
 
 #endif
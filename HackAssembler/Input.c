@@ -0,0 +1,81 @@
+#include "Input.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// constants
+const size_t read_chunk_size = 1 << 16; // initial buffer size of piped input
+
+bool open_input(FILE *in_file, InputBuffer *input) {
+    struct stat in_stat;
+    int fd = fileno(in_file);
+    if (fstat(fd, &in_stat) || !S_ISREG(in_stat.st_mode)
+            || in_stat.st_size == 0) { // not mappable, read it instead
+        return read_whole_input(in_file, input);
+    }
+    void *data = mmap(NULL, in_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return read_whole_input(in_file, input);
+    }
+    madvise(data, in_stat.st_size, MADV_SEQUENTIAL);
+    input->data = data;
+    input->size = in_stat.st_size;
+    input->mapped = true;
+    return true;
+}
+
+bool read_whole_input(FILE *in_file, InputBuffer *input) {
+    size_t capacity = read_chunk_size;
+    size_t size = 0;
+    char *data = malloc(capacity);
+    if (!data) {
+        return false;
+    }
+    size_t num_read;
+    while ((num_read = fread(data + size, 1, capacity - size, in_file)) > 0) {
+        size += num_read;
+        if (size == capacity) {
+            char *grown = realloc(data, 2*capacity);
+            if (!grown) {
+                free(data);
+                return false;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+    }
+    if (ferror(in_file)) {
+        free(data);
+        return false;
+    }
+    input->data = data;
+    input->size = size;
+    input->mapped = false;
+    return true;
+}
+
+void close_input(InputBuffer *input) {
+    if (input->mapped) {
+        munmap((void *)input->data, input->size);
+    } else {
+        free((void *)input->data);
+    }
+    input->data = NULL;
+    input->size = 0;
+}
+
+bool next_line(const char *data, size_t size, size_t *pos, Field *line) {
+    if (*pos >= size) {
+        return false;
+    }
+    const char *line_beginning = data + *pos;
+    const char *line_end = memchr(line_beginning, '\n', size - *pos);
+    if (!line_end) { // last line, without '\n'
+        line_end = data + size;
+    }
+    *line = (Field) {line_beginning, line_end - line_beginning};
+    *pos = line_end - data + 1;
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+
+// data types
+
+// whole contents of an input file, memory-mapped if it is a regular file, or
+// read into a single buffer otherwise (pipes, terminals)
+typedef struct InputBuffer {
+    const char *data;
+    size_t size;
+    bool mapped;
+} InputBuffer;
+
+
+// functions
+
+// maps or reads the whole of in_file into input, returns false on failure
+bool open_input(FILE *in_file, InputBuffer *input);
+
+// reads the rest of in_file into a single heap buffer, returns false on failure
+bool read_whole_input(FILE *in_file, InputBuffer *input);
+
+// unmaps or frees the contents of input
+void close_input(InputBuffer *input);
+
+// places into line a view of the line starting at *pos in data, without its
+// '\n', and advances *pos to the next line. Returns false at the end of data
+bool next_line(const char *data, size_t size, size_t *pos, Field *line);
+
+#endif
@@ -0,0 +1,154 @@
+#include "Lexer.h"
+
+// constants
+const char *const comp_mnemonics[] = {
+    "0",   "1",   "-1",
+    "D",   "A",   "M",
+    "!D",  "!A",  "!M",
+    "-D",  "-A",  "-M",
+    "D+1", "A+1", "M+1",
+    "D-1", "A-1", "M-1",
+    "D+A", "D+M",
+    "D-A", "D-M", "A-D", "M-D",
+    "D&A", "D&M", "D|A", "D|M"
+};
+const char *const dest_mnemonics[] = {
+    "", "M", "D", "MD", "A", "AM", "AD", "AMD"
+};
+const char *const jump_mnemonics[] = {
+    "", "JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP"
+};
+
+void split_C_instruction(const char *asm_instr, size_t len,
+        Field *dest, Field *comp, Field *jump) {
+    const char *end = asm_instr + len;
+    const char *comp_beginning = asm_instr;
+    const char *comp_end = end;
+    *dest = (Field) {NULL, 0};
+    *jump = (Field) {NULL, 0};
+    for (const char *c = asm_instr; c != end; ++c) {
+        if (*c == '=' && comp_beginning == asm_instr) {
+            *dest = (Field) {asm_instr, c - asm_instr};
+            comp_beginning = c + 1;
+        } else if (*c == ';') {
+            comp_end = c;
+            *jump = (Field) {c + 1, end - (c + 1)};
+            break;
+        }
+    }
+    *comp = (Field) {comp_beginning, comp_end - comp_beginning};
+}
+
+bool pack_field(Field field, uint32_t *packed) {
+    if (field.len > 3) {
+        return false;
+    }
+    uint32_t p = 0;
+    for (size_t i = 0; i < field.len; ++i) {
+        p |= (uint32_t)(unsigned char)field.str[i] << 8*i;
+    }
+    *packed = p;
+    return true;
+}
+
+bool lex_comp(Field field, CompToken *comp) {
+    uint32_t packed;
+    if (!pack_field(field, &packed)) {
+        return false;
+    }
+    switch (packed) {
+        case PACK_MNEMONIC('0', 0, 0):     *comp = COMP_0;         break;
+        case PACK_MNEMONIC('1', 0, 0):     *comp = COMP_1;         break;
+        case PACK_MNEMONIC('-', '1', 0):   *comp = COMP_NEG_1;     break;
+        case PACK_MNEMONIC('D', 0, 0):     *comp = COMP_D;         break;
+        case PACK_MNEMONIC('A', 0, 0):     *comp = COMP_A;         break;
+        case PACK_MNEMONIC('M', 0, 0):     *comp = COMP_M;         break;
+        case PACK_MNEMONIC('!', 'D', 0):   *comp = COMP_NOT_D;     break;
+        case PACK_MNEMONIC('!', 'A', 0):   *comp = COMP_NOT_A;     break;
+        case PACK_MNEMONIC('!', 'M', 0):   *comp = COMP_NOT_M;     break;
+        case PACK_MNEMONIC('-', 'D', 0):   *comp = COMP_NEG_D;     break;
+        case PACK_MNEMONIC('-', 'A', 0):   *comp = COMP_NEG_A;     break;
+        case PACK_MNEMONIC('-', 'M', 0):   *comp = COMP_NEG_M;     break;
+        case PACK_MNEMONIC('D', '+', '1'): *comp = COMP_D_PLUS_1;  break;
+        case PACK_MNEMONIC('A', '+', '1'): *comp = COMP_A_PLUS_1;  break;
+        case PACK_MNEMONIC('M', '+', '1'): *comp = COMP_M_PLUS_1;  break;
+        case PACK_MNEMONIC('D', '-', '1'): *comp = COMP_D_MINUS_1; break;
+        case PACK_MNEMONIC('A', '-', '1'): *comp = COMP_A_MINUS_1; break;
+        case PACK_MNEMONIC('M', '-', '1'): *comp = COMP_M_MINUS_1; break;
+        case PACK_MNEMONIC('D', '+', 'A'): *comp = COMP_D_PLUS_A;  break;
+        case PACK_MNEMONIC('D', '+', 'M'): *comp = COMP_D_PLUS_M;  break;
+        case PACK_MNEMONIC('D', '-', 'A'): *comp = COMP_D_MINUS_A; break;
+        case PACK_MNEMONIC('D', '-', 'M'): *comp = COMP_D_MINUS_M; break;
+        case PACK_MNEMONIC('A', '-', 'D'): *comp = COMP_A_MINUS_D; break;
+        case PACK_MNEMONIC('M', '-', 'D'): *comp = COMP_M_MINUS_D; break;
+        case PACK_MNEMONIC('D', '&', 'A'): *comp = COMP_D_AND_A;   break;
+        case PACK_MNEMONIC('D', '&', 'M'): *comp = COMP_D_AND_M;   break;
+        case PACK_MNEMONIC('D', '|', 'A'): *comp = COMP_D_OR_A;    break;
+        case PACK_MNEMONIC('D', '|', 'M'): *comp = COMP_D_OR_M;    break;
+        default: return false;
+    }
+    return true;
+}
+
+bool lex_dest(Field field, DestToken *dest) {
+    if (field.str == NULL) { // absent field
+        *dest = DEST_NULL;
+        return true;
+    }
+    uint32_t packed;
+    if (!pack_field(field, &packed)) {
+        return false;
+    }
+    switch (packed) {
+        case PACK_MNEMONIC('M', 0, 0):     *dest = DEST_M;    break;
+        case PACK_MNEMONIC('D', 0, 0):     *dest = DEST_D;    break;
+        case PACK_MNEMONIC('M', 'D', 0):   *dest = DEST_MD;   break;
+        case PACK_MNEMONIC('A', 0, 0):     *dest = DEST_A;    break;
+        case PACK_MNEMONIC('A', 'M', 0):   *dest = DEST_AM;   break;
+        case PACK_MNEMONIC('A', 'D', 0):   *dest = DEST_AD;   break;
+        case PACK_MNEMONIC('A', 'M', 'D'): *dest = DEST_AMD;  break;
+        default: return false;
+    }
+    return true;
+}
+
+bool lex_jump(Field field, JumpToken *jump) {
+    if (field.str == NULL) { // absent field
+        *jump = JUMP_NULL;
+        return true;
+    }
+    uint32_t packed;
+    if (!pack_field(field, &packed)) {
+        return false;
+    }
+    switch (packed) {
+        case PACK_MNEMONIC('J', 'G', 'T'): *jump = JUMP_JGT;  break;
+        case PACK_MNEMONIC('J', 'E', 'Q'): *jump = JUMP_JEQ;  break;
+        case PACK_MNEMONIC('J', 'G', 'E'): *jump = JUMP_JGE;  break;
+        case PACK_MNEMONIC('J', 'L', 'T'): *jump = JUMP_JLT;  break;
+        case PACK_MNEMONIC('J', 'N', 'E'): *jump = JUMP_JNE;  break;
+        case PACK_MNEMONIC('J', 'L', 'E'): *jump = JUMP_JLE;  break;
+        case PACK_MNEMONIC('J', 'M', 'P'): *jump = JUMP_JMP;  break;
+        default: return false;
+    }
+    return true;
+}
+
+bool lex_value(Field field, uint16_t *value) {
+    if (field.len == 0) {
+        return false;
+    }
+    uint32_t v = 0;
+    for (size_t i = 0; i < field.len; ++i) {
+        unsigned digit = (unsigned char)field.str[i] - '0';
+        if (digit > 9) {
+            return false;
+        }
+        v = 10*v + digit;
+        if (v >> 15) { // does not fit in 15 bits
+            return false;
+        }
+    }
+    *value = v;
+    return true;
+}
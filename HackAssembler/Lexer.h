@@ -0,0 +1,48 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HackAssembler.h"
+
+// constants
+
+// mnemonic of each token, indexed by the token. Null dest and jump tokens are
+// empty
+extern const char *const comp_mnemonics[];
+extern const char *const dest_mnemonics[];
+extern const char *const jump_mnemonics[];
+
+
+// functions
+
+// splits a C instruction of len characters into its dest, comp and jump fields
+// by the positions of '=' and ';', in a single scan and without copying. Absent
+// dest and jump fields are left with a null str
+void split_C_instruction(const char *asm_instr, size_t len,
+        Field *dest, Field *comp, Field *jump);
+
+// packs a mnemonic of up to 3 characters into an integer, that can be used as
+// a switch case label. Characters are never null, so distinct mnemonics always
+// pack to distinct values
+#define PACK_MNEMONIC(c0, c1, c2) \
+    ((uint32_t)(unsigned char)(c0) | (uint32_t)(unsigned char)(c1) << 8 | \
+     (uint32_t)(unsigned char)(c2) << 16)
+
+// packs the characters of field, returns false if it is too long to be a
+// mnemonic
+bool pack_field(Field field, uint32_t *packed);
+
+// maps the field to its token, returns false if it is not a valid mnemonic. An
+// absent dest or jump field maps to the null token
+bool lex_comp(Field field, CompToken *comp);
+bool lex_dest(Field field, DestToken *dest);
+bool lex_jump(Field field, JumpToken *jump);
+
+// lexes a decimal constant, returns false if the field holds anything other
+// than digits or the value does not fit in 15 bits
+bool lex_value(Field field, uint16_t *value);
+
+#endif
@@ -0,0 +1,250 @@
+#include "Object.h"
+#include "Input.h"
+#include "Output.h"
+#include "SymbolTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// constants
+const uint16_t object_version = 1;
+const size_t object_header_size = 28;
+const size_t export_size = 12; // bytes in a file
+const size_t import_size = 8;
+const size_t reloc_size = 8;
+
+bool write_object(FILE *out_file, const Assembly *as) {
+    Object obj;
+    if (!build_object(as, &obj)) {
+        return false;
+    }
+    bool success = write_object_file(out_file, &obj);
+    free_object(&obj);
+    return success;
+}
+
+bool build_object(const Assembly *as, Object *obj) {
+    *obj = (Object) {.num_words = as->num_words};
+    size_t names_capacity = 0;
+    obj->words = malloc((as->num_words ? as->num_words : 1)*sizeof(uint16_t));
+    obj->exports = malloc((as->st->num_entries + 1)*sizeof(*obj->exports));
+    obj->imports = malloc((as->num_pending + 1)*sizeof(*obj->imports));
+    obj->relocs = malloc((as->num_fixups + 1)*sizeof(*obj->relocs));
+    // pending symbols, by index
+    const TableEntry **pending = malloc((as->num_pending + 1)
+            *sizeof(*pending));
+    if (!obj->words || !obj->exports || !obj->imports || !obj->relocs
+            || !pending) {
+        free(pending);
+        free_object(obj);
+        return false;
+    }
+    if (as->num_words > 0) {
+        memcpy(obj->words, as->words, as->num_words*sizeof(uint16_t));
+    }
+    for (size_t i = 0; i < as->pending_st->size; ++i) {
+        if (as->pending_st->table[i].key_len != 0) {
+            pending[as->pending_st->table[i].value] = &as->pending_st->table[i];
+        }
+    }
+    bool success = true;
+    for (size_t i = 0; success && i < as->num_pending; ++i) {
+        const char *key = as->pending_st->arena + pending[i]->key_offset;
+        uint32_t label_addr, symbol = RELOC_LOCAL;
+        if (!lookup_key(as->st, key, pending[i]->key_len, &label_addr)) {
+            symbol = obj->num_imports++;
+            ObjectImport *import = &obj->imports[symbol];
+            import->name_len = pending[i]->key_len;
+            success = add_object_name(obj, &names_capacity, key,
+                    pending[i]->key_len, &import->name_offset);
+            label_addr = 0;
+        }
+        const PendingSymbol *ps = &as->pending[i];
+        for (size_t f = ps->first_fixup; f != NO_FIXUP;
+                f = as->fixups[f].next) {
+            size_t addr = as->fixups[f].instr_addr;
+            obj->words[addr] = label_addr;
+            obj->relocs[obj->num_relocs++] = (ObjectReloc) {
+                .addr = addr, .symbol = symbol};
+        }
+    }
+    // exports in the order they were defined, the order of their keys in the
+    // arena of the labels
+    for (size_t i = 0; i < as->st->size; ++i) {
+        const TableEntry *entry = &as->st->table[i];
+        if (entry->key_len != 0) {
+            obj->exports[obj->num_exports++] = (ObjectExport) {
+                .name_offset = entry->key_offset, .name_len = entry->key_len,
+                .addr = entry->value};
+        }
+    }
+    qsort(obj->exports, obj->num_exports, sizeof(*obj->exports),
+            compare_exports);
+    for (size_t i = 0; success && i < obj->num_exports; ++i) {
+        ObjectExport *export = &obj->exports[i];
+        success = add_object_name(obj, &names_capacity,
+                as->st->arena + export->name_offset, export->name_len,
+                &export->name_offset);
+    }
+    free(pending);
+    if (!success) {
+        free_object(obj);
+        return false;
+    }
+    return true;
+}
+
+bool add_object_name(Object *obj, size_t *names_capacity, const char *name,
+        size_t len, uint32_t *name_offset) {
+    while (obj->names_size + len > *names_capacity) {
+        if (!grow_array(&default_allocator, &obj->names, *names_capacity,
+                    names_capacity, 1)) {
+            return false;
+        }
+    }
+    if (obj->names_size + len > UINT32_MAX) {
+        return false;
+    }
+    *name_offset = obj->names_size;
+    memcpy(obj->names + obj->names_size, name, len);
+    obj->names_size += len;
+    return true;
+}
+
+int compare_exports(const void *a, const void *b) {
+    const ObjectExport *x = a, *y = b;
+    return (x->name_offset > y->name_offset)
+         - (x->name_offset < y->name_offset);
+}
+
+bool write_object_file(FILE *out_file, const Object *obj) {
+    if (obj->num_words > UINT32_MAX) {
+        return false;
+    }
+    size_t size = object_header_size + 2*obj->num_words
+                + export_size*obj->num_exports + import_size*obj->num_imports
+                + reloc_size*obj->num_relocs + obj->names_size;
+    uint8_t *data = malloc(size);
+    if (!data) {
+        return false;
+    }
+    uint8_t *p = data;
+    memcpy(p, "HOBJ", 4);
+    store_le16(p + 4, object_version);
+    store_le16(p + 6, 0);
+    store_le32(p + 8, obj->num_words);
+    store_le32(p + 12, obj->num_exports);
+    store_le32(p + 16, obj->num_imports);
+    store_le32(p + 20, obj->num_relocs);
+    store_le32(p + 24, obj->names_size);
+    p += object_header_size;
+    for (size_t i = 0; i < obj->num_words; ++i, p += 2) {
+        store_le16(p, obj->words[i]);
+    }
+    for (size_t i = 0; i < obj->num_exports; ++i, p += export_size) {
+        store_le32(p, obj->exports[i].name_offset);
+        store_le32(p + 4, obj->exports[i].name_len);
+        store_le32(p + 8, obj->exports[i].addr);
+    }
+    for (size_t i = 0; i < obj->num_imports; ++i, p += import_size) {
+        store_le32(p, obj->imports[i].name_offset);
+        store_le32(p + 4, obj->imports[i].name_len);
+    }
+    for (size_t i = 0; i < obj->num_relocs; ++i, p += reloc_size) {
+        store_le32(p, obj->relocs[i].addr);
+        store_le32(p + 4, obj->relocs[i].symbol);
+    }
+    if (obj->names_size > 0) {
+        memcpy(p, obj->names, obj->names_size);
+    }
+    bool success = fwrite(data, 1, size, out_file) == size;
+    free(data);
+    return success;
+}
+
+bool read_object(FILE *in_file, Object *obj) {
+    *obj = (Object) {0};
+    InputBuffer input;
+    if (!open_input(in_file, &input)) {
+        return false;
+    }
+    bool success = parse_object((const uint8_t *)input.data, input.size, obj);
+    close_input(&input);
+    return success;
+}
+
+bool parse_object(const uint8_t *data, size_t size, Object *obj) {
+    *obj = (Object) {0};
+    if (size < object_header_size || memcmp(data, "HOBJ", 4)
+            || load_le16(data + 4) != object_version) {
+        return false;
+    }
+    obj->num_words = load_le32(data + 8);
+    obj->num_exports = load_le32(data + 12);
+    obj->num_imports = load_le32(data + 16);
+    obj->num_relocs = load_le32(data + 20);
+    obj->names_size = load_le32(data + 24);
+    // 64-bit sums of 32-bit counts cannot overflow
+    uint64_t expected_size = (uint64_t)object_header_size + 2*obj->num_words
+        + export_size*obj->num_exports + import_size*obj->num_imports
+        + reloc_size*obj->num_relocs + obj->names_size;
+    if (expected_size != size) {
+        *obj = (Object) {0};
+        return false;
+    }
+    obj->words = malloc(obj->num_words*sizeof(*obj->words) + 1);
+    obj->exports = malloc(obj->num_exports*sizeof(*obj->exports) + 1);
+    obj->imports = malloc(obj->num_imports*sizeof(*obj->imports) + 1);
+    obj->relocs = malloc(obj->num_relocs*sizeof(*obj->relocs) + 1);
+    obj->names = malloc(obj->names_size + 1);
+    if (!obj->words || !obj->exports || !obj->imports || !obj->relocs
+            || !obj->names) {
+        free_object(obj);
+        return false;
+    }
+    const uint8_t *p = data + object_header_size;
+    bool valid = true;
+    for (size_t i = 0; i < obj->num_words; ++i, p += 2) {
+        obj->words[i] = load_le16(p);
+    }
+    for (size_t i = 0; i < obj->num_exports; ++i, p += export_size) {
+        ObjectExport *export = &obj->exports[i];
+        export->name_offset = load_le32(p);
+        export->name_len = load_le32(p + 4);
+        export->addr = load_le32(p + 8);
+        valid = valid && export->name_len > 0
+            && export->name_offset <= obj->names_size
+            && export->name_len <= obj->names_size - export->name_offset;
+    }
+    for (size_t i = 0; i < obj->num_imports; ++i, p += import_size) {
+        ObjectImport *import = &obj->imports[i];
+        import->name_offset = load_le32(p);
+        import->name_len = load_le32(p + 4);
+        valid = valid && import->name_len > 0
+            && import->name_offset <= obj->names_size
+            && import->name_len <= obj->names_size - import->name_offset;
+    }
+    for (size_t i = 0; i < obj->num_relocs; ++i, p += reloc_size) {
+        ObjectReloc *reloc = &obj->relocs[i];
+        reloc->addr = load_le32(p);
+        reloc->symbol = load_le32(p + 4);
+        valid = valid && reloc->addr < obj->num_words
+            && (reloc->symbol == RELOC_LOCAL
+                || reloc->symbol < obj->num_imports);
+    }
+    memcpy(obj->names, p, obj->names_size);
+    if (!valid) {
+        free_object(obj);
+        return false;
+    }
+    return true;
+}
+
+void free_object(Object *obj) {
+    free(obj->words);
+    free(obj->exports);
+    free(obj->imports);
+    free(obj->relocs);
+    free(obj->names);
+    *obj = (Object) {0};
+}
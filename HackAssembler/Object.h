@@ -0,0 +1,94 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+
+// data types
+
+// marks a relocation of a reference to a label of the object itself, whose
+// word holds the label address from the beginning of the object
+#define RELOC_LOCAL UINT32_MAX
+
+// label defined by the object, at an address from its beginning
+typedef struct ObjectExport {
+    uint32_t name_offset; // in the names of the object
+    uint32_t name_len;
+    uint32_t addr;
+} ObjectExport;
+
+// symbol referenced, but not defined, by the object. Imports are in order of
+// first appearance, the order variables are allocated in
+typedef struct ObjectImport {
+    uint32_t name_offset;
+    uint32_t name_len;
+} ObjectImport;
+
+// word to patch when linking: the base address of the object is added to it,
+// or it is replaced with the value of an import
+typedef struct ObjectReloc {
+    uint32_t addr;
+    uint32_t symbol; // index of the import, or RELOC_LOCAL
+} ObjectReloc;
+
+// relocatable object: the encoded words of a module, assembled as if it began
+// at address 0, its labels, and the words referencing symbols. In a file, a
+// 28 byte header, "HOBJ", the version and 0 in 16 bits, then the number of
+// words, exports, imports, relocations and bytes of names in 32 bits, is
+// followed by each of these in turn, all little-endian
+typedef struct Object {
+    uint16_t *words;
+    size_t num_words;
+    ObjectExport *exports;
+    size_t num_exports;
+    ObjectImport *imports;
+    size_t num_imports;
+    ObjectReloc *relocs;
+    size_t num_relocs;
+    char *names;
+    size_t names_size;
+} Object;
+
+
+// constants
+
+extern const uint16_t object_version;
+
+
+// functions
+
+// writes the object of a relocatable assembly to out_file, returns false on
+// errors
+bool write_object(FILE *out_file, const Assembly *as);
+
+// builds the object of a relocatable assembly, returns false if there is not
+// enough memory
+bool build_object(const Assembly *as, Object *obj);
+
+// appends a name to the names of the object, places its offset in
+// *name_offset, returns false if there is not enough memory
+bool add_object_name(Object *obj, size_t *names_capacity, const char *name,
+        size_t len, uint32_t *name_offset);
+
+// orders exports by the offset of their names
+int compare_exports(const void *a, const void *b);
+
+// writes the object to out_file in a single write, returns false on errors
+bool write_object_file(FILE *out_file, const Object *obj);
+
+// reads and checks an object from in_file, returns false if it is not a valid
+// object, then the object is left empty
+bool read_object(FILE *in_file, Object *obj);
+
+// checks the sizes, names and relocations of an object read from the size
+// bytes of data, and copies them into obj
+bool parse_object(const uint8_t *data, size_t size, Object *obj);
+
+// frees the contents of the object
+void free_object(Object *obj);
+
+#endif
@@ -0,0 +1,539 @@
+#include "OptimizedWriter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// constants
+const JumpToken negated_jumps[] = {
+    [JUMP_NULL] = JUMP_JMP, [JUMP_JGT] = JUMP_JLE, [JUMP_JEQ] = JUMP_JNE,
+    [JUMP_JGE] = JUMP_JLT,  [JUMP_JLT] = JUMP_JGE, [JUMP_JNE] = JUMP_JEQ,
+    [JUMP_JLE] = JUMP_JGT,  [JUMP_JMP] = JUMP_NULL,
+};
+
+// costs in instructions of the ways to address a segment word, or store to it
+const int push_d_cost = 4;
+const int pop_store_cost = 4;       // @SP AM=M-1 D=M, then M=D
+const int indexed_address_cost = 4; // @index D=A @base A=D+M
+const int summed_pop_cost = 9;      // the address plus the value, in D
+const int saved_pop_cost = 12;      // the value saved in R13, the address in
+                                    // R14
+
+void write_optimized_command(CodeWriter *cw, const VMCommand *cmd) {
+    switch (cmd->type) {
+        case C_ARITHMETIC:
+            write_cached_arithmetic(cw, cmd->op);
+            break;
+        case C_PUSH:
+            write_cached_push(cw, cmd->segment, cmd->index);
+            break;
+        case C_POP:
+            write_cached_pop(cw, cmd->segment, cmd->index);
+            break;
+        case C_LABEL:
+            flush_stack(cw);
+            write_label(cw, cmd->name);
+            break;
+        case C_GOTO:
+            flush_stack(cw);
+            write_goto(cw, cmd->name, JUMP_JMP);
+            break;
+        case C_IF:
+            write_cached_if(cw, cmd->name);
+            break;
+        case C_FUNCTION:
+            flush_stack(cw);
+            write_cached_function(cw, cmd->name, cmd->index);
+            break;
+        case C_CALL:
+            flush_stack(cw);
+            write_shared_call(cw, cmd->name, cmd->index);
+            break;
+        case C_RETURN:
+            load_top(cw);
+            write_shared_return(cw);
+            break;
+    }
+}
+
+void write_cached_arithmetic(CodeWriter *cw, ArithmeticOp op) {
+    switch (op) {
+        case VM_NEG:
+        case VM_NOT:
+            if (cw->top == TOP_COMPARISON && op == VM_NOT) {
+                cw->top_jump = negated_jumps[cw->top_jump];
+                return;
+            }
+            if (cw->top == TOP_IN_MEMORY) { // in place, at SP-1
+                write_a_register(cw, "SP");
+                write_c(cw, DEST_A, COMP_M_MINUS_1, JUMP_NULL);
+                write_c(cw, DEST_M, op == VM_NEG ? COMP_NEG_M : COMP_NOT_M,
+                        JUMP_NULL);
+                return;
+            }
+            if (cw->top == TOP_CONSTANT_ON_D) {
+                spill_d(cw);
+            }
+            if (cw->top == TOP_CONSTANT) { // folded into the load
+                write_a_value(cw, cw->top_constant);
+                write_c(cw, DEST_D, op == VM_NEG ? COMP_NEG_A : COMP_NOT_A,
+                        JUMP_NULL);
+                cw->top = TOP_IN_D;
+                return;
+            }
+            load_top(cw);
+            write_c(cw, DEST_D, op == VM_NEG ? COMP_NEG_D : COMP_NOT_D,
+                    JUMP_NULL);
+            return;
+        case VM_EQ:
+        case VM_GT:
+        case VM_LT: // left to the command that uses it
+            write_cached_binary(cw, VM_SUB);
+            cw->top = TOP_COMPARISON;
+            cw->top_jump = compare_jumps[op];
+            return;
+        default:
+            write_cached_binary(cw, op);
+            return;
+    }
+}
+
+void write_cached_binary(CodeWriter *cw, ArithmeticOp op) {
+    if (cw->top == TOP_CONSTANT) {
+        write_pop_d(cw);
+        cw->top = TOP_CONSTANT_ON_D;
+    }
+    if (cw->top == TOP_CONSTANT_ON_D) {
+        write_constant_operation(cw, op, cw->top_constant);
+        cw->top = TOP_IN_D;
+        return;
+    }
+    load_top(cw);
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_AM, COMP_M_MINUS_1, JUMP_NULL);
+    write_c(cw, DEST_D, binary_comps[op], JUMP_NULL);
+}
+
+void write_cached_push(CodeWriter *cw, Segment segment, uint16_t index) {
+    if (segment == SEG_CONSTANT) { // loaded by the command that uses it
+        if (cw->top == TOP_IN_MEMORY) {
+            cw->top = TOP_CONSTANT;
+        } else {
+            load_top(cw);
+            cw->top = TOP_CONSTANT_ON_D;
+        }
+        cw->top_constant = index;
+        return;
+    }
+    flush_stack(cw);
+    if (is_direct_segment(segment)) {
+        write_direct_address(cw, segment, index);
+    } else {
+        write_cached_address(cw, segment, index, false);
+    }
+    write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+    cw->top = TOP_IN_D;
+}
+
+void write_cached_pop(CodeWriter *cw, Segment segment, uint16_t index) {
+    bool direct = is_direct_segment(segment);
+    if (cw->top == TOP_CONSTANT_ON_D && cw->top_constant <= 1
+            && (direct || address_steps_cost(index)
+                <= push_d_cost + indexed_address_cost)) {
+        if (direct) { // stored as M=0 or M=1, D is kept
+            write_direct_address(cw, segment, index);
+        } else {
+            write_address_steps(cw, segment, index);
+        }
+        write_c(cw, DEST_M, cw->top_constant ? COMP_1 : COMP_0, JUMP_NULL);
+        cw->top = TOP_IN_D;
+        return;
+    }
+    if (cw->top == TOP_CONSTANT_ON_D) {
+        spill_d(cw);
+    }
+    if (cw->top == TOP_CONSTANT) {
+        if (cw->top_constant <= 1) {
+            if (direct) {
+                write_direct_address(cw, segment, index);
+            } else {
+                write_cached_address(cw, segment, index, false);
+            }
+            write_c(cw, DEST_M, cw->top_constant ? COMP_1 : COMP_0,
+                    JUMP_NULL);
+            cw->top = TOP_IN_MEMORY;
+            return;
+        }
+        write_load_constant(cw, cw->top_constant);
+        cw->top = TOP_IN_D;
+    }
+    if (cw->top == TOP_IN_MEMORY && !direct
+            && address_steps_cost(index) + pop_store_cost > summed_pop_cost) {
+        write_a_value(cw, index); // D = address, then address + value
+        write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+        write_a_register(cw, segment_registers[segment]);
+        write_c(cw, DEST_D, COMP_D_PLUS_M, JUMP_NULL);
+        write_a_register(cw, "SP");
+        write_c(cw, DEST_AM, COMP_M_MINUS_1, JUMP_NULL);
+        write_c(cw, DEST_D, COMP_D_PLUS_M, JUMP_NULL);
+        write_c(cw, DEST_A, COMP_D_MINUS_M, JUMP_NULL);
+        write_c(cw, DEST_M, COMP_D_MINUS_A, JUMP_NULL);
+        return;
+    }
+    load_top(cw);
+    if (direct) {
+        write_direct_address(cw, segment, index);
+    } else if (address_steps_cost(index) < saved_pop_cost) {
+        write_address_steps(cw, segment, index);
+    } else {
+        write_a_register(cw, "R13");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_value(cw, index);
+        write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+        write_a_register(cw, segment_registers[segment]);
+        write_c(cw, DEST_D, COMP_D_PLUS_M, JUMP_NULL);
+        write_a_register(cw, "R14");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_register(cw, "R13");
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "R14");
+        write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+    }
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    cw->top = TOP_IN_MEMORY;
+}
+
+void write_cached_if(CodeWriter *cw, Field label) {
+    JumpToken jump = JUMP_JNE;
+    if (cw->top == TOP_CONSTANT_ON_D) {
+        spill_d(cw);
+    }
+    if (cw->top == TOP_CONSTANT) { // always or never taken
+        jump = cw->top_constant ? JUMP_JMP : JUMP_NULL;
+    } else if (cw->top == TOP_COMPARISON) {
+        jump = cw->top_jump;
+    } else {
+        load_top(cw);
+    }
+    cw->top = TOP_IN_MEMORY;
+    if (jump == JUMP_NULL) { // the label must still be defined
+        build_label_name(cw, label);
+        add_jump_target(cw);
+        return;
+    }
+    write_label_jump(cw, label, jump);
+}
+
+void write_cached_function(CodeWriter *cw, Field function,
+        uint16_t num_locals) {
+    start_function(cw, function);
+    cw->top = TOP_IN_MEMORY;
+    if (num_locals == 0) {
+        return;
+    }
+    if (num_locals == 1) {
+        write_a_register(cw, "SP");
+        write_c(cw, DEST_AM, COMP_M_PLUS_1, JUMP_NULL);
+        write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+        write_c(cw, DEST_M, COMP_0, JUMP_NULL);
+        return;
+    }
+    write_a_register(cw, "SP"); // zeroed in a row, then SP moved once
+    write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+    for (uint16_t i = 1; i < num_locals; ++i) {
+        write_c(cw, DEST_M, COMP_0, JUMP_NULL);
+        write_c(cw, DEST_A, COMP_A_PLUS_1, JUMP_NULL);
+    }
+    write_c(cw, DEST_M, COMP_0, JUMP_NULL);
+    write_c(cw, DEST_D, COMP_A_PLUS_1, JUMP_NULL);
+    write_a_register(cw, "SP");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+}
+
+void write_shared_call(CodeWriter *cw, Field function, uint16_t num_args) {
+    write_a_value(cw, num_args + frame_size); // R13 = num_args + 5
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_a_register(cw, "R13");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    clear_name(cw); // R14 = function
+    append_name(cw, function.str, function.len);
+    add_jump_target(cw);
+    write_a_name(cw);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_a_register(cw, "R14");
+    write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+    uint32_t ret = cw->num_returns++; // D = return address
+    build_unique_name(cw, cw->scope, "ret", ret);
+    write_a_name(cw);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    clear_name(cw);
+    append_name(cw, "$call", strlen("$call"));
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    build_unique_name(cw, cw->scope, "ret", ret);
+    write_label_name(cw);
+    cw->uses_call = true;
+    cw->top = TOP_IN_D;
+}
+
+void write_shared_return(CodeWriter *cw) {
+    clear_name(cw);
+    append_name(cw, "$return", strlen("$return"));
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    cw->uses_return = true;
+    cw->top = TOP_IN_MEMORY;
+}
+
+void write_shared_subroutines(CodeWriter *cw) {
+    if (cw->uses_call) { // D = return address, R13 = num_args + 5,
+                         // R14 = function
+        if (cw->asm_file) {
+            fprintf(cw->asm_file, "// shared call\n");
+        }
+        clear_name(cw);
+        append_name(cw, "$call", strlen("$call"));
+        write_label_name(cw);
+        write_push_d(cw);
+        for (size_t i = 0; i < num_frame_registers; ++i) {
+            write_a_register(cw, frame_registers[i]);
+            write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+            write_push_d(cw);
+        }
+        write_a_register(cw, "R13"); // ARG = SP - num_args - 5
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "SP");
+        write_c(cw, DEST_D, COMP_M_MINUS_D, JUMP_NULL);
+        write_a_register(cw, "ARG");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_register(cw, "SP"); // LCL = SP
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "LCL");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_register(cw, "R14");
+        write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+        write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    }
+    if (cw->uses_return) { // D = return value, left in D for the caller,
+                           // with SP at ARG
+        if (cw->asm_file) {
+            fprintf(cw->asm_file, "// shared return\n");
+        }
+        clear_name(cw);
+        append_name(cw, "$return", strlen("$return"));
+        write_label_name(cw);
+        write_a_register(cw, "R13");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_register(cw, "LCL"); // return address in R14
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_value(cw, frame_size);
+        write_c(cw, DEST_A, COMP_D_MINUS_A, JUMP_NULL);
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "R14");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        write_a_register(cw, "ARG");
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "SP");
+        write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        for (size_t i = num_frame_registers; i > 0; --i) { // LCL walks down
+            write_a_register(cw, "LCL");
+            write_c(cw, i > 1 ? DEST_AM : DEST_A, COMP_M_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+            write_a_register(cw, frame_registers[i-1]);
+            write_c(cw, DEST_M, COMP_D, JUMP_NULL);
+        }
+        write_a_register(cw, "R13");
+        write_c(cw, DEST_D, COMP_M, JUMP_NULL);
+        write_a_register(cw, "R14");
+        write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+        write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    }
+}
+
+void flush_stack(CodeWriter *cw) {
+    if (cw->top == TOP_IN_MEMORY) {
+        return;
+    }
+    spill_d(cw);
+    if (cw->top == TOP_CONSTANT) {
+        if (cw->top_constant <= 1) { // stored as M=0 or M=1
+            write_a_register(cw, "SP");
+            write_c(cw, DEST_AM, COMP_M_PLUS_1, JUMP_NULL);
+            write_c(cw, DEST_A, COMP_A_MINUS_1, JUMP_NULL);
+            write_c(cw, DEST_M, cw->top_constant ? COMP_1 : COMP_0,
+                    JUMP_NULL);
+        } else {
+            write_load_constant(cw, cw->top_constant);
+            write_push_d(cw);
+        }
+    }
+    cw->top = TOP_IN_MEMORY;
+}
+
+bool same_stack_top(const CodeWriter *cw, const CodeWriter *other) {
+    if (cw->top != other->top) {
+        return false;
+    }
+    switch (cw->top) {
+        case TOP_CONSTANT:
+        case TOP_CONSTANT_ON_D:
+            return cw->top_constant == other->top_constant;
+        case TOP_COMPARISON:
+            return cw->top_jump == other->top_jump;
+        default:
+            return true;
+    }
+}
+
+void copy_stack_top(CodeWriter *cw, const CodeWriter *from) {
+    cw->top = from->top;
+    cw->top_constant = from->top_constant;
+    cw->top_jump = from->top_jump;
+}
+
+void load_top(CodeWriter *cw) {
+    switch (cw->top) {
+        case TOP_IN_MEMORY:
+            write_pop_d(cw);
+            break;
+        case TOP_IN_D:
+            break;
+        case TOP_CONSTANT:
+            write_load_constant(cw, cw->top_constant);
+            break;
+        case TOP_CONSTANT_ON_D:
+            write_push_d(cw);
+            write_load_constant(cw, cw->top_constant);
+            break;
+        case TOP_COMPARISON:
+            write_comparison_value(cw);
+            break;
+    }
+    cw->top = TOP_IN_D;
+}
+
+void spill_d(CodeWriter *cw) {
+    switch (cw->top) {
+        case TOP_CONSTANT_ON_D:
+            write_push_d(cw);
+            cw->top = TOP_CONSTANT;
+            break;
+        case TOP_COMPARISON:
+            write_comparison_value(cw);
+            write_push_d(cw);
+            cw->top = TOP_IN_MEMORY;
+            break;
+        case TOP_IN_D:
+            write_push_d(cw);
+            cw->top = TOP_IN_MEMORY;
+            break;
+        default:
+            break;
+    }
+}
+
+void write_comparison_value(CodeWriter *cw) {
+    uint32_t n = cw->num_compares++;
+    build_unique_name(cw, cw->file_name, "cmp", n);
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_D, cw->top_jump);
+    write_c(cw, DEST_D, COMP_0, JUMP_NULL);
+    build_unique_name(cw, cw->file_name, "cmpend", n);
+    write_a_name(cw);
+    write_c(cw, DEST_NULL, COMP_0, JUMP_JMP);
+    build_unique_name(cw, cw->file_name, "cmp", n);
+    write_label_name(cw);
+    write_c(cw, DEST_D, COMP_NEG_1, JUMP_NULL);
+    build_unique_name(cw, cw->file_name, "cmpend", n);
+    write_label_name(cw);
+    cw->top = TOP_IN_D;
+}
+
+void write_load_constant(CodeWriter *cw, uint16_t value) {
+    if (value <= 1) {
+        write_c(cw, DEST_D, value ? COMP_1 : COMP_0, JUMP_NULL);
+        return;
+    }
+    write_a_value(cw, value);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+}
+
+void write_constant_operation(CodeWriter *cw, ArithmeticOp op,
+        uint16_t value) {
+    switch (op) {
+        case VM_ADD:
+        case VM_SUB:
+            if (value == 0) {
+                return;
+            }
+            if (value == 1) {
+                write_c(cw, DEST_D, op == VM_ADD ? COMP_D_PLUS_1
+                        : COMP_D_MINUS_1, JUMP_NULL);
+                return;
+            }
+            write_a_value(cw, value);
+            write_c(cw, DEST_D, op == VM_ADD ? COMP_D_PLUS_A : COMP_D_MINUS_A,
+                    JUMP_NULL);
+            return;
+        case VM_AND:
+            if (value == 0) {
+                write_c(cw, DEST_D, COMP_0, JUMP_NULL);
+                return;
+            }
+            write_a_value(cw, value);
+            write_c(cw, DEST_D, COMP_D_AND_A, JUMP_NULL);
+            return;
+        case VM_OR:
+            if (value == 0) {
+                return;
+            }
+            write_a_value(cw, value);
+            write_c(cw, DEST_D, COMP_D_OR_A, JUMP_NULL);
+            return;
+        default:
+            return;
+    }
+}
+
+void write_cached_address(CodeWriter *cw, Segment segment, uint16_t index,
+        bool keep_d) {
+    if (keep_d || address_steps_cost(index) <= indexed_address_cost) {
+        write_address_steps(cw, segment, index);
+        return;
+    }
+    write_a_value(cw, index);
+    write_c(cw, DEST_D, COMP_A, JUMP_NULL);
+    write_a_register(cw, segment_registers[segment]);
+    write_c(cw, DEST_A, COMP_D_PLUS_M, JUMP_NULL);
+}
+
+int address_steps_cost(uint16_t index) {
+    return index == 0 ? 2 : index + 1; // @base A=M+1 A=A+1...
+}
+
+void write_address_steps(CodeWriter *cw, Segment segment, uint16_t index) {
+    write_a_register(cw, segment_registers[segment]);
+    if (index == 0) {
+        write_c(cw, DEST_A, COMP_M, JUMP_NULL);
+        return;
+    }
+    write_c(cw, DEST_A, COMP_M_PLUS_1, JUMP_NULL);
+    for (uint16_t i = 1; i < index; ++i) {
+        write_c(cw, DEST_A, COMP_A_PLUS_1, JUMP_NULL);
+    }
+}
+
+bool is_direct_segment(Segment segment) {
+    return segment == SEG_STATIC || segment == SEG_TEMP
+        || segment == SEG_POINTER;
+}
+
+void write_direct_address(CodeWriter *cw, Segment segment, uint16_t index) {
+    if (segment == SEG_STATIC) {
+        build_unique_name(cw, cw->file_name, NULL, index);
+        write_a_name(cw);
+        return;
+    }
+    write_a_value(cw, (segment == SEG_POINTER ? pointer_base : temp_base)
+            + index);
+}
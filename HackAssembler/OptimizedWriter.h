@@ -0,0 +1,99 @@
+#ifndef OPTIMIZED_WRITER_H
+#define OPTIMIZED_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CodeWriter.h"
+#include "VMParser.h"
+
+// optimizing back end of the code writer. The top of the stack is kept in D,
+// or as a pending constant or comparison, between commands, and written to
+// RAM only where control flow joins: at labels, jumps, calls and function
+// entries. Constants fold into the command that uses them, comparisons into
+// the if-goto that tests them, and calls and returns jump to subroutines
+// written once at the end of the program
+
+
+// constants
+
+// jump of the opposite condition of each jump
+extern const JumpToken negated_jumps[];
+
+
+// functions
+
+// translates a single command, from the current state of the stack top
+void write_optimized_command(CodeWriter *cw, const VMCommand *cmd);
+
+// writes the code of each kind of command
+void write_cached_arithmetic(CodeWriter *cw, ArithmeticOp op);
+void write_cached_push(CodeWriter *cw, Segment segment, uint16_t index);
+void write_cached_pop(CodeWriter *cw, Segment segment, uint16_t index);
+void write_cached_if(CodeWriter *cw, Field label);
+void write_cached_function(CodeWriter *cw, Field function,
+        uint16_t num_locals);
+
+// writes the binary operation, or the difference of a comparison, of the two
+// values on top of the stack into D
+void write_cached_binary(CodeWriter *cw, ArithmeticOp op);
+
+// writes a call through the shared call subroutine. Its return value is left
+// in D
+void write_shared_call(CodeWriter *cw, Field function, uint16_t num_args);
+
+// writes a return of the stack top through the shared return subroutine
+void write_shared_return(CodeWriter *cw);
+
+// writes the shared subroutines that were called
+void write_shared_subroutines(CodeWriter *cw);
+
+// writes the cached stack top to RAM
+void flush_stack(CodeWriter *cw);
+
+// returns whether two writers cache the same stack top
+bool same_stack_top(const CodeWriter *cw, const CodeWriter *other);
+
+// makes the writer cache the stack top of from
+void copy_stack_top(CodeWriter *cw, const CodeWriter *from);
+
+// writes the instructions that leave the stack top in D, and the rest of the
+// stack in RAM
+void load_top(CodeWriter *cw);
+
+// writes the value cached in D, if any, to RAM, leaving at most a constant
+// stack top cached
+void spill_d(CodeWriter *cw);
+
+// writes the instructions that compute a comparison into D, -1 or 0
+void write_comparison_value(CodeWriter *cw);
+
+// writes the instructions that place the constant into D
+void write_load_constant(CodeWriter *cw, uint16_t value);
+
+// writes the instructions that apply the binary operation to D and the
+// constant, into D
+void write_constant_operation(CodeWriter *cw, ArithmeticOp op,
+        uint16_t value);
+
+// writes the instructions that place into A the address of the word index of
+// a segment addressed through its base register, without changing D if
+// keep_d is set
+void write_cached_address(CodeWriter *cw, Segment segment, uint16_t index,
+        bool keep_d);
+
+// returns the number of instructions that step A from the base register of a
+// segment to its word index, without using D
+int address_steps_cost(uint16_t index);
+
+// writes the instructions that step A from the base register of a segment to
+// its word index, without using D
+void write_address_steps(CodeWriter *cw, Segment segment, uint16_t index);
+
+// returns whether the segment is a fixed RAM word: static, temp or pointer
+bool is_direct_segment(Segment segment);
+
+// writes the A instruction of a fixed RAM word of a direct segment
+void write_direct_address(CodeWriter *cw, Segment segment, uint16_t index);
+
+#endif
@@ -0,0 +1,182 @@
+#include "Output.h"
+#include "HackAssembler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// constants
+const char *const format_names[] = {
+    [FORMAT_TEXT] = "text", [FORMAT_RAW_LE] = "le", [FORMAT_RAW_BE] = "be",
+    [FORMAT_IHEX] = "ihex", [FORMAT_ROM] = "rom", [FORMAT_OBJECT] = "obj",
+};
+const char *const format_extensions[] = {
+    [FORMAT_TEXT] = "hack", [FORMAT_RAW_LE] = "bin", [FORMAT_RAW_BE] = "bin",
+    [FORMAT_IHEX] = "hex",  [FORMAT_ROM] = "rom", [FORMAT_OBJECT] = "hobj",
+};
+const size_t num_formats = sizeof(format_names) / sizeof(*format_names);
+const uint16_t rom_version = 1;
+const size_t rom_header_size = 16; // bytes, as written
+const size_t raw_block_size = 1 << 15; // words converted per write
+const size_t ihex_record_bytes = 16; // data bytes per record
+// ':' + count, address, type and checksum, 2 hex digits a byte, + '\n'
+const size_t ihex_record_size = 1 + 2*(1 + 2 + 1 + 16 + 1) + 1;
+const size_t ihex_block_records = 2048; // records formatted per write
+const char hex_digits[] = "0123456789ABCDEF";
+
+bool parse_output_format(const char *name, OutputFormat *format) {
+    for (size_t i = 0; i < num_formats; ++i) {
+        if (!strcmp(name, format_names[i])) {
+            *format = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool write_words(FILE *out_file, OutputFormat format, const uint16_t *words,
+        size_t num_words) {
+    switch (format) {
+        case FORMAT_TEXT:
+            return write_text_words(out_file, words, num_words);
+        case FORMAT_RAW_LE:
+        case FORMAT_RAW_BE:
+            return write_raw_words(out_file, format, words, num_words);
+        case FORMAT_IHEX:
+            return write_ihex_words(out_file, words, num_words);
+        case FORMAT_ROM:
+            return write_rom_words(out_file, words, num_words);
+        case FORMAT_OBJECT: // needs the whole assembly, see write_object
+            return false;
+    }
+    return false;
+}
+
+bool write_raw_words(FILE *out_file, OutputFormat format,
+        const uint16_t *words, size_t num_words) {
+    uint8_t *bytes = malloc(2*raw_block_size);
+    if (!bytes) {
+        return false;
+    }
+    int high = format == FORMAT_RAW_BE ? 0 : 1; // index of the high byte
+    for (size_t i = 0; i < num_words; i += raw_block_size) {
+        size_t block_size = num_words - i < raw_block_size
+                          ? num_words - i : raw_block_size;
+        for (size_t j = 0; j < block_size; ++j) {
+            bytes[2*j + high] = words[i+j] >> 8;
+            bytes[2*j + !high] = words[i+j] & 0xff;
+        }
+        if (fwrite(bytes, 2, block_size, out_file) != block_size) {
+            break;
+        }
+    }
+    free(bytes);
+    return !ferror(out_file);
+}
+
+bool write_ihex_words(FILE *out_file, const uint16_t *words, size_t num_words) {
+    char *text = malloc(ihex_block_records*ihex_record_size);
+    if (!text) {
+        return false;
+    }
+    size_t text_len = 0, num_records = 0;
+    size_t num_bytes = 2*num_words;
+    uint8_t data[16];
+    for (size_t offset = 0; offset < num_bytes; offset += ihex_record_bytes) {
+        if (num_records + 2 > ihex_block_records) { // room for 2 more records
+            fwrite(text, 1, text_len, out_file);
+            text_len = num_records = 0;
+        }
+        if (offset % 0x10000 == 0 && offset > 0) { // next 64KB segment
+            uint8_t upper[2] = {offset >> 24, (offset >> 16) & 0xff};
+            text_len += format_ihex_record(text + text_len, 4, 0, upper, 2);
+            ++num_records;
+        }
+        size_t len = num_bytes - offset < ihex_record_bytes
+                   ? num_bytes - offset : ihex_record_bytes;
+        for (size_t j = 0; j < len; j += 2) {
+            uint16_t word = words[(offset + j) / 2];
+            data[j] = word >> 8;
+            data[j+1] = word & 0xff;
+        }
+        text_len += format_ihex_record(text + text_len, 0, offset & 0xffff,
+                data, len);
+        ++num_records;
+    }
+    text_len += format_ihex_record(text + text_len, 1, 0, NULL, 0);
+    fwrite(text, 1, text_len, out_file);
+    free(text);
+    return !ferror(out_file);
+}
+
+size_t format_ihex_record(char *text, uint8_t type, uint16_t addr,
+        const uint8_t *data, size_t len) {
+    uint8_t record[4 + 16 + 1] = {len, addr >> 8, addr & 0xff, type};
+    if (len > 0) {
+        memcpy(record + 4, data, len);
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < 4 + len; ++i) {
+        checksum += record[i];
+    }
+    record[4 + len] = -checksum; // all the bytes sum to 0
+    size_t text_len = 0;
+    text[text_len++] = ':';
+    for (size_t i = 0; i < 4 + len + 1; ++i) {
+        text[text_len++] = hex_digits[record[i] >> 4];
+        text[text_len++] = hex_digits[record[i] & 0xf];
+    }
+    text[text_len++] = '\n';
+    return text_len;
+}
+
+bool write_rom_words(FILE *out_file, const uint16_t *words, size_t num_words) {
+    if (num_words > UINT32_MAX) {
+        return false;
+    }
+    uint8_t header[16];
+    memcpy(header, "HACK", 4);
+    store_le16(header + 4, rom_version);
+    store_le16(header + 6, rom_header_size);
+    store_le32(header + 8, num_words);
+    store_le32(header + 12, fletcher32(words, num_words));
+    if (fwrite(header, 1, rom_header_size, out_file) != rom_header_size) {
+        return false;
+    }
+    return write_raw_words(out_file, FORMAT_RAW_LE, words, num_words);
+}
+
+uint32_t fletcher32(const uint16_t *words, size_t num_words) {
+    uint32_t sum1 = 0xffff, sum2 = 0xffff;
+    while (num_words > 0) {
+        // sums fit in 32 bits for up to 359 words before reducing them
+        size_t block_size = num_words < 359 ? num_words : 359;
+        num_words -= block_size;
+        for (size_t i = 0; i < block_size; ++i) {
+            sum1 += *words++;
+            sum2 += sum1;
+        }
+        sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+        sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    }
+    sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+    sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    return sum2 << 16 | sum1;
+}
+
+void store_le16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = value & 0xff;
+    bytes[1] = value >> 8;
+}
+
+void store_le32(uint8_t *bytes, uint32_t value) {
+    store_le16(bytes, value & 0xffff);
+    store_le16(bytes + 2, value >> 16);
+}
+
+uint16_t load_le16(const uint8_t *bytes) {
+    return bytes[0] | bytes[1] << 8;
+}
+
+uint32_t load_le32(const uint8_t *bytes) {
+    return load_le16(bytes) | (uint32_t)load_le16(bytes + 2) << 16;
+}
@@ -0,0 +1,72 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// data types
+
+// formats the machine words can be written in
+typedef enum OutputFormat {
+    FORMAT_TEXT,   // binary ASCII lines, 16 bits + '\n' each
+    FORMAT_RAW_LE, // 16-bit words, little-endian
+    FORMAT_RAW_BE, // 16-bit words, big-endian
+    FORMAT_IHEX,   // Intel HEX records of the big-endian words
+    FORMAT_ROM,    // rom header, then the little-endian words
+    FORMAT_OBJECT  // relocatable object, to be linked, see Object.h
+} OutputFormat;
+
+
+// constants
+
+// name of each format, as given on the command line
+extern const char *const format_names[];
+
+// output file extension of each format
+extern const char *const format_extensions[];
+
+extern const uint16_t rom_version;
+
+
+// functions
+
+// places into format the format named name, returns false if there is none
+bool parse_output_format(const char *name, OutputFormat *format);
+
+// writes the machine words to out_file in the format, converting them in large
+// blocks, returns false on write errors
+bool write_words(FILE *out_file, OutputFormat format, const uint16_t *words,
+        size_t num_words);
+
+// writes the words as raw bytes, in the byte order of the format
+bool write_raw_words(FILE *out_file, OutputFormat format,
+        const uint16_t *words, size_t num_words);
+
+// writes the words as Intel HEX data records of 16 bytes, extended linear
+// address records past 64KB, and an end of file record
+bool write_ihex_words(FILE *out_file, const uint16_t *words, size_t num_words);
+
+// appends an Intel HEX record of len data bytes to text, returns the length of
+// the record
+size_t format_ihex_record(char *text, uint8_t type, uint16_t addr,
+        const uint8_t *data, size_t len);
+
+// writes the rom header, then the words little-endian. The header holds, all
+// little-endian: "HACK", the version and header size in 16 bits, the number of
+// words and their Fletcher-32 checksum in 32 bits
+bool write_rom_words(FILE *out_file, const uint16_t *words, size_t num_words);
+
+// computes the Fletcher-32 checksum of the words
+uint32_t fletcher32(const uint16_t *words, size_t num_words);
+
+// stores value into the bytes as little-endian
+void store_le16(uint8_t *bytes, uint16_t value);
+void store_le32(uint8_t *bytes, uint32_t value);
+
+// loads a little-endian value from the bytes
+uint16_t load_le16(const uint8_t *bytes);
+uint32_t load_le32(const uint8_t *bytes);
+
+#endif
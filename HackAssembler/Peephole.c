@@ -0,0 +1,343 @@
+#include "Peephole.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Input.h"
+#include "Lexer.h"
+#include "PredefinedSymbols.h"
+#include "SymbolTable.h"
+
+// constants
+const char *const peephole_rule_names[] = {
+    [RULE_REDUNDANT_LOAD] = "redundant loads",
+    [RULE_DEAD_LOAD]      = "dead loads",
+    [RULE_REDUNDANT_COPY] = "redundant copies",
+    [RULE_JUMP_TO_NEXT]   = "jumps to next",
+    [RULE_CANCELLED_STEP] = "cancelled steps",
+    [RULE_FOLDED_STEP]    = "folded steps",
+};
+const size_t names_table_size = 128;
+
+bool optimize_buffer(const char *input, size_t size, const char *filename,
+        Assembly *as, PeepholeStats *stats) {
+    *stats = (PeepholeStats) {0};
+    if (!assemble_buffer(input, size, filename, as)) {
+        return false;
+    }
+    stats->words_before = as->num_words;
+    Program prog;
+    if (!init_program(&prog, as->allocator)
+            || !parse_program(input, size, &prog, as)) {
+        free_program(&prog);
+        memory_error(as);
+        return false;
+    }
+    while (peephole_pass(&prog, stats)) {
+        continue;
+    }
+    assemble_program(&prog, filename, as);
+    free_program(&prog);
+    stats->words_after = as->num_words;
+    return as->num_errors == 0 && !as->out_of_memory;
+}
+
+bool parse_program(const char *input, size_t size, Program *prog,
+        Assembly *as) {
+    size_t pos = 0;
+    Field line;
+    int line_num = 0;
+    while (next_line(input, size, &pos, &line)) {
+        Field asm_instr = parse_comments_and_whitespace(line, as);
+        ++line_num;
+        if (as->out_of_memory) {
+            return false;
+        }
+        if (asm_instr.len == 0) {
+            continue;
+        }
+        size_t names_size = prog->names->arena_size;
+        if (!grow_array(prog->allocator, &prog->instrs, prog->num_instrs,
+                    &prog->instrs_capacity, sizeof(*prog->instrs))
+                || !parse_instr(asm_instr, line_num, prog,
+                    &prog->instrs[prog->num_instrs], as)) {
+            return false;
+        }
+        const Instr *instr = &prog->instrs[prog->num_instrs++];
+        uint32_t label_addr;
+        if (instr->kind == INSTR_A_SYMBOL && instr->value >= names_size
+                && !lookup_key(as->st, prog->names->arena + instr->value,
+                    instr->name_len, &label_addr)) { // first use of a variable
+            if (!grow_array(prog->allocator, &prog->variables,
+                        prog->num_variables, &prog->variables_capacity,
+                        sizeof(*prog->variables))) {
+                return false;
+            }
+            prog->variables[prog->num_variables++] = *instr;
+        }
+    }
+    return true;
+}
+
+bool parse_instr(Field asm_instr, int line_num, Program *prog, Instr *instr,
+        Assembly *as) {
+    *instr = (Instr) {.line_num = line_num};
+    const char *str = asm_instr.str;
+    size_t len = asm_instr.len;
+    if (str[0] == '(') { // (label) definition
+        const char *label_end = memchr(str, ')', len);
+        instr->kind = INSTR_LABEL;
+        return intern_name(prog, str+1, (label_end ? label_end : str+len)
+                - (str+1), instr);
+    }
+    if (str[0] == '@') { // A instruction
+        Field key = {str+1, len-1};
+        uint16_t value;
+        instr->kind = INSTR_A_VALUE;
+        if (isdigit((unsigned char)*key.str)) {
+            lex_value(key, &value);
+            instr->value = value;
+            return true;
+        }
+        if (lookup_predefined(key.str, key.len, &instr->value)) {
+            return true;
+        }
+        instr->kind = INSTR_A_SYMBOL;
+        return intern_name(prog, key.str, key.len, instr);
+    }
+    instr->kind = INSTR_C;
+    parse_C_instruction(str, len, line_num, &instr->comp, &instr->dest,
+            &instr->jump, as);
+    return true;
+}
+
+bool intern_name(Program *prog, const char *name, size_t len, Instr *instr) {
+    instr->name_len = len;
+    if (lookup_key(prog->names, name, len, &instr->value)) {
+        return true;
+    }
+    instr->value = prog->names->arena_size; // where the name is interned
+    return insert_symbol(prog->names, name, len, instr->value) == INSERT_OK;
+}
+
+bool peephole_pass(Program *prog, PeepholeStats *stats) {
+    Instr *instrs = prog->instrs;
+    size_t out = 0; // instructions are kept in place, up to out
+    bool rewritten = false;
+    KnownRegisters known = {0};
+    for (size_t i = 0; i < prog->num_instrs; ++i) {
+        Instr instr = instrs[i];
+        // last instruction kept, before the labels right before instr
+        size_t first_label = out;
+        while (first_label > 0 && instrs[first_label-1].kind == INSTR_LABEL) {
+            --first_label;
+        }
+        size_t num_labels = out - first_label;
+        Instr *prev = first_label > 0 ? &instrs[first_label-1] : NULL;
+        switch (instr.kind) {
+            case INSTR_LABEL:
+                if (prev && prev->kind == INSTR_C && prev->jump != JUMP_NULL
+                        && first_label >= 2
+                        && instrs[first_label-2].kind == INSTR_A_SYMBOL
+                        && instrs[first_label-2].value == instr.value) {
+                    if (prev->dest == DEST_NULL) { // nothing else to do
+                        memmove(prev, prev+1, num_labels*sizeof(*prev));
+                        --out;
+                    } else {
+                        prev->jump = JUMP_NULL;
+                    }
+                    ++stats->rewrites[RULE_JUMP_TO_NEXT];
+                    rewritten = true;
+                }
+                break;
+            case INSTR_A_VALUE:
+            case INSTR_A_SYMBOL:
+                if (known.a_known && same_load(&known.a, &instr)) {
+                    ++stats->rewrites[RULE_REDUNDANT_LOAD];
+                    rewritten = true;
+                    continue;
+                }
+                if (prev && prev->kind != INSTR_C) { // overwritten unused
+                    memmove(prev, prev+1, num_labels*sizeof(*prev));
+                    --out;
+                    ++stats->rewrites[RULE_DEAD_LOAD];
+                    rewritten = true;
+                }
+                break;
+            case INSTR_C:
+                if (known.d_is_m && is_assignment(&instr, DEST_M, COMP_D)) {
+                    ++stats->rewrites[RULE_REDUNDANT_COPY];
+                    rewritten = true;
+                    continue;
+                }
+                if (prev && num_labels == 0 && prev->kind == INSTR_C
+                        && prev->jump == JUMP_NULL) {
+                    int left = rewrite_pair(prev, &instr, stats);
+                    if (left < 2) {
+                        out -= 1 - left;
+                        known.d_is_m = false; // for instructions gone
+                        if (left == 1) {
+                            update_known(&known, prev);
+                        }
+                        rewritten = true;
+                        continue;
+                    }
+                }
+                break;
+        }
+        instrs[out++] = instr;
+        update_known(&known, &instr);
+    }
+    prog->num_instrs = out;
+    return rewritten;
+}
+
+int rewrite_pair(Instr *prev, const Instr *instr, PeepholeStats *stats) {
+    if ((is_assignment(prev, DEST_M, COMP_M_PLUS_1)
+                && is_assignment(instr, DEST_M, COMP_M_MINUS_1))
+            || (is_assignment(prev, DEST_M, COMP_M_MINUS_1)
+                && is_assignment(instr, DEST_M, COMP_M_PLUS_1))) {
+        ++stats->rewrites[RULE_CANCELLED_STEP];
+        return 0;
+    }
+    if ((is_assignment(prev, DEST_M, COMP_M_PLUS_1)
+                && is_assignment(instr, DEST_AM, COMP_M_MINUS_1))
+            || (is_assignment(prev, DEST_M, COMP_M_MINUS_1)
+                && is_assignment(instr, DEST_AM, COMP_M_PLUS_1))) {
+        prev->dest = DEST_A; // M is back to its value, A gets it
+        prev->comp = COMP_M;
+        ++stats->rewrites[RULE_CANCELLED_STEP];
+        return 1;
+    }
+    if (is_assignment(prev, DEST_A, COMP_M)
+            && (is_assignment(instr, DEST_A, COMP_A_PLUS_1)
+                || is_assignment(instr, DEST_A, COMP_A_MINUS_1))) {
+        prev->comp = instr->comp == COMP_A_PLUS_1
+                   ? COMP_M_PLUS_1 : COMP_M_MINUS_1;
+        ++stats->rewrites[RULE_FOLDED_STEP];
+        return 1;
+    }
+    // D=M then D=D+1 or D=D-1, whose jump only depends on the output
+    if (is_assignment(prev, DEST_D, COMP_M) && instr->kind == INSTR_C
+            && instr->dest == DEST_D && (instr->comp == COMP_D_PLUS_1
+                || instr->comp == COMP_D_MINUS_1)) {
+        prev->comp = instr->comp == COMP_D_PLUS_1
+                   ? COMP_M_PLUS_1 : COMP_M_MINUS_1;
+        prev->jump = instr->jump;
+        ++stats->rewrites[RULE_FOLDED_STEP];
+        return 1;
+    }
+    return 2;
+}
+
+void update_known(KnownRegisters *known, const Instr *instr) {
+    switch (instr->kind) {
+        case INSTR_LABEL: // entered from anywhere
+            *known = (KnownRegisters) {0};
+            break;
+        case INSTR_A_VALUE:
+        case INSTR_A_SYMBOL:
+            if (!known->a_known || !same_load(&known->a, instr)) {
+                known->a_known = true;
+                known->a = *instr;
+                known->d_is_m = false;
+            }
+            break;
+        case INSTR_C: {
+            uint16_t dest = dest_bits[instr->dest];
+            if (dest & dest_bits[DEST_A]) { // M is another word
+                known->a_known = false;
+                known->d_is_m = false;
+            } else if (dest == dest_bits[DEST_MD]) {
+                known->d_is_m = true;
+            } else if (dest == dest_bits[DEST_M]) {
+                known->d_is_m = instr->comp == COMP_D;
+            } else if (dest == dest_bits[DEST_D]) {
+                known->d_is_m = instr->comp == COMP_M;
+            }
+            break;
+        }
+    }
+}
+
+bool is_assignment(const Instr *instr, DestToken dest, CompToken comp) {
+    return instr->kind == INSTR_C && instr->dest == dest
+        && instr->comp == comp && instr->jump == JUMP_NULL;
+}
+
+bool same_load(const Instr *instr, const Instr *other) {
+    return instr->kind == other->kind && instr->value == other->value;
+}
+
+void assemble_program(Program *prog, const char *filename, Assembly *as) {
+    reset_assembly(as);
+    as->filename = filename;
+    // pending first, so that rewrites leave the addresses of variables as
+    // they were
+    for (size_t i = 0; i < prog->num_variables && !as->out_of_memory; ++i) {
+        const Instr *variable = &prog->variables[i];
+        uint32_t pending_idx;
+        add_pending(as, prog->names->arena + variable->value,
+                variable->name_len, variable->line_num, &pending_idx);
+    }
+    for (size_t i = 0; i < prog->num_instrs && !as->out_of_memory; ++i) {
+        const Instr *instr = &prog->instrs[i];
+        if (instr->kind == INSTR_A_VALUE) {
+            append_word(as, instr->value);
+            continue;
+        }
+        if (instr->kind == INSTR_C) {
+            append_word(as, encode_C_instruction(instr->comp, instr->dest,
+                        instr->jump));
+            continue;
+        }
+        // symbols are resolved by the assembly, from their name
+        const char *name = prog->names->arena + instr->value;
+        if (instr->kind == INSTR_LABEL) {
+            define_label(name, instr->name_len, instr->line_num, as);
+        } else {
+            uint16_t value;
+            reference_symbol(name, instr->name_len, instr->line_num, &value,
+                    as);
+            append_word(as, value);
+        }
+    }
+    if (!as->out_of_memory && !as->relocatable) {
+        resolve_variables(as);
+    }
+}
+
+bool init_program(Program *prog, const Allocator *allocator) {
+    *prog = (Program) {.allocator = allocator};
+    prog->names = new_symbol_table(names_table_size, allocator);
+    return prog->names != NULL;
+}
+
+void free_program(Program *prog) {
+    mem_free(prog->allocator, prog->instrs);
+    mem_free(prog->allocator, prog->variables);
+    if (prog->names) {
+        delete_symbol_table(prog->names);
+    }
+    *prog = (Program) {0};
+}
+
+void print_peephole_stats(FILE *stream, const char *filename,
+        const PeepholeStats *stats) {
+    fprintf(stream, "%s: peephole saved %zu of %zu words",
+            filename ? filename : "stdin",
+            stats->words_before - stats->words_after, stats->words_before);
+    const char *separator = ": ";
+    for (int rule = 0; rule < NUM_PEEPHOLE_RULES; ++rule) {
+        if (stats->rewrites[rule] > 0) {
+            fprintf(stream, "%s%zu %s", separator, stats->rewrites[rule],
+                    peephole_rule_names[rule]);
+            separator = ", ";
+        }
+    }
+    fputc('\n', stream);
+}
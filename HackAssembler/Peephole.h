@@ -0,0 +1,138 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+
+// data types
+
+// rewrites of the peephole optimizer, each safe on any path into the code
+typedef enum PeepholeRule {
+    RULE_REDUNDANT_LOAD, // @X when A already holds X
+    RULE_DEAD_LOAD,      // @X overwritten by the next @Y, past labels only
+    RULE_REDUNDANT_COPY, // M=D when D already equals M
+    RULE_JUMP_TO_NEXT,   // jump to the label right after it
+    RULE_CANCELLED_STEP, // M=M+1 undone by M=M-1, or by AM=M-1 into A=M
+    RULE_FOLDED_STEP,    // A=M then A=A-1 into A=M-1, also for D and +1
+    NUM_PEEPHOLE_RULES
+} PeepholeRule;
+
+// counts of the rewrites of the optimizer, and the words it saved
+typedef struct PeepholeStats {
+    size_t rewrites[NUM_PEEPHOLE_RULES];
+    size_t words_before;
+    size_t words_after;
+} PeepholeStats;
+
+// kinds of parsed instructions
+typedef enum InstrKind {
+    INSTR_LABEL,    // (label) definition, no word
+    INSTR_A_VALUE,  // A instruction of a constant or predefined symbol
+    INSTR_A_SYMBOL, // A instruction of a label or variable
+    INSTR_C
+} InstrKind;
+
+// instruction parsed into its tokens, or its value or symbol. Symbols are
+// identified by the offset of their name in the names of the program, so
+// that the same symbol always has the same offset
+typedef struct Instr {
+    InstrKind kind;
+    int line_num;     // in the input, errors are reported for it
+    uint32_t value;   // A value, or offset of the name of the symbol
+    uint32_t name_len;
+    CompToken comp;
+    DestToken dest;
+    JumpToken jump;
+} Instr;
+
+// instructions of a whole input, rewritten in place by the optimizer
+typedef struct Program {
+    const Allocator *allocator;
+    Instr *instrs;
+    size_t num_instrs;
+    size_t instrs_capacity;
+    SymbolTable *names; // of the symbols, to the offset of their name
+    Instr *variables;   // first reference of each variable, in input order
+    size_t num_variables;
+    size_t variables_capacity;
+} Program;
+
+// what is known of the registers at a point of the program, on every path
+// into it
+typedef struct KnownRegisters {
+    bool a_known;
+    Instr a;     // A instruction whose value A holds, if a_known
+    bool d_is_m; // D equals the RAM word at A
+} KnownRegisters;
+
+
+// constants
+
+// name of each rule, as reported
+extern const char *const peephole_rule_names[];
+
+
+// functions
+
+// assembles the size characters of input into the words of as like
+// assemble_buffer, then parses it into instructions, rewrites them with the
+// peephole rules until none applies, and assembles them again, recomputing
+// the label addresses. Errors are those of the input, and stop before any
+// rewrite. The rewrites are counted into stats
+bool optimize_buffer(const char *input, size_t size, const char *filename,
+        Assembly *as, PeepholeStats *stats);
+
+// parses the valid input into the instructions of the program, using the
+// scratch buffer of as, whose labels tell the variables apart. Returns false
+// if there is not enough memory
+bool parse_program(const char *input, size_t size, Program *prog,
+        Assembly *as);
+
+// parses a single stripped instruction of the line into instr
+bool parse_instr(Field asm_instr, int line_num, Program *prog, Instr *instr,
+        Assembly *as);
+
+// sets the value of the A instruction instr to the symbol name of len
+// characters, interned in the names of the program, returns false if there is
+// not enough memory
+bool intern_name(Program *prog, const char *name, size_t len, Instr *instr);
+
+// rewrites the instructions of the program once, in a single forward scan,
+// counting the rewrites into stats, returns false if there were none
+bool peephole_pass(Program *prog, PeepholeStats *stats);
+
+// rewrites the pair of C instructions prev, then instr, that follow each
+// other with no label between, into prev alone, or nothing, if a rule
+// applies, returns the number of instructions left, 2 if none applies
+int rewrite_pair(Instr *prev, const Instr *instr, PeepholeStats *stats);
+
+// updates what is known of the registers after the instruction
+void update_known(KnownRegisters *known, const Instr *instr);
+
+// returns whether the instruction is a C instruction dest=comp, with no jump
+bool is_assignment(const Instr *instr, DestToken dest, CompToken comp);
+
+// returns whether both A instructions load the same value
+bool same_load(const Instr *instr, const Instr *other);
+
+// assembles the instructions of the program into the words of as, which is
+// reset first. The variables are allocated in the order of the input, even
+// those whose references were all rewritten away
+void assemble_program(Program *prog, const char *filename, Assembly *as);
+
+// creates an empty program taking its memory from allocator, returns false if
+// there is not enough memory
+bool init_program(Program *prog, const Allocator *allocator);
+
+// frees the instructions and names of the program
+void free_program(Program *prog);
+
+// prints the words saved, and the rewrites, for the file filename
+void print_peephole_stats(FILE *stream, const char *filename,
+        const PeepholeStats *stats);
+
+#endif
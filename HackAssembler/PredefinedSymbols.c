@@ -0,0 +1,14 @@
+#include "PredefinedSymbols.h"
+
+bool lookup_predefined(const char *key, size_t len, uint32_t *value) {
+    if (len == 0 || len > PREDEFINED_MAX_LEN) {
+        return false;
+    }
+    uint64_t packed = pack_predefined_key(key, len);
+    size_t slot = predefined_slot(packed, predefined_seed);
+    if (predefined_keys[slot] != packed) {
+        return false;
+    }
+    *value = predefined_values[slot];
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PREDEFINED_SYMBOLS_H
+#define PREDEFINED_SYMBOLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// constants
+
+// the perfect hash table of predefined symbols has 2^PREDEFINED_TABLE_BITS
+// slots, and holds keys of up to PREDEFINED_MAX_LEN characters
+#define PREDEFINED_TABLE_BITS 6
+#define PREDEFINED_TABLE_SIZE (1 << PREDEFINED_TABLE_BITS)
+#define PREDEFINED_MAX_LEN 8
+
+// read-only tables generated at build time by tools/gen_predefined_table: the
+// packed key and the value of the predefined symbol in each slot, 0 if the
+// slot is empty, and the seed of the hash, chosen so that no two predefined
+// symbols share a slot
+extern const uint64_t predefined_keys[PREDEFINED_TABLE_SIZE];
+extern const uint16_t predefined_values[PREDEFINED_TABLE_SIZE];
+extern const uint64_t predefined_seed;
+
+
+// functions
+
+// packs a key of up to PREDEFINED_MAX_LEN characters into an integer, one
+// byte per character. Characters are never null, so distinct keys always pack
+// to distinct values
+static inline uint64_t pack_predefined_key(const char *key, size_t len) {
+    uint64_t packed = 0;
+    for (size_t i = 0; i < len; ++i) {
+        packed |= (uint64_t)(unsigned char)key[i] << 8*i;
+    }
+    return packed;
+}
+
+// hashes a packed key to its slot in the table, by multiplying it with the
+// seed and keeping the top bits
+static inline size_t predefined_slot(uint64_t packed, uint64_t seed) {
+    return (packed * seed) >> (64 - PREDEFINED_TABLE_BITS);
+}
+
+// looks up a predefined symbol (SP, LCL, ARG, THIS, THAT, SCREEN, KBD, R0-R15)
+// of len characters, if found, places value in *value, returns true
+// if not found, returns false
+bool lookup_predefined(const char *key, size_t len, uint32_t *value);
+
+#endif
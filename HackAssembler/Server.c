@@ -0,0 +1,256 @@
+#include "Server.h"
+#include "Object.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// constants
+const char *const server_env_var = "HACKASM_SERVER";
+const uint32_t max_request_size = 1 << 28; // refuse larger names or data
+const int listen_backlog = 64;
+const int connection_timeout = 10;
+
+bool run_server(const char *socket_path, long num_threads) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return false;
+    }
+    strcpy(addr.sun_path, socket_path);
+    signal(SIGPIPE, SIG_IGN); // clients going away are write errors
+    Server server;
+    atomic_init(&server.failed, false);
+    if ((server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("Error: socket");
+        return false;
+    }
+    struct stat path_stat;
+    if (!stat(socket_path, &path_stat) && S_ISSOCK(path_stat.st_mode)) {
+        unlink(socket_path); // left by a previous server
+    }
+    if (bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr))
+            || listen(server.listen_fd, listen_backlog)) {
+        fprintf(stderr, "Error: could not listen on %s: %s\n", socket_path,
+                strerror(errno));
+        close(server.listen_fd);
+        return false;
+    }
+    // the main thread serves too, with the threads that could be started
+    pthread_t *threads = malloc(num_threads*sizeof(*threads));
+    long num_started = 0;
+    while (threads && num_started < num_threads - 1
+            && !pthread_create(&threads[num_started], NULL, server_worker,
+                &server)) {
+        ++num_started;
+    }
+    server_worker(&server);
+    for (long i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    close(server.listen_fd);
+    return !atomic_load(&server.failed);
+}
+
+void *server_worker(void *server_ptr) {
+    Server *server = server_ptr;
+    Assembly *as = new_assembly(NULL); // warm across every job of the thread
+    if (!as) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    struct timeval timeout = {.tv_sec = connection_timeout};
+    while (true) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (!atomic_exchange(&server->failed, true)) {
+                perror("Error: accept");
+                // wakes the other threads blocked in accept
+                shutdown(server->listen_fd, SHUT_RDWR);
+            }
+            break;
+        }
+        // an idle or stalled client does not hold the thread forever
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        serve_connection(fd, as);
+        close(fd);
+    }
+    delete_assembly(as);
+    return NULL;
+}
+
+void serve_connection(int fd, Assembly *as) {
+    JobRequest request;
+    char *payload = NULL;
+    while (read_full(fd, &request, sizeof(request))) {
+        if (request.name_size > max_request_size
+                || request.data_size > max_request_size
+                || request.kind > JOB_PATH || request.format > FORMAT_OBJECT) {
+            break; // not a client of this server
+        }
+        size_t payload_size = request.name_size + request.data_size;
+        char *new_payload = realloc(payload, payload_size + 2);
+        if (!new_payload) {
+            break;
+        }
+        payload = new_payload;
+        if (!read_full(fd, payload, payload_size)) {
+            break;
+        }
+        // null terminate the name, and the data after it, which is moved by
+        // one byte to make room
+        memmove(payload + request.name_size + 1, payload + request.name_size,
+                request.data_size);
+        payload[request.name_size] = '\0';
+        payload[payload_size + 1] = '\0';
+        if (!serve_job(fd, &request, payload, as)) {
+            break;
+        }
+    }
+    free(payload);
+}
+
+bool serve_job(int fd, const JobRequest *request, const char *payload,
+        Assembly *as) {
+    const char *name = request->name_size > 0 ? payload : NULL;
+    const char *data = payload + request->name_size + 1;
+    as->relocatable = request->format == FORMAT_OBJECT;
+    bool success;
+    if (request->kind == JOB_PATH) {
+        FILE *in_file = fopen(data, "r");
+        if (!in_file) {
+            reset_assembly(as);
+            as->filename = data;
+            parse_error(as, 0, "could not open file for reading",
+                    (Field) {NULL, 0});
+            success = false;
+        } else {
+            success = assemble(in_file, name ? name : data, as);
+            fclose(in_file);
+        }
+    } else {
+        success = assemble_buffer(data, request->data_size, name, as);
+    }
+    char *output = NULL;
+    size_t output_size = 0;
+    FILE *out_stream = open_memstream(&output, &output_size);
+    if (!out_stream) {
+        return false;
+    }
+    if (success) {
+        success = as->relocatable
+                ? write_object(out_stream, as)
+                : write_words(out_stream, request->format, as->words,
+                        as->num_words);
+    } else {
+        print_assembly_errors(out_stream, as);
+    }
+    bool sent = false;
+    if (!fclose(out_stream)) {
+        JobResponse response = {
+            .num_errors = success ? 0 : as->num_errors + as->out_of_memory,
+            .size = output_size};
+        if (!success && response.num_errors == 0) { // failed writing output
+            response.num_errors = 1;
+        }
+        sent = write_full(fd, &response, sizeof(response))
+            && write_full(fd, output, output_size);
+    }
+    free(output);
+    return sent;
+}
+
+void print_assembly_errors(FILE *stream, const Assembly *as) {
+    for (size_t i = 0; i < as->num_errors; ++i) {
+        const AssemblyError *error = &as->errors[i];
+        Field value = {error->value, error->value ? strlen(error->value) : 0};
+        print_error(stream, as->filename, error->line_num, error->message,
+                value);
+    }
+    if (as->out_of_memory) {
+        print_error(stream, as->filename, 0, "out of memory",
+                (Field) {NULL, 0});
+    }
+}
+
+int connect_server(const char *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool request_job(int fd, const JobRequest *request, const char *name,
+        const char *data, JobResponse *response, char **payload) {
+    if (!write_full(fd, request, sizeof(*request))
+            || !write_full(fd, name, request->name_size)
+            || !write_full(fd, data, request->data_size)
+            || !read_full(fd, response, sizeof(*response))) {
+        return false;
+    }
+    if (!(*payload = malloc(response->size + 1))) {
+        return false;
+    }
+    if (!read_full(fd, *payload, response->size)) {
+        free(*payload);
+        return false;
+    }
+    (*payload)[response->size] = '\0';
+    return true;
+}
+
+bool read_full(int fd, void *buf, size_t size) {
+    char *bytes = buf;
+    while (size > 0) {
+        ssize_t n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool write_full(int fd, const void *buf, size_t size) {
+    const char *bytes = buf;
+    while (size > 0) {
+        // a peer gone, or timed out, is an error rather than a SIGPIPE
+        ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HackAssembler.h"
+#include "Output.h"
+
+// data types
+
+// what the data of a job request holds
+typedef enum JobKind {
+    JOB_SOURCE, // assembly source text
+    JOB_PATH    // path of a file to assemble, as seen by the server
+} JobKind;
+
+// header of a job request, followed by name_size bytes of the name errors are
+// reported for, and data_size bytes of data. Client and server share the host,
+// fields are in its byte order
+typedef struct JobRequest {
+    uint32_t kind;
+    uint32_t format;
+    uint32_t name_size;
+    uint32_t data_size;
+} JobRequest;
+
+// header of a job response, followed by size bytes: the output in the format
+// requested if there were no errors, or else the text of the errors
+typedef struct JobResponse {
+    uint32_t num_errors;
+    uint32_t size;
+} JobResponse;
+
+// listening socket shared by the worker threads of the server
+typedef struct Server {
+    int listen_fd;
+    atomic_bool failed; // accept failed, the socket is shut down to stop the
+                        // other threads
+} Server;
+
+
+// constants
+
+// environment variable naming the socket of a server, jobs are sent to it
+// instead of being assembled locally when it is set
+extern const char *const server_env_var;
+
+// seconds a connection may wait for a client, that keeps it open between its
+// jobs, before it is closed. The client then assembles its jobs locally
+extern const int connection_timeout;
+
+
+// functions
+
+// listens on the unix socket at socket_path, replacing a stale socket file,
+// and serves jobs on num_threads threads, each keeping its assembly state
+// warm between jobs. Returns false if the socket could not be set up, or
+// could no longer accept connections, otherwise runs until killed
+bool run_server(const char *socket_path, long num_threads);
+
+// worker thread, accepts connections and serves their jobs one at a time,
+// until accepting fails
+void *server_worker(void *server);
+
+// serves every job sent on the connection fd, until it is closed, or waits
+// for the client for longer than the connection timeout
+void serve_connection(int fd, Assembly *as);
+
+// assembles the job and sends its response, returns false if the connection
+// failed
+bool serve_job(int fd, const JobRequest *request, const char *payload,
+        Assembly *as);
+
+// prints the errors of the assembly, as they were collected, to stream
+void print_assembly_errors(FILE *stream, const Assembly *as);
+
+// connects to the server listening at socket_path, returns the socket, or -1
+// on failure
+int connect_server(const char *socket_path);
+
+// sends a job to the server on fd, and receives the response, whose payload is
+// allocated on the heap into *payload. Returns false if the connection failed
+bool request_job(int fd, const JobRequest *request, const char *name,
+        const char *data, JobResponse *response, char **payload);
+
+// reads exactly size bytes from fd, returns false on errors or end of file
+bool read_full(int fd, void *buf, size_t size);
+
+// writes exactly size bytes to the socket fd, returns false on errors,
+// including a peer that closed the connection
+bool write_full(int fd, const void *buf, size_t size);
+
+#endif
@@ -0,0 +1,170 @@
+#include "Stats.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "Emulator.h"
+#include "Input.h"
+#include "Lexer.h"
+
+// constants
+const char *const stats_phase_names[] = {"read", "assemble", "output"};
+
+void start_stats(AssemblyStats *stats, const Assembly *as) {
+    memset(stats, 0, sizeof(*stats));
+    stats->symbols.num_grows = as->st->num_grows;
+    stats->pending.num_grows = as->pending_st->num_grows;
+}
+
+void start_phase(PhaseTime *start) {
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    start->wall = wall.tv_sec + wall.tv_nsec/1e9;
+    start->cpu = cpu.tv_sec + cpu.tv_nsec/1e9;
+}
+
+void end_phase(AssemblyStats *stats, StatsPhase phase, const PhaseTime *start) {
+    PhaseTime end;
+    start_phase(&end);
+    stats->phases[phase].wall += end.wall - start->wall;
+    stats->phases[phase].cpu += end.cpu - start->cpu;
+}
+
+void collect_stats(AssemblyStats *stats, const char *input, size_t size,
+        const Assembly *as) {
+    size_t pos = 0;
+    Field line;
+    while (next_line(input, size, &pos, &line)) {
+        ++stats->num_lines;
+    }
+    // comp bits to their token, NUM_COMP_TOKENS for none
+    uint8_t comp_tokens[128];
+    for (int comp = 0; comp < 128; ++comp) {
+        CompToken token;
+        comp_tokens[comp] = lookup_comp_token(comp, &token) ? token
+                                                            : NUM_COMP_TOKENS;
+    }
+    stats->num_instructions = as->num_words;
+    for (size_t i = 0; i < as->num_words; ++i) {
+        if (!(as->words[i] & 0x8000)) {
+            ++stats->num_a_instructions;
+            continue;
+        }
+        ++stats->num_c_instructions;
+        uint8_t token = comp_tokens[(as->words[i] >> 6) & 0x7f];
+        if (token == NUM_COMP_TOKENS) {
+            ++stats->num_other_comps;
+        } else {
+            ++stats->comp_counts[token];
+        }
+    }
+    stats->num_labels = as->st->num_entries;
+    const SymbolTable *pending_st = as->pending_st;
+    for (size_t i = 0; i < pending_st->size; ++i) {
+        const TableEntry *entry = &pending_st->table[i];
+        uint32_t value;
+        if (entry->key_len != 0 && !lookup_key(as->st,
+                    pending_st->arena + entry->key_offset, entry->key_len,
+                    &value)) {
+            ++stats->num_variables;
+        }
+    }
+    compute_table_stats(as->st, stats->symbols.num_grows, &stats->symbols);
+    compute_table_stats(as->pending_st, stats->pending.num_grows,
+            &stats->pending);
+}
+
+void compute_table_stats(const SymbolTable *st, size_t num_grows,
+        TableStats *stats) {
+    *stats = (TableStats) {.size = st->size, .num_entries = st->num_entries,
+        .num_grows = st->num_grows - num_grows};
+    size_t mask = st->size - 1;
+    size_t hit_probes = 0;
+    for (size_t i = 0; i < st->size; ++i) {
+        const TableEntry *entry = &st->table[i];
+        if (entry->key_len == 0) {
+            continue;
+        }
+        size_t probes = ((i - (entry->hash & mask)) & mask) + 1;
+        hit_probes += probes;
+        if (probes > stats->max_hit_probes) {
+            stats->max_hit_probes = probes;
+        }
+    }
+    // a miss probes up to the first free entry from its home entry. Walking
+    // down twice, wrapping around, counts the full entries above each one
+    size_t miss_probes = 0, run = 0;
+    for (size_t n = 2*st->size; n > 0; --n) {
+        size_t i = (n - 1) & mask;
+        run = st->table[i].key_len == 0 ? 0 : run + 1;
+        if (n <= st->size) {
+            miss_probes += run + 1;
+        }
+    }
+    if (st->num_entries > 0) {
+        stats->avg_hit_probes = (double)hit_probes / st->num_entries;
+    }
+    stats->avg_miss_probes = (double)miss_probes / st->size;
+}
+
+void print_stats(FILE *stream, const char *filename,
+        const AssemblyStats *stats) {
+    flockfile(stream);
+    fprintf(stream, "{\"file\": ");
+    write_json_string(stream, filename ? filename : "stdin");
+    fprintf(stream, ", \"phases\": {");
+    for (int i = 0; i < NUM_STATS_PHASES; ++i) {
+        fprintf(stream, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                i ? ", " : "", stats_phase_names[i],
+                1e3*stats->phases[i].wall, 1e3*stats->phases[i].cpu);
+    }
+    fprintf(stream, "}, \"lines\": %zu, \"instructions\": %zu, "
+            "\"a_instructions\": %zu, \"c_instructions\": %zu, "
+            "\"labels\": %zu, \"variables\": %zu, \"symbol_table\": ",
+            stats->num_lines, stats->num_instructions,
+            stats->num_a_instructions, stats->num_c_instructions,
+            stats->num_labels, stats->num_variables);
+    print_table_stats(stream, &stats->symbols);
+    fprintf(stream, ", \"pending_table\": ");
+    print_table_stats(stream, &stats->pending);
+    fprintf(stream, ", \"comp_histogram\": {");
+    const char *separator = "";
+    for (int comp = 0; comp < NUM_COMP_TOKENS; ++comp) {
+        if (stats->comp_counts[comp] > 0) {
+            fprintf(stream, "%s\"%s\": %zu", separator, comp_mnemonics[comp],
+                    stats->comp_counts[comp]);
+            separator = ", ";
+        }
+    }
+    if (stats->num_other_comps > 0) {
+        fprintf(stream, "%s\"other\": %zu", separator,
+                stats->num_other_comps);
+    }
+    fprintf(stream, "}}\n");
+    funlockfile(stream);
+}
+
+void print_table_stats(FILE *stream, const TableStats *stats) {
+    fprintf(stream, "{\"size\": %zu, \"entries\": %zu, \"load_factor\": %.3f, "
+            "\"grows\": %zu, \"avg_hit_probes\": %.3f, "
+            "\"max_hit_probes\": %zu, \"avg_miss_probes\": %.3f}",
+            stats->size, stats->num_entries,
+            (double)stats->num_entries / stats->size, stats->num_grows,
+            stats->avg_hit_probes, stats->max_hit_probes,
+            stats->avg_miss_probes);
+}
+
+void write_json_string(FILE *stream, const char *str) {
+    fputc('"', stream);
+    for (const char *c = str; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(stream, "\\%c", *c);
+        } else if ((unsigned char)*c < ' ') {
+            fprintf(stream, "\\u%04x", *c);
+        } else {
+            fputc(*c, stream);
+        }
+    }
+    fputc('"', stream);
+}
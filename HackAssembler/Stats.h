@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+#include "SymbolTable.h"
+
+// number of comp tokens
+#define NUM_COMP_TOKENS (COMP_D_OR_M + 1)
+
+// data types
+
+// phases of a job timed by --stats
+typedef enum StatsPhase {
+    STATS_READ,     // open or map the input
+    STATS_ASSEMBLE, // parse and encode, define and resolve the symbols
+    STATS_OUTPUT,   // write the output file
+    NUM_STATS_PHASES
+} StatsPhase;
+
+// wall clock and CPU time of the thread, in seconds, read at the start of a
+// phase, or spent in it
+typedef struct PhaseTime {
+    double wall;
+    double cpu;
+} PhaseTime;
+
+// shape of a symbol table, and the probes of looking up keys in it
+typedef struct TableStats {
+    size_t size;
+    size_t num_entries;
+    size_t num_grows;       // grow_table calls during the job
+    double avg_hit_probes;  // of looking up each key in the table
+    size_t max_hit_probes;
+    double avg_miss_probes; // of looking up an absent key, over every home
+                            // entry
+} TableStats;
+
+// statistics of a job, reported by --stats. Everything but the times is
+// computed once the job is done, from its input, words and symbol tables,
+// so that assembling costs nothing more for them
+typedef struct AssemblyStats {
+    PhaseTime phases[NUM_STATS_PHASES];
+    size_t num_lines;
+    size_t num_instructions;
+    size_t num_a_instructions;
+    size_t num_c_instructions;
+    size_t num_labels;
+    size_t num_variables; // symbols never defined as labels
+    TableStats symbols;   // labels
+    TableStats pending;   // symbols referenced before their definition
+    size_t comp_counts[NUM_COMP_TOKENS]; // of the C instructions
+    size_t num_other_comps;              // comp bits of no token
+} AssemblyStats;
+
+
+// functions
+
+// starts the statistics of a job assembled into as
+void start_stats(AssemblyStats *stats, const Assembly *as);
+
+// reads the clocks at the start of a phase
+void start_phase(PhaseTime *start);
+
+// adds the time since start to the phase
+void end_phase(AssemblyStats *stats, StatsPhase phase, const PhaseTime *start);
+
+// computes the statistics of the finished assembly of the size characters of
+// input into as
+void collect_stats(AssemblyStats *stats, const char *input, size_t size,
+        const Assembly *as);
+
+// computes the statistics of the symbol table, that had grown num_grows times
+// before the job
+void compute_table_stats(const SymbolTable *st, size_t num_grows,
+        TableStats *stats);
+
+// prints the statistics of the file filename as a line of JSON, at once even
+// if other threads print to the stream
+void print_stats(FILE *stream, const char *filename,
+        const AssemblyStats *stats);
+
+// prints the statistics of a symbol table as a JSON object
+void print_table_stats(FILE *stream, const TableStats *stats);
+
+// prints str as a JSON string, quoted and escaped
+void write_json_string(FILE *stream, const char *str);
+
+#endif
@@ -0,0 +1,213 @@
+#include "Stream.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// constants
+const size_t stream_read_size = 65536;
+const size_t default_stream_buffer = 1 << 20; // 2 MB of words
+const size_t spill_block_size = 4096; // words read back at a time
+
+bool can_stream(OutputFormat format) {
+    return format == FORMAT_TEXT || format == FORMAT_RAW_LE
+        || format == FORMAT_RAW_BE;
+}
+
+bool stream_file(FILE *in_file, FILE *out_file, const char *filename,
+        OutputFormat format, size_t max_buffered) {
+    Stream stream = {.out_file = out_file, .format = format,
+        .max_buffered = max_buffered ? max_buffered : 1};
+    char *data = malloc(stream_read_size);
+    Assembly *as = stream.as = new_assembly(NULL);
+    if (!data || !as) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(data);
+        if (as) {
+            delete_assembly(as);
+        }
+        return false;
+    }
+    as->error_stream = stderr;
+    as->filename = filename;
+    as->patch_taken = patch_spilled;
+    as->patch_context = &stream;
+    // read as the data arrives, so a pipe does not wait for its writer to
+    // finish, and flushed after each read, so its reader does not either
+    ssize_t size;
+    while ((size = read(fileno(in_file), data, stream_read_size)) != 0) {
+        if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size < 0) {
+            parse_error(as, 0, "could not read input", (Field) {NULL, 0});
+            break;
+        }
+        stream_data(&stream, data, size);
+        flush_stream(&stream);
+    }
+    if (stream.line_len > 0) { // last line, without '\n'
+        assemble_line((Field) {stream.line, stream.line_len},
+                ++stream.line_num, as);
+    }
+    if (!as->out_of_memory) {
+        resolve_variables(as);
+    }
+    stream.failed |= as->num_errors > 0 || as->out_of_memory;
+    if (!stream.failed) {
+        write_final_words(&stream, as->num_words);
+    }
+    if (!stream.failed && fflush(out_file)) {
+        stream_error(&stream, "could not write the output");
+    }
+    bool success = !stream.failed;
+    free(data);
+    mem_free(as->allocator, stream.line);
+    if (stream.spill_file) {
+        fclose(stream.spill_file);
+    }
+    delete_assembly(as);
+    return success;
+}
+
+void stream_data(Stream *stream, const char *data, size_t size) {
+    const char *end = data + size;
+    while (data != end) {
+        const char *line_end = memchr(data, '\n', end - data);
+        size_t len = (line_end ? line_end : end) - data;
+        if (!line_end || stream->line_len > 0) { // joined to the partial line
+            if (!grow_array(stream->as->allocator, &stream->line,
+                        stream->line_len + len, &stream->line_capacity, 1)) {
+                memory_error(stream->as);
+                return;
+            }
+            memcpy(stream->line + stream->line_len, data, len);
+            stream->line_len += len;
+        }
+        if (!line_end) {
+            return;
+        }
+        Field line = stream->line_len > 0
+                   ? (Field) {stream->line, stream->line_len}
+                   : (Field) {data, len};
+        assemble_line(line, ++stream->line_num, stream->as);
+        stream->line_len = 0;
+        data = line_end + 1;
+    }
+}
+
+void flush_stream(Stream *stream) {
+    Assembly *as = stream->as;
+    stream->failed |= as->num_errors > 0 || as->out_of_memory;
+    if (stream->failed) {
+        return;
+    }
+    write_final_words(stream, final_words_end(stream));
+    // the words written are dropped once they are half of the buffer, so each
+    // word buffered is moved a bounded number of times
+    size_t num_buffered = as->num_words - as->words_base;
+    if (stream->num_written > as->words_base
+            && 2*(stream->num_written - as->words_base) >= num_buffered) {
+        take_words(as, stream->num_written);
+    }
+    if (as->num_words - as->words_base > stream->max_buffered) {
+        spill_words(stream);
+    }
+    if (fflush(stream->out_file)) {
+        stream_error(stream, "could not write the output");
+    }
+}
+
+size_t final_words_end(Stream *stream) {
+    const Assembly *as = stream->as;
+    // the first fixups of the pending symbols are in the order of the
+    // symbols, so the first fixup of the first unresolved one is the first
+    // word that may not be final
+    while (stream->first_unresolved < as->num_pending
+            && as->pending[stream->first_unresolved].resolved) {
+        ++stream->first_unresolved;
+    }
+    if (stream->first_unresolved == as->num_pending) {
+        return as->num_words;
+    }
+    const PendingSymbol *ps = &as->pending[stream->first_unresolved];
+    return as->fixups[ps->first_fixup].instr_addr;
+}
+
+void write_final_words(Stream *stream, size_t end) {
+    Assembly *as = stream->as;
+    uint16_t *block = NULL;
+    while (!stream->failed && stream->num_written < end
+            && stream->num_written < stream->spill_end) {
+        size_t spilled_end = end < stream->spill_end ? end : stream->spill_end;
+        size_t num_words = spilled_end - stream->num_written;
+        if (num_words > spill_block_size) {
+            num_words = spill_block_size;
+        }
+        if (!block && !(block = malloc(spill_block_size*sizeof(*block)))) {
+            memory_error(as);
+            stream->failed = true;
+            break;
+        }
+        long offset = (stream->num_written - stream->spill_start)
+            * sizeof(*block);
+        if (fseek(stream->spill_file, offset, SEEK_SET)
+                || fread(block, sizeof(*block), num_words, stream->spill_file)
+                   != num_words
+                || !write_words(stream->out_file, stream->format, block,
+                    num_words)) {
+            stream_error(stream, "could not copy the temporary file to the "
+                    "output");
+        }
+        stream->num_written += num_words;
+    }
+    free(block);
+    if (!stream->failed && stream->num_written < end) {
+        if (!write_words(stream->out_file, stream->format,
+                    as->words + (stream->num_written - as->words_base),
+                    end - stream->num_written)) {
+            stream_error(stream, "could not write the output");
+        }
+        stream->num_written = end;
+    }
+}
+
+void spill_words(Stream *stream) {
+    Assembly *as = stream->as;
+    if (stream->num_written > as->words_base) {
+        take_words(as, stream->num_written);
+    }
+    if (!stream->spill_file && !(stream->spill_file = tmpfile())) {
+        stream_error(stream, "could not create a temporary file");
+        return;
+    }
+    if (stream->num_written >= stream->spill_end) { // all written, reuse it
+        stream->spill_start = stream->spill_end = as->words_base;
+    }
+    size_t num_words = as->num_words - as->words_base;
+    long offset = (stream->spill_end - stream->spill_start)*sizeof(uint16_t);
+    if (fseek(stream->spill_file, offset, SEEK_SET)
+            || fwrite(as->words, sizeof(uint16_t), num_words,
+                stream->spill_file) != num_words) {
+        stream_error(stream, "could not write the temporary file");
+        return;
+    }
+    stream->spill_end += num_words;
+    take_words(as, as->num_words);
+}
+
+void patch_spilled(void *stream_ptr, size_t addr, uint16_t value) {
+    Stream *stream = stream_ptr;
+    long offset = (addr - stream->spill_start)*sizeof(value);
+    if (fseek(stream->spill_file, offset, SEEK_SET)
+            || fwrite(&value, sizeof(value), 1, stream->spill_file) != 1) {
+        stream_error(stream, "could not write the temporary file");
+    }
+}
+
+void stream_error(Stream *stream, const char *message) {
+    if (!stream->failed) {
+        fprintf(stderr, "Error: %s\n", message);
+    }
+    stream->failed = true;
+}
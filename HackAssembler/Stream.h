@@ -0,0 +1,87 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "HackAssembler.h"
+#include "Output.h"
+
+// data types
+
+// assembly of an input read as it arrives, a pipe from a compiler say, whose
+// words are written as soon as they are final: every word before the first
+// reference to a symbol that may not be resolved yet. A symbol is resolved
+// when its label is defined, or at the end of the input, as a variable. The
+// words after it are buffered in memory up to a cap, and past it in a
+// temporary file, where their fixups are patched
+typedef struct Stream {
+    Assembly *as; // its words start at the first word buffered in memory
+    FILE *out_file;
+    OutputFormat format;
+    size_t num_written;     // words written to out_file
+    size_t first_unresolved; // index of the first pending symbol that was
+                             // not resolved when last checked
+    size_t max_buffered;    // words buffered in memory before spilling
+    FILE *spill_file;       // words spilled, NULL until needed
+    size_t spill_start;     // address of the first word of the spill file
+    size_t spill_end;       // address past its last word
+    char *line;             // partial line at the end of the data read
+    size_t line_len;
+    size_t line_capacity;
+    int line_num;
+    bool failed; // on errors, the words are no longer written
+} Stream;
+
+
+// constants
+
+// bytes read from the input at a time, the output is flushed after each
+extern const size_t stream_read_size;
+
+// default cap of the words buffered in memory
+extern const size_t default_stream_buffer;
+
+
+// functions
+
+// returns whether words can be written in the format as they are assembled,
+// from the first: text and raw words. The rom header and objects need the
+// whole program, and Intel HEX is not streamed
+bool can_stream(OutputFormat format);
+
+// assembles in_file as it is read to out_file, in a format that can be
+// streamed, buffering at most max_buffered words in memory. Errors are
+// reported for the file filename to stderr, and stop the output, which is
+// then incomplete. Returns false if there were errors
+bool stream_file(FILE *in_file, FILE *out_file, const char *filename,
+        OutputFormat format, size_t max_buffered);
+
+// assembles the complete lines of the size characters of data, keeping the
+// partial line at its end for the next data, or the end of the input
+void stream_data(Stream *stream, const char *data, size_t size);
+
+// writes the words that are final, drops them from memory, and spills the
+// words buffered past the cap
+void flush_stream(Stream *stream);
+
+// returns the address of the first word that is not final, the words of the
+// stream if they all are
+size_t final_words_end(Stream *stream);
+
+// writes the words from the first not written to the address end, from the
+// spill file, then from memory
+void write_final_words(Stream *stream, size_t end);
+
+// moves the words buffered in memory to the end of the spill file
+void spill_words(Stream *stream);
+
+// patches a fixup of the word at addr, spilled by the stream, with value
+void patch_spilled(void *stream, size_t addr, uint16_t value);
+
+// reports an error of the stream to stderr, unless it has already failed, and
+// stops its output
+void stream_error(Stream *stream, const char *message);
+
+#endif
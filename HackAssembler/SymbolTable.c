@@ -1,109 +1,194 @@
 #include "SymbolTable.h"
 
 #include <stdio.h>
-#include <stdlib.h>
 
-SymbolTable *new_symbol_table(size_t size) {
-    SymbolTable *st = malloc(sizeof(*st));
-    st->table = malloc(size*sizeof(*st->table));
-    st->size = size;
+// constants
+const size_t initial_arena_capacity = 1024;
+
+SymbolTable *new_symbol_table(size_t size, const Allocator *allocator) {
+    size_t pow2_size = 1;
+    while (pow2_size < size) { // round up to a power of two, for masking
+        pow2_size <<= 1;
+    }
+    SymbolTable *st = mem_alloc(allocator, sizeof(*st));
+    if (!st) {
+        return NULL;
+    }
+    st->allocator = allocator;
+    st->table = mem_calloc(allocator, pow2_size, sizeof(*st->table));
+    st->size = pow2_size;
     st->num_entries = 0;
+    st->num_grows = 0;
+    st->arena = mem_alloc(allocator, initial_arena_capacity);
+    st->arena_size = 0;
+    st->arena_capacity = initial_arena_capacity;
+    if (!st->table || !st->arena) {
+        delete_symbol_table(st);
+        return NULL;
+    }
     return st;
 }
 
 void delete_symbol_table(SymbolTable *st) {
-    free(st->table);
-    st->size = 0;
-    st->num_entries = 0;
-    // free(st);
+    mem_free(st->allocator, st->table);
+    mem_free(st->allocator, st->arena);
+    mem_free(st->allocator, st);
 }
 
-size_t compute_hash(const char *key) {
-    size_t hash = 5381;
-    char c;
-    while ((c = *key++)) {
-        hash = ((hash << 5) + hash) + c;
+uint32_t compute_hash(const char *key, size_t len) {
+    uint32_t hash = 5381;
+    for (size_t i = 0; i < len; ++i) {
+        hash = ((hash << 5) + hash) + (unsigned char)key[i];
     }
+    // mix the high bits into the low ones, which index the table
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
     return hash;
 }
 
-void insert_symbol(SymbolTable *st, const char *key, uint16_t value) {
-    size_t hash = compute_hash(key) % st->size;
-    size_t i = hash;
-    if (st->num_entries > 0.7*st->size) {
-        grow_table(st, 2);
+bool key_equals(const SymbolTable *st, const TableEntry *entry,
+        const char *key, size_t len, uint32_t hash) {
+    return entry->hash == hash && entry->key_len == len
+        && !memcmp(st->arena + entry->key_offset, key, len);
+}
+
+bool intern_key(SymbolTable *st, const char *key, size_t len,
+        uint32_t *key_offset) {
+    if (st->arena_size + len > UINT32_MAX) { // offsets would not fit
+        return false;
     }
-    while (st->table[i].key[0] != '\0') { // traverse until no collision
-        if (i == hash - 1) { // wrapped around to starting index
-            symbol_table_error("no space left", key);
+    if (st->arena_size + len > st->arena_capacity) {
+        size_t new_capacity = st->arena_capacity;
+        while (st->arena_size + len > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *new_arena = mem_realloc(st->allocator, st->arena, new_capacity);
+        if (!new_arena) {
+            return false;
         }
-        if (!strcmp(key, st->table[i].key)) { // name collision
-            symbol_table_error("key already present", key);
+        st->arena = new_arena;
+        st->arena_capacity = new_capacity;
+    }
+    *key_offset = st->arena_size;
+    memcpy(st->arena + *key_offset, key, len);
+    st->arena_size += len;
+    return true;
+}
+
+InsertResult insert_symbol(SymbolTable *st, const char *key, size_t len,
+        uint32_t value) {
+    if (len == 0 || len > UINT32_MAX) {
+        return INSERT_INVALID_KEY;
+    }
+    if (10*(st->num_entries+1) > 7*st->size // keep load factor under 0.7
+            && !grow_table(st)) {
+        return INSERT_NO_MEMORY;
+    }
+    uint32_t hash = compute_hash(key, len);
+    size_t mask = st->size - 1;
+    size_t i = hash & mask;
+    while (st->table[i].key_len != 0) { // traverse until no collision
+        if (key_equals(st, &st->table[i], key, len, hash)) { // name collision
+            return INSERT_DUPLICATE;
         }
-        i = (i + 1) % st->size; // increment, wrapping around
+        i = (i + 1) & mask; // increment, wrapping around
+    }
+    // intern the key, and fill the empty table entry
+    uint32_t key_offset;
+    if (!intern_key(st, key, len, &key_offset)) {
+        return INSERT_NO_MEMORY;
     }
-    // copy key, value pair to the empty table entry
-    strcpy(st->table[i].key, key);
-    st->table[i].value = value;
+    st->table[i] = (TableEntry) {
+        .hash = hash, .key_offset = key_offset, .key_len = len,
+        .value = value};
     ++st->num_entries;
+    return INSERT_OK;
 }
 
-void grow_table(SymbolTable *st, double factor) {
-    size_t new_st_size = factor*st->size;
-    SymbolTable *new_st = new_symbol_table(new_st_size);
-    // printf("growing from %zd to %zd\n", st->size, new_st_size);
+void clear_symbol_table(SymbolTable *st) {
+    memset(st->table, 0, st->size*sizeof(*st->table));
+    st->num_entries = 0;
+    st->arena_size = 0;
+}
+
+void truncate_symbol_table(SymbolTable *st, size_t arena_size) {
+    size_t mask = st->size - 1;
+    // every removed entry is cleared, and the entries after it in its run of
+    // probes are reinserted, so that none is left past an empty entry
     for (size_t i = 0; i < st->size; ++i) {
-        if (st->table[i].key[0] == '\0') { // skip empty entries
+        if (st->table[i].key_len == 0
+                || st->table[i].key_offset < arena_size) {
             continue;
         }
-        insert_symbol(new_st, st->table[i].key, st->table[i].value);
+        st->table[i].key_len = 0;
+        --st->num_entries;
+        for (size_t j = (i + 1) & mask; st->table[j].key_len != 0;
+                j = (j + 1) & mask) {
+            TableEntry entry = st->table[j];
+            st->table[j].key_len = 0;
+            if (entry.key_offset >= arena_size) { // removed as well
+                --st->num_entries;
+                continue;
+            }
+            size_t k = entry.hash & mask;
+            while (st->table[k].key_len != 0) {
+                k = (k + 1) & mask;
+            }
+            st->table[k] = entry;
+        }
     }
-    delete_symbol_table(st);
-    *st = *new_st;
+    st->arena_size = arena_size;
 }
 
-bool lookup_key(SymbolTable *st, const char *key, uint16_t *value) {
-    size_t hash = compute_hash(key) % st->size;
-    size_t i = hash;
-    while (strcmp(key, st->table[i].key)) {
-        if (i == hash - 1) { // wrapped around to starting index, not found
-            return false;
+bool grow_table(SymbolTable *st) {
+    size_t new_size = 2*st->size;
+    size_t new_mask = new_size - 1;
+    TableEntry *new_table = mem_calloc(st->allocator, new_size,
+            sizeof(*new_table));
+    if (!new_table) {
+        return false;
+    }
+    for (size_t i = 0; i < st->size; ++i) {
+        if (st->table[i].key_len == 0) { // skip empty entries
+            continue;
+        }
+        size_t j = st->table[i].hash & new_mask;
+        while (new_table[j].key_len != 0) {
+            j = (j + 1) & new_mask;
         }
-        i = (i + 1) % st->size; // increment, wrapping around
+        new_table[j] = st->table[i];
     }
-    *value = st->table[i].value;
+    mem_free(st->allocator, st->table);
+    st->table = new_table;
+    st->size = new_size;
+    ++st->num_grows;
     return true;
 }
 
-void symbol_table_error(const char *error_msg, const char *error_val) {
-    fprintf(stderr, "Error in symbol table: %s: %s\n", error_msg, error_val);
-    exit(EXIT_FAILURE);
+bool lookup_key(const SymbolTable *st, const char *key, size_t len,
+        uint32_t *value) {
+    uint32_t hash = compute_hash(key, len);
+    size_t mask = st->size - 1;
+    size_t i = hash & mask;
+    while (!key_equals(st, &st->table[i], key, len, hash)) {
+        if (st->table[i].key_len == 0) { // reached an empty entry, not found
+            return false;
+        }
+        i = (i + 1) & mask; // increment, wrapping around
+    }
+    *value = st->table[i].value;
+    return true;
 }
 
-void print_table(SymbolTable *st) {
+void print_table(const SymbolTable *st) {
     for (size_t i = 0; i < st->size; ++i) {
-        if (st->table[i].key[0] == '\0') { // skip empty entries
+        const TableEntry *entry = &st->table[i];
+        if (entry->key_len == 0) { // skip empty entries
             continue;
         }
-        printf("%zd %s: %" PRIu16 "\n",
-                i, st->table[i].key, st->table[i].value);
+        printf("%zd %.*s: %" PRIu32 "\n", i, (int)entry->key_len,
+                st->arena + entry->key_offset, entry->value);
     }
     putchar('\n');
 }
-
-SymbolTable *initial_symbol_table(size_t size) {
-    const int num_symbols = 23;
-    char keys[num_symbols][7] = {
-        "SP", "LCL", "ARG", "THIS", "THAT", "SCREEN", "KBD",
-        "R0", "R1", "R2",  "R3",  "R4",  "R5",  "R6",  "R7",
-        "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15"};
-    uint16_t values[num_symbols] = {
-        0, 1, 2, 3, 4, 16384, 24576,
-        0, 1, 2,  3,  4,  5,  6,  7,
-        8, 9, 10, 11, 12, 13, 14, 15};
-    SymbolTable *st = new_symbol_table(size);
-    for (size_t i = 0; i < num_symbols; ++i) {
-        insert_symbol(st, keys[i], values[i]);
-    }
-    return st;
-}
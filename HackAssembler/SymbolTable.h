@@ -5,52 +5,90 @@
 #include <stdbool.h>
 #include <string.h>
 
-#define KEY_SIZE 64
+#include "Allocator.h"
 
 // data types
 
-// entry in symbol table, key: value pair (char[]: uint16_t)
+// entry in symbol table, key: value pair (char[]: uint32_t). The key is
+// interned in the arena of the table, and its hash is kept to skip comparing
+// keys that cannot match, and to grow the table without rehashing the keys.
+// Keys are never empty, an entry with key_len 0 is free
 typedef struct TableEntry {
-    uint16_t value;
-    char key[KEY_SIZE];
+    uint32_t hash;
+    uint32_t key_offset; // offset of the key in the arena
+    uint32_t key_len;
+    uint32_t value;
 } TableEntry;
 
-// symbol table, holds array of entries and its size
+// result of inserting a symbol
+typedef enum InsertResult {
+    INSERT_OK,
+    INSERT_DUPLICATE,   // the key is already present
+    INSERT_INVALID_KEY, // empty or too long key
+    INSERT_NO_MEMORY
+} InsertResult;
+
+// symbol table, holds a power of two sized array of entries, probed linearly
+// with a mask, and the arena holding the characters of all the keys
 typedef struct SymbolTable {
+    const Allocator *allocator;
     TableEntry *table;
     size_t size;
     size_t num_entries;
+    size_t num_grows; // calls of grow_table, never reset
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
 } SymbolTable;
 
 
 // functions
 
-// creates a new empty symbol table
-SymbolTable *new_symbol_table(size_t size);
+// creates a new empty symbol table, of at least size entries, taking its memory
+// from allocator. Returns NULL if there is not enough memory
+SymbolTable *new_symbol_table(size_t size, const Allocator *allocator);
 
 // deletes symbol table from memory
 void delete_symbol_table(SymbolTable *st);
 
-// computes the djb2 hash of a string
-size_t compute_hash(const char *key);
+// computes the djb2 hash of a string of len characters, mixed so that its low
+// bits can be used as an index
+uint32_t compute_hash(const char *key, size_t len);
+
+// compares the key of the entry to the string of len characters with the
+// given hash
+bool key_equals(const SymbolTable *st, const TableEntry *entry,
+        const char *key, size_t len, uint32_t hash);
+
+// copies a key of len characters into the arena, places its offset in
+// *key_offset. Returns false if the arena cannot hold it
+bool intern_key(SymbolTable *st, const char *key, size_t len,
+        uint32_t *key_offset);
 
 // inserts a symbol key: value pair into the symbol table st, grows if necessary
-void insert_symbol(SymbolTable *st, const char *key, uint16_t value);
+// the key has len characters, and need not be null terminated. The table is
+// left unchanged unless INSERT_OK is returned
+InsertResult insert_symbol(SymbolTable *st, const char *key, size_t len,
+        uint32_t value);
 
-// grows table to acommodate new entries
-void grow_table(SymbolTable *st, double factor);
+// removes all the entries and keys, keeping the allocated memory
+void clear_symbol_table(SymbolTable *st);
 
-// looks up a key in the table, if found, places value in *value, returns true
-// if not found, returns false
-bool lookup_key(SymbolTable *st, const char *key, uint16_t *value);
+// removes the entries inserted after the arena held arena_size bytes, keys are
+// interned in insertion order. The remaining entries are reinserted
+void truncate_symbol_table(SymbolTable *st, size_t arena_size);
 
-// prints an error message and exits
-void symbol_table_error(const char *error_msg, const char *error_val);
+// doubles the size of the table, reinserting the entries by their kept hash,
+// returns false, leaving the table unchanged, if there is not enough memory
+bool grow_table(SymbolTable *st);
 
-// prints the symbol table to stdout
-void print_table(SymbolTable *st);
+// looks up a key of len characters in the table, if found, places value in
+// *value, returns true
+// if not found, returns false
+bool lookup_key(const SymbolTable *st, const char *key, size_t len,
+        uint32_t *value);
 
-// creates the initial symbol table for the Hack assembler
-SymbolTable *initial_symbol_table(size_t size);
+// prints the symbol table to stdout
+void print_table(const SymbolTable *st);
 
 #endif
@@ -0,0 +1,182 @@
+#include "VMParser.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Input.h"
+#include "Lexer.h"
+
+// constants
+const char *const command_keywords[] = {
+    [C_ARITHMETIC] = "",
+    [C_PUSH]       = "push",
+    [C_POP]        = "pop",
+    [C_LABEL]      = "label",
+    [C_GOTO]       = "goto",
+    [C_IF]         = "if-goto",
+    [C_FUNCTION]   = "function",
+    [C_RETURN]     = "return",
+    [C_CALL]       = "call",
+};
+const char *const segment_keywords[] = {
+    [SEG_ARGUMENT] = "argument",
+    [SEG_LOCAL]    = "local",
+    [SEG_STATIC]   = "static",
+    [SEG_CONSTANT] = "constant",
+    [SEG_THIS]     = "this",
+    [SEG_THAT]     = "that",
+    [SEG_POINTER]  = "pointer",
+    [SEG_TEMP]     = "temp",
+};
+const char *const arithmetic_keywords[] = {
+    [VM_ADD] = "add",
+    [VM_SUB] = "sub",
+    [VM_NEG] = "neg",
+    [VM_EQ]  = "eq",
+    [VM_GT]  = "gt",
+    [VM_LT]  = "lt",
+    [VM_AND] = "and",
+    [VM_OR]  = "or",
+    [VM_NOT] = "not",
+};
+const int num_command_keywords = C_CALL + 1;
+const int num_segment_keywords = SEG_TEMP + 1;
+const int num_arithmetic_keywords = VM_NOT + 1;
+const uint16_t num_pointers = 2;
+const uint16_t num_temps = 8;
+
+void init_vm_parser(VMParser *parser, const char *data, size_t size) {
+    *parser = (VMParser) {.data = data, .size = size};
+}
+
+bool next_command(VMParser *parser, VMCommand *cmd, Assembly *as) {
+    Field line;
+    Field words[MAX_COMMAND_WORDS + 1];
+    while (next_line(parser->data, parser->size, &parser->pos, &line)) {
+        ++parser->line_num;
+        size_t num_words = split_words(line, words, MAX_COMMAND_WORDS);
+        if (num_words > 0 && parse_command(words, num_words,
+                    parser->line_num, cmd, as)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t split_words(Field line, Field *words, size_t max_words) {
+    const char *c = line.str;
+    const char *end = line.str + line.len;
+    size_t num_words = 0;
+    while (c != end) {
+        if (isspace((unsigned char)*c)) {
+            ++c;
+            continue;
+        }
+        if (*c == '/' && c + 1 != end && c[1] == '/') { // comment to the end
+            break;
+        }
+        const char *word = c;
+        while (c != end && !isspace((unsigned char)*c)
+                && !(*c == '/' && c + 1 != end && c[1] == '/')) {
+            ++c;
+        }
+        if (num_words == max_words) {
+            return max_words + 1;
+        }
+        words[num_words++] = (Field) {word, c - word};
+    }
+    return num_words;
+}
+
+bool parse_command(const Field *words, size_t num_words, int line_num,
+        VMCommand *cmd, Assembly *as) {
+    *cmd = (VMCommand) {.line_num = line_num};
+    int token;
+    size_t expected_words;
+    if (lex_keyword(words[0], arithmetic_keywords, num_arithmetic_keywords,
+                &token)) {
+        cmd->type = C_ARITHMETIC;
+        cmd->op = token;
+        expected_words = 1;
+    } else if (lex_keyword(words[0], command_keywords, num_command_keywords,
+                &token) && token != C_ARITHMETIC) {
+        cmd->type = token;
+        expected_words = token == C_RETURN ? 1
+                       : token == C_LABEL || token == C_GOTO
+                         || token == C_IF ? 2 : 3;
+    } else {
+        parse_error(as, line_num, "unknown command", words[0]);
+        return false;
+    }
+    if (num_words != expected_words) {
+        parse_error(as, line_num, num_words < expected_words
+                ? "missing argument" : "too many arguments", words[0]);
+        return false;
+    }
+    switch (cmd->type) {
+        case C_PUSH:
+        case C_POP:
+            if (!lex_keyword(words[1], segment_keywords, num_segment_keywords,
+                        &token)) {
+                parse_error(as, line_num, "unknown segment", words[1]);
+                return false;
+            }
+            cmd->segment = token;
+            break;
+        case C_LABEL:
+        case C_GOTO:
+        case C_IF:
+        case C_FUNCTION:
+        case C_CALL:
+            if (!is_vm_name(words[1])) {
+                parse_error(as, line_num, "invalid name", words[1]);
+                return false;
+            }
+            cmd->name = words[1];
+            break;
+        default:
+            break;
+    }
+    if (expected_words == 3 && !lex_value(words[2], &cmd->index)) {
+        parse_error(as, line_num, "invalid index", words[2]);
+        return false;
+    }
+    if (cmd->type == C_POP && cmd->segment == SEG_CONSTANT) {
+        parse_error(as, line_num, "cannot pop to constant", words[1]);
+        return false;
+    }
+    if ((cmd->type == C_PUSH || cmd->type == C_POP)
+            && ((cmd->segment == SEG_POINTER && cmd->index >= num_pointers)
+                || (cmd->segment == SEG_TEMP && cmd->index >= num_temps))) {
+        parse_error(as, line_num, "index out of segment", words[2]);
+        return false;
+    }
+    return true;
+}
+
+bool lex_keyword(Field word, const char *const *keywords, int num_keywords,
+        int *token) {
+    for (int t = 0; t < num_keywords; ++t) {
+        if (!strncmp(keywords[t], word.str, word.len)
+                && keywords[t][word.len] == '\0') {
+            *token = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool is_vm_name(Field word) {
+    if (isdigit((unsigned char)word.str[0])) {
+        return false;
+    }
+    for (size_t i = 0; i < word.len; ++i) {
+        unsigned char c = word.str[i];
+        if (!isalnum(c) && c != '_' && c != '.' && c != ':') {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef VM_PARSER_H
+#define VM_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HackAssembler.h"
+
+// data types
+
+// words of the longest commands: function, call, push and pop
+#define MAX_COMMAND_WORDS 3
+
+// types of VM commands
+typedef enum VMCommandType {
+    C_ARITHMETIC, C_PUSH, C_POP, C_LABEL, C_GOTO, C_IF, C_FUNCTION, C_RETURN,
+    C_CALL
+} VMCommandType;
+
+// arithmetic and logical commands, that work on the top of the stack
+typedef enum ArithmeticOp {
+    VM_ADD, VM_SUB, VM_NEG, VM_EQ, VM_GT, VM_LT, VM_AND, VM_OR, VM_NOT
+} ArithmeticOp;
+
+// memory segments of push and pop commands
+typedef enum Segment {
+    SEG_ARGUMENT, SEG_LOCAL, SEG_STATIC, SEG_CONSTANT, SEG_THIS, SEG_THAT,
+    SEG_POINTER, SEG_TEMP
+} Segment;
+
+// VM command parsed from a line, its name is a view into the input
+typedef struct VMCommand {
+    VMCommandType type;
+    ArithmeticOp op;  // of C_ARITHMETIC
+    Segment segment;  // of C_PUSH and C_POP
+    Field name;       // label, or function name
+    uint16_t index;   // segment index, number of locals or of arguments
+    int line_num;
+} VMCommand;
+
+// position of the parser in the whole input of a .vm file
+typedef struct VMParser {
+    const char *data;
+    size_t size;
+    size_t pos;
+    int line_num;
+} VMParser;
+
+
+// constants
+
+// keywords of the commands, segments and arithmetic operations, indexed by
+// their token
+extern const char *const command_keywords[];
+extern const char *const segment_keywords[];
+extern const char *const arithmetic_keywords[];
+
+
+// functions
+
+// starts parsing the size characters of data, which is not copied and need
+// not be null terminated
+void init_vm_parser(VMParser *parser, const char *data, size_t size);
+
+// parses the next command of the input into cmd, returns false at the end of
+// the input. Lines with errors are reported to as and skipped
+bool next_command(VMParser *parser, VMCommand *cmd, Assembly *as);
+
+// splits the line into the words before its comment, at most max_words, and
+// returns their number, or max_words + 1 if there are more
+size_t split_words(Field line, Field *words, size_t max_words);
+
+// parses the words of a line into cmd, returns false on errors, reported to
+// as
+bool parse_command(const Field *words, size_t num_words, int line_num,
+        VMCommand *cmd, Assembly *as);
+
+// places into token the index of the keyword equal to word, among
+// num_keywords, returns false if there is none
+bool lex_keyword(Field word, const char *const *keywords, int num_keywords,
+        int *token);
+
+// returns whether the word is a valid label or function name: letters,
+// digits, '_', '.' and ':', not starting with a digit
+bool is_vm_name(Field word);
+
+#endif
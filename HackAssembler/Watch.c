@@ -0,0 +1,193 @@
+#include "Watch.h"
+#include "Input.h"
+#include "SymbolTable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// constants
+const useconds_t watch_interval = 100000; // between checks for changes
+
+bool watch_file(const char *in_filename, const char *out_filename,
+        OutputFormat format) {
+    Watch watch = {.in_filename = in_filename, .out_filename = out_filename,
+        .format = format};
+    if (!(watch.as = new_assembly(NULL))) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    watch.as->error_stream = stderr;
+    watch.as->filename = in_filename;
+    bool first = true;
+    while (true) {
+        struct stat in_stat;
+        if (stat(in_filename, &in_stat)) {
+            if (first) {
+                fprintf(stderr, "Error: could not read file: %s\n",
+                        in_filename);
+                delete_assembly(watch.as);
+                return false;
+            }
+            usleep(watch_interval); // being replaced, maybe
+            continue;
+        }
+        if (!first && in_stat.st_mtim.tv_sec == watch.mtime.tv_sec
+                && in_stat.st_mtim.tv_nsec == watch.mtime.tv_nsec) {
+            usleep(watch_interval);
+            continue;
+        }
+        char *input;
+        size_t size;
+        if (!read_watched(&watch, &input, &size)) {
+            usleep(watch_interval);
+            continue;
+        }
+        watch.mtime = in_stat.st_mtim;
+        size_t line_idx = first ? 0 : first_changed_line(&watch, input, size);
+        if (!first && line_idx == watch.num_lines) {
+            free(input); // touched, but the same
+            continue;
+        }
+        rewind_watch(&watch, line_idx);
+        free(watch.input);
+        watch.input = input;
+        watch.size = size;
+        assemble_watched(&watch, line_idx);
+        bool written = write_watched(&watch);
+        printf("%s: assembled from line %zu, %zu words, %zu errors%s\n",
+                in_filename, line_idx + 1, watch.as->num_words,
+                watch.as->num_errors, written ? "" : ", not written");
+        fflush(stdout);
+        first = false;
+    }
+}
+
+bool read_watched(const Watch *watch, char **input, size_t *size) {
+    FILE *in_file = fopen(watch->in_filename, "r");
+    if (!in_file) {
+        return false;
+    }
+    InputBuffer buffer;
+    bool read = read_whole_input(in_file, &buffer); // a copy, kept
+    fclose(in_file);
+    if (!read) {
+        return false;
+    }
+    *input = (char *)buffer.data;
+    *size = buffer.size;
+    return true;
+}
+
+size_t first_changed_line(const Watch *watch, const char *input, size_t size) {
+    size_t common = size < watch->size ? size : watch->size;
+    size_t offset = 0;
+    while (offset < common && input[offset] == watch->input[offset]) {
+        ++offset;
+    }
+    // last line beginning at or before the first difference, found by binary
+    // search of the offsets of the lines
+    size_t low = 0, high = watch->num_lines;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (watch->checkpoints[mid].offset <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == watch->num_lines && offset == common && size == watch->size) {
+        return watch->num_lines; // no change
+    }
+    return low > 0 ? low - 1 : 0;
+}
+
+void rewind_watch(Watch *watch, size_t line_idx) {
+    Assembly *as = watch->as;
+    if (line_idx == 0) {
+        reset_assembly(as);
+        as->filename = watch->in_filename;
+        watch->num_lines = 0;
+        return;
+    }
+    const Checkpoint *checkpoint = &watch->checkpoints[line_idx];
+    as->num_words = checkpoint->num_words;
+    as->num_fixups = checkpoint->num_fixups;
+    as->num_pending = checkpoint->num_pending;
+    for (size_t i = checkpoint->num_errors; i < as->num_errors; ++i) {
+        mem_free(as->allocator, as->errors[i].value);
+    }
+    as->num_errors = checkpoint->num_errors;
+    truncate_symbol_table(as->st, checkpoint->st_arena_size);
+    truncate_symbol_table(as->pending_st, checkpoint->pending_arena_size);
+    watch->num_lines = line_idx;
+    as->out_of_memory = false;
+    // cut the chains of fixups at the ones removed, and let the symbols be
+    // resolved again, unless they are labels defined before the line
+    for (size_t i = 0; i < as->pending_st->size; ++i) {
+        const TableEntry *entry = &as->pending_st->table[i];
+        if (entry->key_len == 0) {
+            continue;
+        }
+        PendingSymbol *ps = &as->pending[entry->value];
+        for (size_t f = ps->first_fixup; f != NO_FIXUP;
+                f = as->fixups[f].next) {
+            if (as->fixups[f].next >= as->num_fixups) {
+                as->fixups[f].next = NO_FIXUP;
+                ps->last_fixup = f;
+            }
+        }
+        uint32_t label_addr;
+        ps->resolved = lookup_key(as->st,
+                as->pending_st->arena + entry->key_offset, entry->key_len,
+                &label_addr);
+    }
+}
+
+void assemble_watched(Watch *watch, size_t line_idx) {
+    Assembly *as = watch->as;
+    // the lines before are the same, and so is the offset of the line
+    size_t pos = line_idx > 0 ? watch->checkpoints[line_idx].offset : 0;
+    Field line;
+    while (!as->out_of_memory) {
+        Checkpoint checkpoint = {.offset = pos, .num_words = as->num_words,
+            .num_fixups = as->num_fixups, .num_pending = as->num_pending,
+            .num_errors = as->num_errors,
+            .st_arena_size = as->st->arena_size,
+            .pending_arena_size = as->pending_st->arena_size};
+        if (!next_line(watch->input, watch->size, &pos, &line)) {
+            break;
+        }
+        if (!grow_array(as->allocator, &watch->checkpoints, watch->num_lines,
+                    &watch->checkpoints_capacity,
+                    sizeof(*watch->checkpoints))) {
+            memory_error(as);
+            break;
+        }
+        watch->checkpoints[watch->num_lines++] = checkpoint;
+        assemble_line(line, watch->num_lines, as);
+    }
+    resolve_variables(as);
+}
+
+bool write_watched(const Watch *watch) {
+    if (watch->as->num_errors > 0 || watch->as->out_of_memory) {
+        return false;
+    }
+    unlink(watch->out_filename); // it may be linked into a cache
+    FILE *out_file = fopen(watch->out_filename, "w");
+    if (!out_file) {
+        fprintf(stderr, "Error: could not open file for writing: %s\n",
+                watch->out_filename);
+        return false;
+    }
+    bool success = write_words(out_file, watch->format, watch->as->words,
+            watch->as->num_words);
+    if (fclose(out_file) || !success) {
+        fprintf(stderr, "Error: could not write file: %s\n",
+                watch->out_filename);
+        return false;
+    }
+    return true;
+}
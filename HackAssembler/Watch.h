@@ -0,0 +1,68 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "HackAssembler.h"
+#include "Output.h"
+
+// data types
+
+// state of the assembly at the beginning of a line. The assembly only ever
+// appends to its arrays and symbol tables, so restoring their sizes rewinds it
+// to that line
+typedef struct Checkpoint {
+    size_t offset; // of the line in the input
+    size_t num_words;
+    size_t num_fixups;
+    size_t num_pending;
+    size_t num_errors;
+    size_t st_arena_size;
+    size_t pending_arena_size;
+} Checkpoint;
+
+// file assembled again whenever it changes, from its first changed line
+typedef struct Watch {
+    const char *in_filename;
+    const char *out_filename;
+    OutputFormat format;
+    char *input; // contents last assembled
+    size_t size;
+    Checkpoint *checkpoints; // one per line
+    size_t num_lines;
+    size_t checkpoints_capacity;
+    Assembly *as;
+    struct timespec mtime; // of the contents last assembled
+} Watch;
+
+
+// functions
+
+// assembles in_filename to out_filename in the format, then again every time
+// in_filename changes, until killed. Returns false if it cannot be read
+bool watch_file(const char *in_filename, const char *out_filename,
+        OutputFormat format);
+
+// reads the whole of the watched file, returns false if it cannot be read
+bool read_watched(const Watch *watch, char **input, size_t *size);
+
+// returns the index of the first line of the last assembled contents that is
+// not the same in input, num_lines if none is
+size_t first_changed_line(const Watch *watch, const char *input, size_t size);
+
+// rewinds the assembly to the beginning of the line of index line_idx, one of
+// the lines last assembled, as if it and the lines after it were never
+// assembled
+void rewind_watch(Watch *watch, size_t line_idx);
+
+// assembles the input from the line of index line_idx, recording a checkpoint
+// for each line, and resolves the variables
+void assemble_watched(Watch *watch, size_t line_idx);
+
+// writes the output file, if there were no errors
+bool write_watched(const Watch *watch);
+
+#endif
@@ -0,0 +1,471 @@
+//
+// ahead-of-time translator for the Hack computer: translates a .hack program,
+// or a .asm program assembled in memory, to a C program that runs it natively,
+// taking the same options and reporting like the emulator. The cycle limit is
+// checked at the beginning of basic blocks, and the block that would pass it
+// is run one instruction at a time from a copy of the ROM, so the program
+// stops where the emulator does. A jump to a computed address inside a basic
+// block, that find_leaders could not foresee, is run from the ROM the same
+// way, up to the next leader
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Emulator.h"
+#include "../HackAssembler.h"
+
+// program being translated
+typedef struct Translation {
+    EmulatorOp *ops;
+    size_t num_words;
+    bool *leaders; // whether each address begins a basic block
+    size_t num_blocks;
+    FILE *out;
+} Translation;
+
+// value of the A register while translating a block, if it is known
+typedef struct KnownA {
+    bool known;
+    uint16_t value;
+} KnownA;
+
+
+// constants
+
+// C expression of each comp token, D, A and M standing for the registers
+const char *const comp_exprs[] = {
+    [COMP_0]         = "0",
+    [COMP_1]         = "1",
+    [COMP_NEG_1]     = "0xffff",
+    [COMP_D]         = "D",
+    [COMP_A]         = "A",
+    [COMP_M]         = "M",
+    [COMP_NOT_D]     = "~D",
+    [COMP_NOT_A]     = "~A",
+    [COMP_NOT_M]     = "~M",
+    [COMP_NEG_D]     = "-D",
+    [COMP_NEG_A]     = "-A",
+    [COMP_NEG_M]     = "-M",
+    [COMP_D_PLUS_1]  = "D + 1",
+    [COMP_A_PLUS_1]  = "A + 1",
+    [COMP_M_PLUS_1]  = "M + 1",
+    [COMP_D_MINUS_1] = "D - 1",
+    [COMP_A_MINUS_1] = "A - 1",
+    [COMP_M_MINUS_1] = "M - 1",
+    [COMP_D_PLUS_A]  = "D + A",
+    [COMP_D_PLUS_M]  = "D + M",
+    [COMP_D_MINUS_A] = "D - A",
+    [COMP_D_MINUS_M] = "D - M",
+    [COMP_A_MINUS_D] = "A - D",
+    [COMP_M_MINUS_D] = "M - D",
+    [COMP_D_AND_A]   = "D & A",
+    [COMP_D_AND_M]   = "D & M",
+    [COMP_D_OR_A]    = "D | A",
+    [COMP_D_OR_M]    = "D | M",
+};
+
+// C condition on the ALU output of each jump, but the null jump
+const char *const jump_conds[] = {
+    NULL, "(int16_t)out > 0", "out == 0", "(int16_t)out >= 0",
+    "(int16_t)out < 0", "out != 0", "(int16_t)out <= 0", "1"
+};
+
+// generated headers, before the ROM
+const char *const runtime_includes =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <time.h>\n"
+    "#include <unistd.h>\n"
+    "\n";
+
+// generated code before the blocks of the program: the RAM, the ALU for comp
+// bits of no token and for the instructions run from the ROM, and the
+// beginning of the function running the program, that returns 1 if it halted
+// in a loop, 0 at the cycle limit
+const char *const runtime_prologue =
+    "static uint16_t ram[32768];\n"
+    "\n"
+    "static uint16_t alu(unsigned comp, uint16_t d, uint16_t a, uint16_t m) {\n"
+    "    uint16_t x = d, y = comp & 0x40 ? m : a;\n"
+    "    if (comp & 0x20) x = 0;\n"
+    "    if (comp & 0x10) x = ~x;\n"
+    "    if (comp & 0x08) y = 0;\n"
+    "    if (comp & 0x04) y = ~y;\n"
+    "    uint16_t out = comp & 0x02 ? x + y : x & y;\n"
+    "    return comp & 0x01 ? ~out : out;\n"
+    "}\n"
+    "\n"
+    "static int run(uint64_t max_cycles, uint64_t *cycles_out,\n"
+    "        uint16_t *pc_out) {\n"
+    "    uint16_t a = 0, d = 0, pc = 0;\n"
+    "    uint64_t cycles = 0;\n"
+    "    int halted = 0;\n"
+    "    goto dispatch;\n";
+
+// generated code after the dispatch of jumps to computed addresses: the end of
+// the function running the program, that runs one instruction at pc from the
+// ROM then dispatches again, for the blocks that would pass the cycle limit
+// and for jumps inside a block, and the main function, parsing the same
+// options as the emulator
+const char *const runtime_epilogue =
+    "halt:\n"
+    "    halted = 1;\n"
+    "    goto done;\n"
+    "step:\n"
+    "    if (cycles >= max_cycles) {\n"
+    "        goto done;\n"
+    "    }\n"
+    "    ++cycles;\n"
+    "    {\n"
+    "        uint16_t addr = pc;\n"
+    "        uint16_t instr = pc < sizeof(rom)/sizeof(*rom) ? rom[pc] : 0;\n"
+    "        pc = (pc + 1) & 0x7fff;\n"
+    "        if (!(instr & 0x8000)) {\n"
+    "            a = instr;\n"
+    "            goto dispatch;\n"
+    "        }\n"
+    "        uint16_t target = a & 0x7fff, *m = &ram[target];\n"
+    "        uint16_t out = alu((instr >> 6) & 0x7f, d, a, *m);\n"
+    "        if (instr & 0x08) *m = out;\n"
+    "        if (instr & 0x10) d = out;\n"
+    "        if (instr & 0x20) a = out;\n"
+    "        if ((instr & 0x04 && (int16_t)out < 0) || (instr & 0x02 && !out)\n"
+    "                || (instr & 0x01 && (int16_t)out > 0)) {\n"
+    "            pc = target;\n"
+    "            // a jump to the @ right before it, that changes nothing\n"
+    "            if (!(instr & 0x38) && addr > 0\n"
+    "                    && rom[addr - 1] == addr - 1)\n"
+    "                goto halt;\n"
+    "        }\n"
+    "    }\n"
+    "    goto dispatch;\n"
+    "done:\n"
+    "    *cycles_out = cycles;\n"
+    "    *pc_out = pc;\n"
+    "    return halted;\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char *argv[]) {\n"
+    "    uint64_t max_cycles = UINT64_MAX;\n"
+    "    unsigned long *dumps = calloc(2*argc, sizeof(*dumps));\n"
+    "    int num_dumps = 0, optchar;\n"
+    "    unsigned long addr, last;\n"
+    "    long value;\n"
+    "    while ((optchar = getopt(argc, argv, \"hc:d:s:\")) != -1) {\n"
+    "        switch (optchar) {\n"
+    "            case 'c':\n"
+    "                max_cycles = strtoull(optarg, NULL, 10);\n"
+    "                if (max_cycles == 0) max_cycles = UINT64_MAX;\n"
+    "                break;\n"
+    "            case 'd':\n"
+    "                if (sscanf(optarg, \"%lu:%lu\", &addr, &last) == 1)\n"
+    "                    last = addr;\n"
+    "                dumps[2*num_dumps] = addr & 0x7fff;\n"
+    "                dumps[2*num_dumps++ + 1] = last & 0x7fff;\n"
+    "                break;\n"
+    "            case 's':\n"
+    "                if (sscanf(optarg, \"%lu=%ld\", &addr, &value) == 2)\n"
+    "                    ram[addr & 0x7fff] = value;\n"
+    "                break;\n"
+    "            default:\n"
+    "                fprintf(stderr, \"Usage: %s: [-h] [-c max_cycles] \"\n"
+    "                        \"[-d first[:last]]... [-s addr=value]...\\n\",\n"
+    "                        argv[0]);\n"
+    "                return optchar == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;\n"
+    "        }\n"
+    "    }\n"
+    "    struct timespec start, end;\n"
+    "    uint64_t cycles;\n"
+    "    uint16_t pc;\n"
+    "    clock_gettime(CLOCK_MONOTONIC, &start);\n"
+    "    int halted = run(max_cycles, &cycles, &pc);\n"
+    "    clock_gettime(CLOCK_MONOTONIC, &end);\n"
+    "    double elapsed = (end.tv_sec - start.tv_sec)\n"
+    "        + (end.tv_nsec - start.tv_nsec) / 1e9;\n"
+    "    fprintf(stderr, \"%s after %llu instructions, pc %u, in %.3f s, \"\n"
+    "            \"%.1f M instructions/s\\n\",\n"
+    "            halted ? \"halted\" : \"reached cycle limit\",\n"
+    "            (unsigned long long)cycles, pc, elapsed,\n"
+    "            elapsed > 0 ? cycles / elapsed / 1e6 : 0.0);\n"
+    "    for (int i = 0; i < num_dumps; ++i) {\n"
+    "        for (addr = dumps[2*i]; addr <= dumps[2*i + 1]; ++addr) {\n"
+    "            printf(\"RAM[%lu] = %d\\n\", addr, (int16_t)ram[addr]);\n"
+    "        }\n"
+    "    }\n"
+    "    return EXIT_SUCCESS;\n"
+    "}\n";
+
+
+// functions
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+// marks the leaders of the basic blocks of the program: address 0, every
+// instruction after a jump, and every address loaded into A by an A
+// instruction, the only way to know the target of a jump to a computed address
+void find_leaders(Translation *tr);
+
+// writes the whole C program
+void write_program(Translation *tr, const uint16_t *words,
+        const char *in_filename);
+
+// writes the words of the program as the ROM array, run at the cycle limit
+// and from jumps inside a block, with a last word of 0 so that it is never
+// empty
+void write_rom(Translation *tr, const uint16_t *words);
+
+// writes the basic block beginning at the leader, up to the next one, and
+// returns the address after it
+size_t write_block(Translation *tr, size_t leader);
+
+// writes a C instruction, at addr, of the block
+void write_c_instruction(Translation *tr, size_t addr, const EmulatorOp *op,
+        KnownA *a);
+
+// writes the C expression of the comp of op, with M, the RAM word at A, being
+// m_expr
+void write_comp_expr(FILE *out, const EmulatorOp *op, const char *m_expr);
+
+// writes the code that jumps to the target, the C expression of the address
+// that was in A, or halts if the op loops forever once taken
+void write_jump_target(Translation *tr, const EmulatorOp *op,
+        const char *target, const KnownA *a);
+
+// writes the switch dispatching jumps to computed addresses, through pc, to
+// the blocks, or to the ROM for addresses inside a block. Addresses past the
+// program hold @0, that runs until the program counter wraps around to 0
+void write_dispatch(Translation *tr);
+
+int main(int argc, char *argv[]) {
+    const char *out_filename = NULL;
+    int optchar;
+    while ((optchar = getopt(argc, argv, "ho:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                return EXIT_SUCCESS;
+            case 'o': // specify output file
+                out_filename = optarg;
+                break;
+            default:
+                print_help(stderr, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        print_help(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *in_filename = argv[optind];
+
+    uint16_t *words = malloc(rom_size*sizeof(*words));
+    Emulator *em = new_emulator(NULL); // decodes the program into ops
+    Translation tr = {.leaders = calloc(rom_size, sizeof(*tr.leaders))};
+    if (!words || !em || !tr.leaders) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    if (!read_program(in_filename, words, &tr.num_words, stderr)) {
+        return EXIT_FAILURE;
+    }
+    load_program(em, words, tr.num_words);
+    tr.ops = em->ops;
+    find_leaders(&tr);
+
+    tr.out = out_filename ? fopen(out_filename, "w") : stdout;
+    if (!tr.out) {
+        fprintf(stderr, "Error: could not open file for writing: %s\n",
+                out_filename);
+        return EXIT_FAILURE;
+    }
+    write_program(&tr, words, in_filename);
+    if (fclose(tr.out)) {
+        fprintf(stderr, "Error: could not write file: %s\n",
+                out_filename ? out_filename : "stdout");
+        return EXIT_FAILURE;
+    }
+    delete_emulator(em);
+    free(tr.leaders);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: ", exec_name);
+    fprintf(stream, "[-h] [-o out_file] in_file\n");
+}
+
+void find_leaders(Translation *tr) {
+    if (tr->num_words > 0) {
+        tr->leaders[0] = true;
+    }
+    for (size_t i = 0; i < tr->num_words; ++i) {
+        const EmulatorOp *op = &tr->ops[i];
+        if (op->kind == OP_LOAD) {
+            if (op->value < tr->num_words) {
+                tr->leaders[op->value] = true;
+            }
+        } else if (op->jump != 0 && i + 1 < tr->num_words) {
+            tr->leaders[i + 1] = true;
+        }
+    }
+    for (size_t i = 0; i < tr->num_words; ++i) {
+        tr->num_blocks += tr->leaders[i];
+    }
+}
+
+void write_program(Translation *tr, const uint16_t *words,
+        const char *in_filename) {
+    fprintf(tr->out, "// translated from %s by hack2c, %zu words in %zu "
+            "basic blocks\n", in_filename, tr->num_words, tr->num_blocks);
+    fputs(runtime_includes, tr->out);
+    write_rom(tr, words);
+    fputs(runtime_prologue, tr->out);
+    for (size_t addr = 0; addr < tr->num_words; ) {
+        addr = write_block(tr, addr);
+    }
+    fprintf(tr->out, "    pc = %zu;\n", tr->num_words & (rom_size - 1));
+    write_dispatch(tr);
+    fputs(runtime_epilogue, tr->out);
+}
+
+void write_rom(Translation *tr, const uint16_t *words) {
+    fprintf(tr->out, "static const uint16_t rom[] = {");
+    for (size_t i = 0; i < tr->num_words; ++i) {
+        fprintf(tr->out, i % 8 ? " %u," : "\n    %u,", words[i]);
+    }
+    fprintf(tr->out, "\n    0\n};\n\n");
+}
+
+size_t write_block(Translation *tr, size_t leader) {
+    size_t end = leader + 1;
+    while (end < tr->num_words && !tr->leaders[end]) {
+        ++end;
+    }
+    FILE *out = tr->out;
+    fprintf(out, "L%zu:\n", leader);
+    fprintf(out, "    if (cycles + %zu > max_cycles) {\n", end - leader);
+    fprintf(out, "        pc = %zu;\n", leader);
+    fprintf(out, "        goto step;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    cycles += %zu;\n", end - leader);
+    KnownA a = {0}; // blocks are entered from anywhere
+    for (size_t addr = leader; addr < end; ++addr) {
+        const EmulatorOp *op = &tr->ops[addr];
+        if (op->kind == OP_LOAD) {
+            fprintf(out, "    a = %u;\n", op->value);
+            a = (KnownA) {true, op->value};
+        } else {
+            write_c_instruction(tr, addr, op, &a);
+        }
+    }
+    return end;
+}
+
+void write_c_instruction(Translation *tr, size_t addr, const EmulatorOp *op,
+        KnownA *a) {
+    FILE *out = tr->out;
+    char m_expr[32];
+    char target[32];
+    if (a->known) {
+        snprintf(m_expr, sizeof(m_expr), "ram[%u]", a->value & 0x7fff);
+        snprintf(target, sizeof(target), "%u", a->value & 0x7fff);
+    } else {
+        snprintf(m_expr, sizeof(m_expr), "ram[a & 0x7fff]");
+        snprintf(target, sizeof(target), "a & 0x7fff");
+    }
+    fprintf(out, "    { // %zu\n", addr);
+    if (op->jump != 0 && !a->known && (op->dest & 0x4)) {
+        fprintf(out, "        uint16_t target = a & 0x7fff;\n");
+        snprintf(target, sizeof(target), "target");
+    }
+    // the output is not computed if nothing stores or tests it
+    if (op->dest != 0 || (op->jump != 0 && op->jump != JUMP_JMP)) {
+        fprintf(out, "        uint16_t out = ");
+        write_comp_expr(out, op, m_expr);
+        fprintf(out, ";\n");
+    }
+    if (op->dest & 0x1) {
+        fprintf(out, "        %s = out;\n", m_expr);
+    }
+    if (op->dest & 0x2) {
+        fprintf(out, "        d = out;\n");
+    }
+    if (op->dest & 0x4) {
+        fprintf(out, "        a = out;\n");
+    }
+    if (op->jump != 0) {
+        write_jump_target(tr, op, target, a);
+    }
+    fprintf(out, "    }\n");
+    if (op->dest & 0x4) {
+        a->known = false;
+    }
+}
+
+void write_comp_expr(FILE *out, const EmulatorOp *op, const char *m_expr) {
+    if (op->kind == OP_ALU) {
+        fprintf(out, "alu(0x%02x, d, a, %s)", op->comp, m_expr);
+        return;
+    }
+    for (const char *c = comp_exprs[op->kind]; *c; ++c) {
+        switch (*c) {
+            case 'D':
+                fputc('d', out);
+                break;
+            case 'A':
+                fputc('a', out);
+                break;
+            case 'M':
+                fputs(m_expr, out);
+                break;
+            default:
+                fputc(*c, out);
+        }
+    }
+}
+
+void write_jump_target(Translation *tr, const EmulatorOp *op,
+        const char *target, const KnownA *a) {
+    FILE *out = tr->out;
+    fprintf(out, "        if (%s) {\n", jump_conds[op->jump]);
+    if (op->halts) {
+        fprintf(out, "            pc = %s;\n", target);
+        fprintf(out, "            goto halt;\n");
+    } else if (a->known && (a->value & 0x7fff) < tr->num_words) {
+        fprintf(out, "            goto L%u;\n", a->value & 0x7fff);
+    } else {
+        fprintf(out, "            pc = %s;\n", target);
+        fprintf(out, "            goto dispatch;\n");
+    }
+    fprintf(out, "        }\n");
+}
+
+void write_dispatch(Translation *tr) {
+    FILE *out = tr->out;
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    switch (pc) {\n");
+    for (size_t i = 0; i < tr->num_words; ++i) {
+        if (tr->leaders[i]) {
+            fprintf(out, "        case %zu: goto L%zu;\n", i, i);
+        }
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (pc >= %zu) { // @0 up to the end of ROM\n",
+            tr->num_words);
+    fprintf(out, "        if (cycles + (32768 - pc) > max_cycles) {\n");
+    fprintf(out, "            goto step;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        cycles += 32768 - pc;\n");
+    fprintf(out, "        a = 0;\n");
+    fprintf(out, "        pc = 0;\n");
+    fprintf(out, "        goto dispatch;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    goto step; // inside a block\n");
+}
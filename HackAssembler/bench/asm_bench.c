@@ -0,0 +1,204 @@
+//
+// benchmark of the phases of assembling a file: reading it, splitting it into
+// lines, stripping comments and whitespace, parsing and encoding, resolving
+// the variables and writing the words, over repeated runs. Prints a line of
+// JSON, to track them over time
+//
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../HackAssembler.h"
+#include "../Input.h"
+#include "../Output.h"
+#include "../Stats.h"
+
+// phases of an assembly, that are timed. The assembler is single-pass, with
+// labels defined and backpatched while parsing, so there is no label pass
+typedef enum Phase {
+    PHASE_READ,         // open or map the input
+    PHASE_SPLIT,        // find the lines
+    PHASE_STRIP,        // remove comments and whitespace
+    PHASE_PARSE_ENCODE, // parse, encode, define labels and fixups
+    PHASE_RESOLVE,      // allocate the variables, patch their fixups
+    PHASE_WRITE,        // format the words as text, into /dev/null
+    NUM_PHASES
+} Phase;
+
+// best time of each phase over the runs, in seconds
+typedef struct PhaseTimes {
+    double seconds[NUM_PHASES];
+} PhaseTimes;
+
+// size of the input, and of its assembly
+typedef struct InputStats {
+    size_t bytes;
+    size_t lines;
+    size_t words;
+} InputStats;
+
+
+// constants
+const int default_bench_runs = 5;
+const char *const phase_names[] = {
+    "read", "split", "strip", "parse_encode", "resolve", "write"
+};
+
+
+// assembles in_filename num_runs times, placing the best time of each phase
+// into times, returns false on errors
+bool time_phases(const char *in_filename, int num_runs, PhaseTimes *times,
+        InputStats *stats);
+
+// returns the current time in seconds
+double now_seconds(void);
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+int main(int argc, char *argv[]) {
+    int num_runs = default_bench_runs;
+    const char *workload = NULL;
+    int optchar;
+    while ((optchar = getopt(argc, argv, "hr:w:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                exit(EXIT_SUCCESS);
+            case 'r': // number of runs
+                num_runs = atoi(optarg);
+                break;
+            case 'w': // name of the workload, in the results
+                workload = optarg;
+                break;
+            default:
+                print_help(stderr, argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || num_runs < 1) {
+        print_help(stderr, argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char *in_filename = argv[optind];
+    PhaseTimes times;
+    InputStats stats;
+    if (!time_phases(in_filename, num_runs, &times, &stats)) {
+        return EXIT_FAILURE;
+    }
+    // the strip pass also splits, and the assembly also splits and strips,
+    // so their own cost is the difference
+    double assemble_seconds = times.seconds[PHASE_PARSE_ENCODE];
+    times.seconds[PHASE_PARSE_ENCODE] -= times.seconds[PHASE_STRIP];
+    times.seconds[PHASE_STRIP] -= times.seconds[PHASE_SPLIT];
+    double total_seconds = times.seconds[PHASE_READ] + assemble_seconds
+        + times.seconds[PHASE_RESOLVE] + times.seconds[PHASE_WRITE];
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\"time\": %lld, \"workload\": ", (long long)time(NULL));
+    write_json_string(stdout, workload ? workload : in_filename);
+    printf(", \"runs\": %d, \"bytes\": %zu, \"lines\": %zu, \"words\": %zu, "
+            "\"phases_ms\": {", num_runs, stats.bytes, stats.lines,
+            stats.words);
+    for (int i = 0; i < NUM_PHASES; ++i) {
+        double ms = times.seconds[i] > 0 ? 1e3*times.seconds[i] : 0;
+        printf("%s\"%s\": %.3f", i ? ", " : "", phase_names[i], ms);
+    }
+    printf("}, \"total_ms\": %.3f, \"lines_per_sec\": %.0f, "
+            "\"peak_rss_kb\": %ld}\n", 1e3*total_seconds,
+            stats.lines / total_seconds, usage.ru_maxrss);
+    return 0;
+}
+
+bool time_phases(const char *in_filename, int num_runs, PhaseTimes *times,
+        InputStats *stats) {
+    Assembly *as = new_assembly(NULL);
+    FILE *null_file = fopen("/dev/null", "w");
+    if (!as || !null_file) {
+        fprintf(stderr, "Error: could not start the benchmark\n");
+        return false;
+    }
+    as->error_stream = stderr;
+    for (int i = 0; i < NUM_PHASES; ++i) {
+        times->seconds[i] = -1;
+    }
+    for (int run = 0; run < num_runs; ++run) {
+        double seconds[NUM_PHASES];
+        double start = now_seconds();
+        FILE *in_file = fopen(in_filename, "r");
+        InputBuffer input;
+        if (!in_file || !open_input(in_file, &input)) {
+            fprintf(stderr, "Error: could not open file for reading: %s\n",
+                    in_filename);
+            return false;
+        }
+        seconds[PHASE_READ] = now_seconds() - start;
+
+        start = now_seconds();
+        size_t pos = 0, num_lines = 0;
+        Field line;
+        while (next_line(input.data, input.size, &pos, &line)) {
+            ++num_lines;
+        }
+        seconds[PHASE_SPLIT] = now_seconds() - start;
+
+        start = now_seconds(); // split and strip
+        pos = 0;
+        while (next_line(input.data, input.size, &pos, &line)) {
+            parse_comments_and_whitespace(line, as);
+        }
+        seconds[PHASE_STRIP] = now_seconds() - start;
+
+        reset_assembly(as); // split, strip, parse and encode
+        as->filename = in_filename;
+        start = now_seconds();
+        read_instructions(input.data, input.size, as);
+        seconds[PHASE_PARSE_ENCODE] = now_seconds() - start;
+        if (as->num_errors || as->out_of_memory) {
+            return false;
+        }
+
+        start = now_seconds();
+        resolve_variables(as);
+        seconds[PHASE_RESOLVE] = now_seconds() - start;
+
+        start = now_seconds();
+        if (!write_words(null_file, FORMAT_TEXT, as->words, as->num_words)
+                || fflush(null_file)) {
+            fprintf(stderr, "Error: could not write the words\n");
+            return false;
+        }
+        seconds[PHASE_WRITE] = now_seconds() - start;
+
+        *stats = (InputStats) {input.size, num_lines, as->num_words};
+        close_input(&input);
+        fclose(in_file);
+        for (int i = 0; i < NUM_PHASES; ++i) {
+            if (times->seconds[i] < 0 || seconds[i] < times->seconds[i]) {
+                times->seconds[i] = seconds[i];
+            }
+        }
+    }
+    fclose(null_file);
+    delete_assembly(as);
+    return true;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: [-h] [-r num_runs] [-w workload] in_file.asm\n",
+            exec_name);
+    fprintf(stream, "prints the best time of each phase over num_runs runs, "
+            "as JSON\n");
+}
@@ -0,0 +1,221 @@
+//
+// generator of synthetic Hack assembly workloads for the benchmarks: large
+// programs, heavy in labels, in variables, in long symbol names, or in
+// comments and whitespace, always the same for a given seed
+//
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../Lexer.h"
+
+// state of the pseudo-random generator, xorshift32
+typedef struct Random {
+    uint32_t state;
+} Random;
+
+// kind of program generated
+typedef struct Workload {
+    const char *name;
+    const char *description;
+    void (*write)(FILE *out_file, size_t num_lines, Random *random);
+} Workload;
+
+
+// writes a program of about num_lines lines of each kind of workload
+void write_mixed(FILE *out_file, size_t num_lines, Random *random);
+void write_labels(FILE *out_file, size_t num_lines, Random *random);
+void write_variables(FILE *out_file, size_t num_lines, Random *random);
+void write_long_names(FILE *out_file, size_t num_lines, Random *random);
+void write_comments(FILE *out_file, size_t num_lines, Random *random);
+
+// writes a random C instruction, with no line ending
+void write_random_C(FILE *out_file, Random *random);
+
+// returns the next pseudo-random number, and one below bound
+uint32_t next_random(Random *random);
+uint32_t random_below(Random *random, uint32_t bound);
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+// constants
+const size_t default_gen_lines = 1000000;
+const uint32_t default_seed = 2463534242;
+const size_t label_spacing = 10; // lines per label in the mixed workloads
+const size_t num_mixed_variables = 200;
+const char *const long_name_prefix =
+    "Application.Module.Component.very_long_function_name_of_the_component";
+
+const Workload workloads[] = {
+    {"mixed", "labels, variables, values and C instructions, like real code",
+        write_mixed},
+    {"labels", "a label every third line, jumped to forward and backward",
+        write_labels},
+    {"variables", "a quarter as many variables as lines", write_variables},
+    {"long_names", "the mixed workload, with symbols of about 90 characters",
+        write_long_names},
+    {"comments", "instructions among comments, indentation and blank lines",
+        write_comments},
+};
+const size_t num_workloads = sizeof(workloads)/sizeof(workloads[0]);
+
+int main(int argc, char *argv[]) {
+    size_t num_lines = default_gen_lines;
+    Random random = {default_seed};
+    int optchar;
+    while ((optchar = getopt(argc, argv, "hn:s:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                exit(EXIT_SUCCESS);
+            case 'n': // number of lines
+                num_lines = strtoull(optarg, NULL, 10);
+                break;
+            case 's': // seed, not 0
+                random.state = strtoul(optarg, NULL, 10);
+                random.state = random.state ? random.state : default_seed;
+                break;
+            default:
+                print_help(stderr, argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1) {
+        print_help(stderr, argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < num_workloads; ++i) {
+        if (!strcmp(argv[optind], workloads[i].name)) {
+            workloads[i].write(stdout, num_lines, &random);
+            return fflush(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+    }
+    fprintf(stderr, "Unknown workload: %s\n", argv[optind]);
+    print_help(stderr, argv[0]);
+    return EXIT_FAILURE;
+}
+
+void write_mixed(FILE *out_file, size_t num_lines, Random *random) {
+    uint32_t num_labels = (num_lines + label_spacing - 1) / label_spacing;
+    for (size_t i = 0; i < num_lines; ++i) {
+        if (i % label_spacing == 0) {
+            fprintf(out_file, "(LOOP.%zu)\n", i / label_spacing);
+            continue;
+        }
+        switch (random_below(random, 6)) {
+            case 0:
+                fprintf(out_file, "@%" PRIu32 "\n", random_below(random,
+                            32768));
+                break;
+            case 1: // forward or backward
+                fprintf(out_file, "@LOOP.%" PRIu32 "\n",
+                        random_below(random, num_labels));
+                break;
+            case 2:
+                fprintf(out_file, "@var.%" PRIu32 "\n",
+                        random_below(random, num_mixed_variables));
+                break;
+            default:
+                write_random_C(out_file, random);
+                fputc('\n', out_file);
+        }
+    }
+}
+
+void write_labels(FILE *out_file, size_t num_lines, Random *random) {
+    uint32_t num_labels = (num_lines + 2) / 3;
+    for (size_t i = 0; i < num_lines; i += 3) {
+        fprintf(out_file, "(L.%zu)\n@L.%" PRIu32 "\nD;JNE\n", i / 3,
+                random_below(random, num_labels));
+    }
+}
+
+void write_variables(FILE *out_file, size_t num_lines, Random *random) {
+    uint32_t num_variables = num_lines / 4 + 1;
+    for (size_t i = 0; i < num_lines; i += 2) {
+        fprintf(out_file, "@v.%" PRIu32 "\nM=D+M\n",
+                random_below(random, num_variables));
+    }
+}
+
+void write_long_names(FILE *out_file, size_t num_lines, Random *random) {
+    uint32_t num_labels = (num_lines + label_spacing - 1) / label_spacing;
+    for (size_t i = 0; i < num_lines; ++i) {
+        if (i % label_spacing == 0) {
+            fprintf(out_file, "(%s$loop.%zu)\n", long_name_prefix,
+                    i / label_spacing);
+        } else if (i % 3 == 1) {
+            fprintf(out_file, "@%s$loop.%" PRIu32 "\n", long_name_prefix,
+                    random_below(random, num_labels));
+        } else if (i % 3 == 2) {
+            fprintf(out_file, "@%s.field_%" PRIu32 "\n", long_name_prefix,
+                    random_below(random, num_mixed_variables));
+        } else {
+            write_random_C(out_file, random);
+            fputc('\n', out_file);
+        }
+    }
+}
+
+void write_comments(FILE *out_file, size_t num_lines, Random *random) {
+    uint32_t num_labels = num_lines >= 10 ? num_lines / 5 : 1;
+    for (size_t i = 0; i < num_lines; ++i) {
+        switch (i % 5) {
+            case 0:
+                fprintf(out_file, "// block %zu: loads the next value, and "
+                        "adds it to the running total\n", i);
+                break;
+            case 1:
+                fputs("\n", out_file);
+                break;
+            case 2:
+                fprintf(out_file, "  (LOOP.%zu)   // top of the loop\n",
+                        i / 5);
+                break;
+            case 3:
+                fprintf(out_file, "\t@LOOP.%" PRIu32 "  \t// jump target\n",
+                        random_below(random, num_labels));
+                break;
+            default:
+                fputs("        ", out_file);
+                write_random_C(out_file, random);
+                fputs("    // computes the next value   \n", out_file);
+        }
+    }
+}
+
+void write_random_C(FILE *out_file, Random *random) {
+    uint32_t dest = random_below(random, 8);
+    uint32_t comp = random_below(random, 28);
+    uint32_t jump = random_below(random, 4) ? 0 : random_below(random, 8);
+    fprintf(out_file, "%s%s%s%s%s", dest_mnemonics[dest], dest ? "=" : "",
+            comp_mnemonics[comp], jump ? ";" : "", jump_mnemonics[jump]);
+}
+
+uint32_t next_random(Random *random) {
+    uint32_t x = random->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return random->state = x;
+}
+
+uint32_t random_below(Random *random, uint32_t bound) {
+    return next_random(random) % bound;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: [-h] [-n num_lines] [-s seed] workload\n",
+            exec_name);
+    fprintf(stream, "writes a program of num_lines lines to the standard "
+            "output, one of:\n");
+    for (size_t i = 0; i < num_workloads; ++i) {
+        fprintf(stream, "  %-10s %s\n", workloads[i].name,
+                workloads[i].description);
+    }
+}
@@ -0,0 +1,204 @@
+//
+// benchmark of the latency of assembling a small file: a fresh assembler
+// process per job, against jobs sent to a running server, from a client
+// process per job, and over a connection kept open by the caller
+//
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../Input.h"
+#include "../Server.h"
+
+// constants
+const char *const assembler_path = "./main";
+const int default_num_jobs = 200;
+const int num_small_lines = 200; // of the generated input
+const int connect_attempts = 100;
+
+// latencies of a series of jobs, in microseconds
+typedef struct Latencies {
+    double *us;
+    int num_jobs;
+} Latencies;
+
+
+// writes a small program, like the ones assembled on every keystroke, to a
+// temporary file, returns its name
+char *write_small_input(void);
+
+// returns the current time in microseconds
+double now_us(void);
+
+// runs the command, waiting for it, returns false if it failed
+bool run_command(char *const argv[]);
+
+// starts a server on socket_path, returns its process id once it accepts
+// connections, or -1
+pid_t start_server(const char *socket_path);
+
+// times num_jobs runs of the assembler command
+Latencies time_processes(char *const argv[], int num_jobs);
+
+// times num_jobs jobs sent to the server over a single connection
+Latencies time_connection(const char *socket_path, const char *in_filename,
+        int num_jobs);
+
+// prints the median and the 99th percentile of the latencies
+void print_latencies(const char *name, Latencies *latencies);
+
+// orders latencies, for qsort
+int compare_doubles(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+    char *in_filename = argc > 1 ? argv[1] : write_small_input();
+    int num_jobs = argc > 2 ? atoi(argv[2]) : default_num_jobs;
+    char socket_path[] = "/tmp/hackasm_bench.XXXXXX";
+    int tmp_fd = mkstemp(socket_path); // a unique name, for the socket
+    if (tmp_fd < 0) {
+        perror("Error: mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(tmp_fd);
+    unlink(socket_path);
+    char out_filename[] = "/tmp/hackasm_bench_out.hack";
+
+    char *fresh_argv[] = {(char *)assembler_path, "-j", "1", "-o",
+        out_filename, in_filename, NULL};
+    Latencies fresh = time_processes(fresh_argv, num_jobs);
+
+    pid_t server = start_server(socket_path);
+    if (server < 0) {
+        fprintf(stderr, "Error: could not start the server\n");
+        return EXIT_FAILURE;
+    }
+    char *client_argv[] = {(char *)assembler_path, "-j", "1", "-C",
+        socket_path, "-o", out_filename, in_filename, NULL};
+    Latencies client = time_processes(client_argv, num_jobs);
+    Latencies connection = time_connection(socket_path, in_filename,
+            num_jobs);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(socket_path);
+    unlink(out_filename);
+    if (argc <= 1) {
+        unlink(in_filename);
+    }
+
+    printf("jobs: %d\n", num_jobs);
+    print_latencies("fresh process", &fresh);
+    print_latencies("client process", &client);
+    print_latencies("open connection", &connection);
+    return 0;
+}
+
+char *write_small_input(void) {
+    static char in_filename[] = "/tmp/hackasm_bench_in.XXXXXX";
+    int fd = mkstemp(in_filename);
+    FILE *in_file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!in_file) {
+        perror("Error: could not write input");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_small_lines; i += 4) {
+        fprintf(in_file, "(LOOP%d)\n@i\nD=M\n@LOOP%d\nD;JGT\n", i, i);
+    }
+    fclose(in_file);
+    return in_filename;
+}
+
+double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+bool run_command(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid
+        && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+pid_t start_server(const char *socket_path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(assembler_path, assembler_path, "-S", socket_path, "-j", "1",
+                (char *)NULL);
+        _exit(127);
+    }
+    for (int i = 0; pid > 0 && i < connect_attempts; ++i) {
+        int fd = connect_server(socket_path);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+Latencies time_processes(char *const argv[], int num_jobs) {
+    Latencies latencies = {malloc(num_jobs*sizeof(double)), num_jobs};
+    for (int i = 0; i < num_jobs; ++i) {
+        double start = now_us();
+        if (!run_command(argv)) {
+            fprintf(stderr, "Error: %s failed\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        latencies.us[i] = now_us() - start;
+    }
+    return latencies;
+}
+
+Latencies time_connection(const char *socket_path, const char *in_filename,
+        int num_jobs) {
+    Latencies latencies = {malloc(num_jobs*sizeof(double)), num_jobs};
+    int fd = connect_server(socket_path);
+    FILE *in_file = fopen(in_filename, "r");
+    InputBuffer input;
+    if (fd < 0 || !in_file || !open_input(in_file, &input)) {
+        fprintf(stderr, "Error: could not send jobs\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(in_file);
+    JobRequest request = {.kind = JOB_SOURCE, .format = FORMAT_TEXT,
+        .name_size = strlen(in_filename), .data_size = input.size};
+    for (int i = 0; i < num_jobs; ++i) {
+        double start = now_us();
+        JobResponse response;
+        char *payload;
+        if (!request_job(fd, &request, in_filename, input.data, &response,
+                    &payload) || response.num_errors > 0) {
+            fprintf(stderr, "Error: job failed\n");
+            exit(EXIT_FAILURE);
+        }
+        free(payload);
+        latencies.us[i] = now_us() - start;
+    }
+    close_input(&input);
+    close(fd);
+    return latencies;
+}
+
+void print_latencies(const char *name, Latencies *latencies) {
+    qsort(latencies->us, latencies->num_jobs, sizeof(double),
+            compare_doubles);
+    printf("%-16s median %8.1f us, p99 %8.1f us\n", name,
+            latencies->us[latencies->num_jobs/2],
+            latencies->us[latencies->num_jobs*99/100]);
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
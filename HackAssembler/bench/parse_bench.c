@@ -0,0 +1,278 @@
+//
+// benchmark of the per-line parse cost of the Hack assembler: the former
+// sscanf/strcmp-chain parser against the lexer, over the same lines
+//
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../HackAssembler.h"
+#include "../Input.h"
+#include "../Lexer.h"
+
+// constants
+const size_t line_size = 128; // maximum line length = 126 + '\n' + '\0'
+const size_t default_num_lines = 2000000;
+const int num_runs = 5;
+
+// lines to parse, stripped of comments and whitespace
+typedef struct Lines {
+    char **lines;
+    size_t *lens;
+    size_t num_lines;
+} Lines;
+
+
+// appends a copy of the instruction to lines, growing them if needed
+void add_line(Lines *lines, const char *asm_instr, size_t *capacity);
+
+// generates num_lines instructions, cycling through every dest, comp and jump
+// mnemonic and mixing in A instructions with values and symbols
+Lines generate_lines(size_t num_lines);
+
+// reads the instructions of the file in_filename
+Lines read_lines(const char *in_filename);
+
+// the parser before the lexer, kept as the baseline of the comparison
+void legacy_parse_C_instruction(const char *asm_instr, int line_num,
+        CompToken *comp, DestToken *dest, JumpToken *jump);
+
+// signals an error in the legacy parser, aborts program execution
+void legacy_parse_error(int line_num, const char *error_msg,
+        const char *error_val);
+
+// parses every line with the legacy parser, returns a checksum of the tokens
+uint32_t parse_legacy(const Lines *lines);
+
+// parses every line with the lexer, returns a checksum of the tokens
+uint32_t parse_lexer(const Lines *lines);
+
+// returns the best time of num_runs runs of parse, in nanoseconds per line
+double time_parser(uint32_t (*parse)(const Lines *), const Lines *lines,
+        uint32_t *checksum);
+
+int main(int argc, char *argv[]) {
+    Lines lines = argc > 1 ? read_lines(argv[1])
+                           : generate_lines(default_num_lines);
+    uint32_t legacy_checksum, lexer_checksum;
+    double legacy_ns = time_parser(parse_legacy, &lines, &legacy_checksum);
+    double lexer_ns = time_parser(parse_lexer, &lines, &lexer_checksum);
+    if (legacy_checksum != lexer_checksum) {
+        fprintf(stderr, "Error: parsers disagree on the tokens\n");
+        return EXIT_FAILURE;
+    }
+    printf("lines:  %zu\n", lines.num_lines);
+    printf("legacy: %6.1f ns/line\n", legacy_ns);
+    printf("lexer:  %6.1f ns/line\n", lexer_ns);
+    printf("speedup: %.1fx\n", legacy_ns / lexer_ns);
+    return 0;
+}
+
+void add_line(Lines *lines, const char *asm_instr, size_t *capacity) {
+    if (lines->num_lines == *capacity) {
+        *capacity = *capacity ? 2*(*capacity) : 1024;
+        lines->lines = realloc(lines->lines, *capacity*sizeof(*lines->lines));
+        lines->lens = realloc(lines->lens, *capacity*sizeof(*lines->lens));
+    }
+    lines->lens[lines->num_lines] = strlen(asm_instr);
+    lines->lines[lines->num_lines++] = strdup(asm_instr);
+}
+
+Lines generate_lines(size_t num_lines) {
+    const char *dests[] = {"", "M", "D", "MD", "A", "AM", "AD", "AMD"};
+    const char *comps[] = {
+        "0", "1", "-1", "D", "A", "M", "!D", "!A", "!M", "-D", "-A", "-M",
+        "D+1", "A+1", "M+1", "D-1", "A-1", "M-1", "D+A", "D+M",
+        "D-A", "D-M", "A-D", "M-D", "D&A", "D&M", "D|A", "D|M"};
+    const char *jumps[] = {"", "JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP"};
+    Lines lines = {0};
+    size_t capacity = 0;
+    char asm_instr[line_size];
+    for (size_t i = 0; i < num_lines; ++i) {
+        if (i % 3 == 0) { // one in three lines is an A instruction
+            if (i % 2) {
+                sprintf(asm_instr, "@%zu", i % 32768);
+            } else {
+                sprintf(asm_instr, "@symbol.%zu", i % 1000);
+            }
+        } else {
+            const char *dest = dests[i % 8];
+            const char *comp = comps[i % 28];
+            const char *jump = jumps[(i / 8) % 8];
+            sprintf(asm_instr, "%s%s%s%s%s", dest, *dest ? "=" : "", comp,
+                    *jump ? ";" : "", jump);
+        }
+        add_line(&lines, asm_instr, &capacity);
+    }
+    return lines;
+}
+
+Lines read_lines(const char *in_filename) {
+    FILE *in_file = fopen(in_filename, "r");
+    InputBuffer input;
+    if (!in_file || !open_input(in_file, &input)) {
+        fprintf(stderr, "Error: could not open file for reading: %s\n",
+                in_filename);
+        exit(EXIT_FAILURE);
+    }
+    Lines lines = {0};
+    size_t capacity = 0;
+    Assembly *as = new_assembly(NULL); // only holds the scratch buffer
+    char asm_instr[line_size];
+    size_t pos = 0;
+    Field line;
+    while (next_line(input.data, input.size, &pos, &line)) {
+        line = parse_comments_and_whitespace(line, as);
+        if (line.len > 0 && line.len < line_size && line.str[0] != '(') {
+            memcpy(asm_instr, line.str, line.len);
+            asm_instr[line.len] = '\0';
+            add_line(&lines, asm_instr, &capacity);
+        }
+    }
+    delete_assembly(as);
+    close_input(&input);
+    fclose(in_file);
+    return lines;
+}
+
+uint32_t parse_legacy(const Lines *lines) {
+    uint32_t checksum = 0;
+    char key[line_size];
+    for (size_t i = 0; i < lines->num_lines; ++i) {
+        const char *asm_instr = lines->lines[i];
+        if (asm_instr[0] == '@') {
+            uint16_t value;
+            if (1 == sscanf(asm_instr, "@%" SCNu16, &value)) {
+                checksum += value;
+            } else if (1 == sscanf(asm_instr, "@%s", key)) {
+                checksum += key[0];
+            }
+        } else {
+            CompToken comp;
+            DestToken dest;
+            JumpToken jump;
+            legacy_parse_C_instruction(asm_instr, i+1, &comp, &dest, &jump);
+            checksum += comp << 6 | dest << 3 | jump;
+        }
+    }
+    return checksum;
+}
+
+uint32_t parse_lexer(const Lines *lines) {
+    Assembly *as = new_assembly(NULL); // only collects errors
+    as->error_stream = stderr;
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < lines->num_lines; ++i) {
+        const char *asm_instr = lines->lines[i];
+        size_t len = lines->lens[i];
+        if (asm_instr[0] == '@') {
+            uint16_t value;
+            if (lex_value((Field) {asm_instr+1, len-1}, &value)) {
+                checksum += value;
+            } else {
+                checksum += asm_instr[1];
+            }
+        } else {
+            CompToken comp;
+            DestToken dest;
+            JumpToken jump;
+            parse_C_instruction(asm_instr, len, i+1, &comp, &dest, &jump, as);
+            checksum += comp << 6 | dest << 3 | jump;
+        }
+    }
+    delete_assembly(as);
+    return checksum;
+}
+
+double time_parser(uint32_t (*parse)(const Lines *), const Lines *lines,
+        uint32_t *checksum) {
+    double best_ns = 0;
+    for (int run = 0; run < num_runs; ++run) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        *checksum = parse(lines);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ns = (end.tv_sec - start.tv_sec)*1e9
+                  + (end.tv_nsec - start.tv_nsec);
+        if (run == 0 || ns < best_ns) {
+            best_ns = ns;
+        }
+    }
+    return best_ns / lines->num_lines;
+}
+
+void legacy_parse_C_instruction(const char *asm_instr, int line_num,
+        CompToken *comp, DestToken *dest, JumpToken *jump) {
+    char dest_str[line_size];
+    char comp_str[line_size];
+    char jump_str[line_size];
+    if (3 == sscanf(asm_instr, "%[^=]=%[^;];%s", dest_str, comp_str, jump_str)) {
+    } else if (2 == sscanf(asm_instr, "%[^;];%s", comp_str, jump_str)) {
+        *dest_str = '\0';
+    } else if (2 == sscanf(asm_instr, "%[^=]=%s", dest_str, comp_str)) {
+        *jump_str = '\0';
+    } else {
+        strcpy(comp_str, asm_instr);
+        *dest_str = '\0';
+        *jump_str = '\0';
+    }
+    if      (!strcmp(dest_str, ""))    *dest = DEST_NULL;
+    else if (!strcmp(dest_str, "M"))   *dest = DEST_M;
+    else if (!strcmp(dest_str, "D"))   *dest = DEST_D;
+    else if (!strcmp(dest_str, "MD"))  *dest = DEST_MD;
+    else if (!strcmp(dest_str, "A"))   *dest = DEST_A;
+    else if (!strcmp(dest_str, "AM"))  *dest = DEST_AM;
+    else if (!strcmp(dest_str, "AD"))  *dest = DEST_AD;
+    else if (!strcmp(dest_str, "AMD")) *dest = DEST_AMD;
+    else legacy_parse_error(line_num, "unknown dest token", dest_str);
+
+    if      (!strcmp(comp_str, "0"))   *comp = COMP_0;
+    else if (!strcmp(comp_str, "1"))   *comp = COMP_1;
+    else if (!strcmp(comp_str, "-1"))  *comp = COMP_NEG_1;
+    else if (!strcmp(comp_str, "D"))   *comp = COMP_D;
+    else if (!strcmp(comp_str, "A"))   *comp = COMP_A;
+    else if (!strcmp(comp_str, "M"))   *comp = COMP_M;
+    else if (!strcmp(comp_str, "!D"))  *comp = COMP_NOT_D;
+    else if (!strcmp(comp_str, "!A"))  *comp = COMP_NOT_A;
+    else if (!strcmp(comp_str, "!M"))  *comp = COMP_NOT_M;
+    else if (!strcmp(comp_str, "-D"))  *comp = COMP_NEG_D;
+    else if (!strcmp(comp_str, "-A"))  *comp = COMP_NEG_A;
+    else if (!strcmp(comp_str, "-M"))  *comp = COMP_NEG_M;
+    else if (!strcmp(comp_str, "D+1")) *comp = COMP_D_PLUS_1;
+    else if (!strcmp(comp_str, "A+1")) *comp = COMP_A_PLUS_1;
+    else if (!strcmp(comp_str, "M+1")) *comp = COMP_M_PLUS_1;
+    else if (!strcmp(comp_str, "D-1")) *comp = COMP_D_MINUS_1;
+    else if (!strcmp(comp_str, "A-1")) *comp = COMP_A_MINUS_1;
+    else if (!strcmp(comp_str, "M-1")) *comp = COMP_M_MINUS_1;
+    else if (!strcmp(comp_str, "D+A")) *comp = COMP_D_PLUS_A;
+    else if (!strcmp(comp_str, "D+M")) *comp = COMP_D_PLUS_M;
+    else if (!strcmp(comp_str, "D-A")) *comp = COMP_D_MINUS_A;
+    else if (!strcmp(comp_str, "D-M")) *comp = COMP_D_MINUS_M;
+    else if (!strcmp(comp_str, "A-D")) *comp = COMP_A_MINUS_D;
+    else if (!strcmp(comp_str, "M-D")) *comp = COMP_M_MINUS_D;
+    else if (!strcmp(comp_str, "D&A")) *comp = COMP_D_AND_A;
+    else if (!strcmp(comp_str, "D&M")) *comp = COMP_D_AND_M;
+    else if (!strcmp(comp_str, "D|A")) *comp = COMP_D_OR_A;
+    else if (!strcmp(comp_str, "D|M")) *comp = COMP_D_OR_M;
+    else legacy_parse_error(line_num, "unknown comp token", comp_str);
+
+    if      (!strcmp(jump_str, ""))    *jump = JUMP_NULL;
+    else if (!strcmp(jump_str, "JGT")) *jump = JUMP_JGT;
+    else if (!strcmp(jump_str, "JEQ")) *jump = JUMP_JEQ;
+    else if (!strcmp(jump_str, "JGE")) *jump = JUMP_JGE;
+    else if (!strcmp(jump_str, "JLT")) *jump = JUMP_JLT;
+    else if (!strcmp(jump_str, "JNE")) *jump = JUMP_JNE;
+    else if (!strcmp(jump_str, "JLE")) *jump = JUMP_JLE;
+    else if (!strcmp(jump_str, "JMP")) *jump = JUMP_JMP;
+    else legacy_parse_error(line_num, "unknown jump token", jump_str);
+}
+
+void legacy_parse_error(int line_num, const char *error_msg,
+        const char *error_val) {
+    fprintf(stderr, "Error: parsing line %d: %s: %s\n",
+            line_num, error_msg, error_val);
+    exit(EXIT_FAILURE);
+}
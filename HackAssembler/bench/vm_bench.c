@@ -0,0 +1,227 @@
+//
+// benchmark of the code of the VM translator: the size and running time of
+// programs translated by the plain back end, against the optimizing one, run
+// on the emulator, that must leave the same values in RAM
+//
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../CodeWriter.h"
+#include "../Emulator.h"
+#include "../HackAssembler.h"
+
+// VM program of the benchmark, with a Sys.init that ends in a loop
+typedef struct VMProgram {
+    const char *name;
+    const char *code;
+} VMProgram;
+
+// size and running time of a translated program
+typedef struct VMRun {
+    size_t num_words;
+    uint64_t cycles;
+} VMRun;
+
+
+// constants
+const uint64_t max_bench_cycles = 100000000;
+
+// RAM ranges compared between the back ends: registers but R13-R15, which
+// the translated code uses as scratch, statics, and the heap. The stack holds
+// return addresses, that differ
+const size_t compared_ranges[][2] = {{0, 13}, {16, 256}, {2048, 4096}};
+const size_t num_compared_ranges = 3;
+
+const VMProgram vm_programs[] = {
+    {"fibonacci",
+        "function Sys.init 0\n"
+        "push constant 20\ncall Main.fib 1\npop static 0\n"
+        "label halt\ngoto halt\n"
+        "function Main.fib 0\n"
+        "push argument 0\npush constant 2\nlt\nif-goto base\n"
+        "push argument 0\npush constant 2\nsub\ncall Main.fib 1\n"
+        "push argument 0\npush constant 1\nsub\ncall Main.fib 1\n"
+        "add\nreturn\n"
+        "label base\npush argument 0\nreturn\n"},
+    {"sum loop",
+        "function Sys.init 2\n"
+        "push constant 0\npop local 0\npush constant 30000\npop local 1\n"
+        "label loop\n"
+        "push local 0\npush local 1\nadd\npop local 0\n"
+        "push local 1\npush constant 1\nsub\npop local 1\n"
+        "push local 1\npush constant 0\ngt\nif-goto loop\n"
+        "push local 0\npop static 0\n"
+        "label halt\ngoto halt\n"},
+    {"bubble sort",
+        "function Sys.init 0\n"
+        "push constant 120\ncall Main.fill 1\npop temp 0\n"
+        "push constant 120\ncall Main.sort 1\npop temp 0\n"
+        "label halt\ngoto halt\n"
+        "function Main.fill 2\n" // x = (5x + 13) & 1023 into 2048 + i
+        "push constant 0\npop local 0\npush constant 17\npop local 1\n"
+        "label loop\n"
+        "push local 1\npush local 1\nadd\npush local 1\nadd\n"
+        "push local 1\nadd\npush local 1\nadd\n"
+        "push constant 13\nadd\npush constant 1023\nand\npop local 1\n"
+        "push constant 2048\npush local 0\nadd\npop pointer 1\n"
+        "push local 1\npop that 0\n"
+        "push local 0\npush constant 1\nadd\npop local 0\n"
+        "push local 0\npush argument 0\nlt\nif-goto loop\n"
+        "push constant 0\nreturn\n"
+        "function Main.sort 3\n"
+        "push argument 0\npush constant 1\nsub\npop local 0\n"
+        "label outer\n"
+        "push constant 0\npop local 1\n"
+        "label inner\n"
+        "push constant 2048\npush local 1\nadd\npop pointer 1\n"
+        "push that 0\npush that 1\ngt\nnot\nif-goto noswap\n"
+        "push that 0\npop local 2\npush that 1\npop that 0\n"
+        "push local 2\npop that 1\n"
+        "label noswap\n"
+        "push local 1\npush constant 1\nadd\npop local 1\n"
+        "push local 1\npush local 0\nlt\nif-goto inner\n"
+        "push local 0\npush constant 1\nsub\npop local 0\n"
+        "push local 0\npush constant 0\ngt\nif-goto outer\n"
+        "push constant 0\nreturn\n"},
+    {"multiply",
+        "function Sys.init 2\n" // sum of the squares of 1 to 300
+        "push constant 0\npop local 0\npush constant 300\npop local 1\n"
+        "label loop\n"
+        "push local 0\npush local 1\npush local 1\ncall Main.mult 2\n"
+        "add\npop local 0\n"
+        "push local 1\npush constant 1\nsub\npop local 1\n"
+        "push local 1\nif-goto loop\n"
+        "push local 0\npop static 0\n"
+        "label halt\ngoto halt\n"
+        "function Main.mult 3\n" // shift and add, over the 16 bits
+        "push constant 0\npop local 0\npush constant 1\npop local 1\n"
+        "push argument 0\npop local 2\n"
+        "label loop\n"
+        "push argument 1\npush local 1\nand\npush constant 0\neq\n"
+        "if-goto skip\n"
+        "push local 0\npush local 2\nadd\npop local 0\n"
+        "label skip\n"
+        "push local 2\npush local 2\nadd\npop local 2\n"
+        "push local 1\npush local 1\nadd\npop local 1\n"
+        "push local 1\npush constant 0\neq\nnot\nif-goto loop\n"
+        "push local 0\nreturn\n"},
+    {"gcd",
+        "function Sys.init 2\n" // sum of gcd(3i, 360) for i from 1 to 200
+        "push constant 0\npop local 0\npush constant 200\npop local 1\n"
+        "label loop\n"
+        "push local 0\n"
+        "push local 1\npush local 1\nadd\npush local 1\nadd\n"
+        "push constant 360\ncall Main.gcd 2\nadd\npop local 0\n"
+        "push local 1\npush constant 1\nsub\npop local 1\n"
+        "push local 1\npush constant 0\ngt\nif-goto loop\n"
+        "push local 0\npop static 0\n"
+        "label halt\ngoto halt\n"
+        "function Main.gcd 0\n" // by subtraction
+        "label loop\n"
+        "push argument 0\npush argument 1\neq\nif-goto done\n"
+        "push argument 0\npush argument 1\ngt\nif-goto greater\n"
+        "push argument 1\npush argument 0\nsub\npop argument 1\n"
+        "goto loop\n"
+        "label greater\n"
+        "push argument 0\npush argument 1\nsub\npop argument 0\n"
+        "goto loop\n"
+        "label done\npush argument 0\nreturn\n"},
+};
+const size_t num_vm_programs = sizeof(vm_programs)/sizeof(vm_programs[0]);
+
+
+// translates the program with the back end selected by optimize, and runs it
+// on the emulator until it halts, returns false on errors
+bool run_vm_program(const VMProgram *program, bool optimize, Emulator *em,
+        VMRun *run);
+
+// returns whether the compared RAM ranges of the emulators are equal
+bool same_results(const Emulator *a, const Emulator *b);
+
+int main(void) {
+    Emulator *plain_em = new_emulator(NULL);
+    Emulator *optimized_em = new_emulator(NULL);
+    if (!plain_em || !optimized_em) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-12s %16s %22s\n", "program", "words", "cycles");
+    size_t plain_words = 0, optimized_words = 0;
+    uint64_t plain_cycles = 0, optimized_cycles = 0;
+    for (size_t i = 0; i < num_vm_programs; ++i) {
+        VMRun plain, optimized;
+        if (!run_vm_program(&vm_programs[i], false, plain_em, &plain)
+                || !run_vm_program(&vm_programs[i], true, optimized_em,
+                    &optimized)) {
+            return EXIT_FAILURE;
+        }
+        if (!same_results(plain_em, optimized_em)) {
+            fprintf(stderr, "Error: back ends disagree on %s\n",
+                    vm_programs[i].name);
+            return EXIT_FAILURE;
+        }
+        printf("%-12s %6zu -> %6zu %9" PRIu64 " -> %9" PRIu64 "\n",
+                vm_programs[i].name, plain.num_words, optimized.num_words,
+                plain.cycles, optimized.cycles);
+        plain_words += plain.num_words;
+        optimized_words += optimized.num_words;
+        plain_cycles += plain.cycles;
+        optimized_cycles += optimized.cycles;
+    }
+    printf("size:   %.1f%% of the plain code\n",
+            100.0*optimized_words/plain_words);
+    printf("cycles: %.1f%% of the plain code\n",
+            100.0*optimized_cycles/plain_cycles);
+    delete_emulator(plain_em);
+    delete_emulator(optimized_em);
+    return 0;
+}
+
+bool run_vm_program(const VMProgram *program, bool optimize, Emulator *em,
+        VMRun *run) {
+    Assembly *as = new_assembly(NULL);
+    CodeWriter cw;
+    if (!as || !init_code_writer(&cw, as, NULL)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    as->error_stream = stderr;
+    cw.optimize = optimize;
+    write_init(&cw);
+    bool success = translate_buffer(&cw, program->code, strlen(program->code),
+            "Sys.vm");
+    success = write_end(&cw) && success;
+    if (success) {
+        resolve_variables(as);
+        success = load_program(em, as->words, as->num_words);
+    }
+    run->num_words = as->num_words;
+    free_code_writer(&cw);
+    delete_assembly(as);
+    if (!success) {
+        fprintf(stderr, "Error: could not translate %s\n", program->name);
+        return false;
+    }
+    if (run_emulator(em, max_bench_cycles) != HALT_LOOP) {
+        fprintf(stderr, "Error: %s did not halt\n", program->name);
+        return false;
+    }
+    run->cycles = em->cycles;
+    return true;
+}
+
+bool same_results(const Emulator *a, const Emulator *b) {
+    for (size_t i = 0; i < num_compared_ranges; ++i) {
+        size_t start = compared_ranges[i][0], end = compared_ranges[i][1];
+        if (memcmp(a->ram + start, b->ram + start,
+                    (end - start)*sizeof(*a->ram))) {
+            return false;
+        }
+    }
+    return true;
+}
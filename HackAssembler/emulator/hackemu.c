@@ -0,0 +1,362 @@
+//
+// emulator for the Hack computer: runs a .hack program, or a .asm program
+// assembled in memory, until it halts in a tight loop or reaches a cycle
+// limit, then reports its speed and dumps ranges of its RAM. With -n or -i,
+// runs a batch of instances of the program in lockstep, each from its own
+// RAM image
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../BatchEmulator.h"
+#include "../Emulator.h"
+
+// range of RAM addresses to dump, inclusive
+typedef struct RamRange {
+    unsigned long first;
+    unsigned long last;
+} RamRange;
+
+// RAM word to set before running
+typedef struct RamValue {
+    unsigned long addr;
+    long value;
+} RamValue;
+
+// RAM words to set before running an instance of a batch, a line of an
+// images file
+typedef struct RamImage {
+    RamValue *values;
+    size_t num_values;
+} RamImage;
+
+// program options struct
+typedef struct {
+    const char *in_filename;
+    unsigned long long max_cycles; // 0 for no limit
+    RamRange *dumps;
+    size_t num_dumps;
+    RamValue *presets;
+    size_t num_presets;
+    size_t num_instances;        // of a batch, 0 for its number of images
+    const char *images_filename; // RAM image of each instance of a batch
+    long num_threads;            // running the batch
+} Options;
+
+
+// parses command line arguments, exits on errors
+Options parse_args(int argc, char *argv[]);
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+// parses a RAM range, first:last or a single address, returns false on errors
+bool parse_range(const char *arg, RamRange *range);
+
+// parses a RAM preset, addr=value, returns false on errors
+bool parse_preset(const char *arg, RamValue *preset);
+
+// returns the monotonic time in seconds
+double now_s(void);
+
+// runs the program as a batch of instances, and reports the state of each,
+// returns the exit status
+int run_batch_mode(const Options *opts, const uint16_t *words,
+        size_t num_words);
+
+// reads the RAM images of filename, one per non-empty line of addr=value
+// words separated by spaces, returns false and signals an error on failure
+bool read_images(const char *filename, RamImage **images, size_t *num_images);
+
+// frees the num_images RAM images, and their array
+void free_images(RamImage *images, size_t num_images);
+
+int main(int argc, char *argv[]) {
+    Options opts = parse_args(argc, argv);
+    uint16_t *words = malloc(rom_size*sizeof(*words));
+    size_t num_words;
+    Emulator *em = new_emulator(NULL);
+    if (!words || !em) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    if (!read_program(opts.in_filename, words, &num_words, stderr)) {
+        return EXIT_FAILURE;
+    }
+    if (opts.num_instances > 0 || opts.images_filename) {
+        delete_emulator(em);
+        int status = run_batch_mode(&opts, words, num_words);
+        free(words);
+        return status;
+    }
+    load_program(em, words, num_words);
+    for (size_t i = 0; i < opts.num_presets; ++i) {
+        em->ram[opts.presets[i].addr] = opts.presets[i].value;
+    }
+
+    double start = now_s();
+    HaltReason reason = run_emulator(em, opts.max_cycles);
+    double elapsed = now_s() - start;
+    fprintf(stderr, "%s after %llu instructions, pc %u, in %.3f s, "
+            "%.1f M instructions/s\n",
+            reason == HALT_LOOP ? "halted" : "reached cycle limit",
+            (unsigned long long)em->cycles, em->pc, elapsed,
+            elapsed > 0 ? em->cycles / elapsed / 1e6 : 0.0);
+    for (size_t i = 0; i < opts.num_dumps; ++i) {
+        for (unsigned long addr = opts.dumps[i].first;
+                addr <= opts.dumps[i].last; ++addr) {
+            printf("RAM[%lu] = %d\n", addr, (int16_t)em->ram[addr]);
+        }
+    }
+    delete_emulator(em);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
+Options parse_args(int argc, char *argv[]) {
+    Options opts = {.num_threads = sysconf(_SC_NPROCESSORS_ONLN)};
+    bool args_error = false;
+    int optchar;
+    char *end; // of a number
+    while ((optchar = getopt(argc, argv, "hc:d:s:n:i:j:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                exit(EXIT_SUCCESS);
+            case 'c': // specify cycle limit
+                opts.max_cycles = strtoull(optarg, NULL, 10);
+                break;
+            case 'd': // dump a RAM range when halted
+                opts.dumps = realloc(opts.dumps,
+                        (opts.num_dumps + 1)*sizeof(*opts.dumps));
+                if (!parse_range(optarg, &opts.dumps[opts.num_dumps++])) {
+                    fprintf(stderr, "Invalid RAM range: %s\n", optarg);
+                    args_error = true;
+                }
+                break;
+            case 's': // set a RAM word before running
+                opts.presets = realloc(opts.presets,
+                        (opts.num_presets + 1)*sizeof(*opts.presets));
+                if (!parse_preset(optarg, &opts.presets[opts.num_presets++])) {
+                    fprintf(stderr, "Invalid RAM value: %s\n", optarg);
+                    args_error = true;
+                }
+                break;
+            case 'n': // run a batch of instances
+                opts.num_instances = strtoul(optarg, &end, 10);
+                if (end == optarg || *end != '\0'
+                        || opts.num_instances < 1) {
+                    fprintf(stderr, "Invalid number of instances: %s\n",
+                            optarg);
+                    args_error = true;
+                }
+                break;
+            case 'i': // RAM images of the instances of a batch
+                opts.images_filename = optarg;
+                break;
+            case 'j': // threads running the batch
+                opts.num_threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || opts.num_threads < 1) {
+                    fprintf(stderr, "Invalid number of threads: %s\n",
+                            optarg);
+                    args_error = true;
+                }
+                break;
+            default:
+                args_error = true;
+        }
+    }
+    if (args_error || optind != argc - 1) {
+        print_help(stderr, argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    opts.in_filename = argv[optind];
+    if (opts.num_threads < 1) { // number of processors unknown
+        opts.num_threads = 1;
+    }
+    return opts;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: ", exec_name);
+    fprintf(stream, "[-h] [-c max_cycles] [-d first[:last]]... "
+            "[-s addr=value]...\n       [-n num_instances] [-i images_file] "
+            "[-j num_threads] in_file\n");
+    fprintf(stream, "-n and -i run a batch of instances in lockstep, one "
+            "per line of addr=value words\nof images_file, repeated up to "
+            "num_instances, after the -s values\n");
+}
+
+bool parse_range(const char *arg, RamRange *range) {
+    char *end;
+    range->first = strtoul(arg, &end, 10);
+    range->last = range->first;
+    if (end != arg && *end == ':') {
+        const char *last = end + 1;
+        range->last = strtoul(last, &end, 10);
+        if (end == last) {
+            return false;
+        }
+    }
+    return end != arg && *end == '\0' && range->first <= range->last
+        && range->last < ram_size;
+}
+
+bool parse_preset(const char *arg, RamValue *preset) {
+    char *end;
+    preset->addr = strtoul(arg, &end, 10);
+    if (end == arg || *end != '=' || preset->addr >= ram_size) {
+        return false;
+    }
+    const char *value = end + 1;
+    preset->value = strtol(value, &end, 10);
+    return end != value && *end == '\0' && preset->value >= INT16_MIN
+        && preset->value <= UINT16_MAX;
+}
+
+double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int run_batch_mode(const Options *opts, const uint16_t *words,
+        size_t num_words) {
+    RamImage *images = NULL;
+    size_t num_images = 0;
+    if (opts->images_filename && !read_images(opts->images_filename, &images,
+                &num_images)) {
+        return EXIT_FAILURE;
+    }
+    size_t num_instances = opts->num_instances ? opts->num_instances
+                                               : num_images;
+    BatchEmulator *be;
+    if (num_instances == 0) {
+        fprintf(stderr, "Error: %s: no RAM images\n", opts->images_filename);
+        return EXIT_FAILURE;
+    } else if (!(be = new_batch_emulator(NULL, num_instances))) {
+        fprintf(stderr, "Error: out of memory\n");
+        free_images(images, num_images);
+        return EXIT_FAILURE;
+    }
+    load_batch_program(be, words, num_words);
+    for (size_t i = 0; i < num_instances; ++i) {
+        for (size_t j = 0; j < opts->num_presets; ++j) {
+            *batch_ram_word(be, i, opts->presets[j].addr) =
+                opts->presets[j].value;
+        }
+        const RamImage *image = num_images ? &images[i % num_images] : NULL;
+        for (size_t j = 0; image && j < image->num_values; ++j) {
+            *batch_ram_word(be, i, image->values[j].addr) =
+                image->values[j].value;
+        }
+    }
+
+    double start = now_s();
+    bool success = run_batch(be, opts->max_cycles, opts->num_threads);
+    double elapsed = now_s() - start;
+    if (!success) {
+        fprintf(stderr, "Error: out of memory\n");
+        delete_batch_emulator(be);
+        free_images(images, num_images);
+        return EXIT_FAILURE;
+    }
+    unsigned long long cycles = 0;
+    size_t num_halted = 0;
+    for (size_t i = 0; i < num_instances; ++i) {
+        cycles += be->cycles[i];
+        num_halted += be->halt_reasons[i] == HALT_LOOP;
+        printf("instance %zu: %s after %llu instructions, pc %u\n", i,
+                be->halt_reasons[i] == HALT_LOOP ? "halted"
+                                                 : "reached cycle limit",
+                (unsigned long long)be->cycles[i], be->pc[i]);
+        for (size_t j = 0; j < opts->num_dumps; ++j) {
+            for (unsigned long addr = opts->dumps[j].first;
+                    addr <= opts->dumps[j].last; ++addr) {
+                printf("RAM[%lu] = %d\n", addr,
+                        (int16_t)*batch_ram_word(be, i, addr));
+            }
+        }
+    }
+    fprintf(stderr, "%zu of %zu instances halted, %llu instructions in "
+            "%.3f s, %.1f M instructions/s, %.1f instances per op run\n",
+            num_halted, num_instances, cycles, elapsed,
+            elapsed > 0 ? cycles / elapsed / 1e6 : 0.0,
+            be->num_steps ? (double)cycles / be->num_steps : 0.0);
+    delete_batch_emulator(be);
+    free_images(images, num_images);
+    return EXIT_SUCCESS;
+}
+
+bool read_images(const char *filename, RamImage **images, size_t *num_images) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: could not open file for reading: %s\n",
+                filename);
+        return false;
+    }
+    *images = NULL;
+    *num_images = 0;
+    size_t images_capacity = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    size_t line_num = 0;
+    bool success = true;
+    while (success && getline(&line, &line_capacity, file) != -1) {
+        ++line_num;
+        RamImage image = {NULL, 0};
+        size_t values_capacity = 0;
+        for (char *word = strtok(line, " \t\r\n"); word;
+                word = strtok(NULL, " \t\r\n")) {
+            if (!grow_array(&default_allocator, &image.values,
+                        image.num_values, &values_capacity,
+                        sizeof(*image.values))) {
+                fprintf(stderr, "Error: out of memory\n");
+                success = false;
+                break;
+            }
+            if (!parse_preset(word, &image.values[image.num_values++])) {
+                fprintf(stderr, "Error: %s:%zu: invalid RAM value: %s\n",
+                        filename, line_num, word);
+                success = false;
+                break;
+            }
+        }
+        if (success && image.num_values > 0
+                && !grow_array(&default_allocator, images, *num_images,
+                    &images_capacity, sizeof(**images))) {
+            fprintf(stderr, "Error: out of memory\n");
+            success = false;
+        }
+        if (image.num_values == 0 || !success) {
+            free(image.values);
+            continue;
+        }
+        (*images)[(*num_images)++] = image;
+    }
+    if (success && ferror(file)) {
+        fprintf(stderr, "Error: could not read file: %s\n", filename);
+        success = false;
+    }
+    free(line);
+    fclose(file);
+    if (!success) {
+        free_images(*images, *num_images);
+        *images = NULL;
+        *num_images = 0;
+    }
+    return success;
+}
+
+void free_images(RamImage *images, size_t num_images) {
+    for (size_t i = 0; i < num_images; ++i) {
+        free(images[i].values);
+    }
+    free(images);
+}
@@ -0,0 +1,315 @@
+//
+// linker for the Hack computer: merges relocatable objects written by the
+// assembler with -f obj, in the order given, resolves their symbols, and
+// writes the machine words of the whole program
+//
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../HackAssembler.h"
+#include "../Object.h"
+#include "../Output.h"
+#include "../PredefinedSymbols.h"
+#include "../SymbolTable.h"
+
+// constants
+const size_t link_table_size = 1024;
+const uint16_t first_var_addr = 16;
+
+// object to link, placed at its base address
+typedef struct Module {
+    const char *filename;
+    Object obj;
+    size_t base_addr;
+    uint16_t *import_values; // resolved value of each import
+    bool loaded;
+} Module;
+
+// objects being linked into a program, processed in parallel by the tasks
+typedef struct Link {
+    Module *modules;
+    size_t num_modules;
+    long num_threads;
+    SymbolTable *labels; // exported by every module, to absolute addresses
+    uint16_t *words;     // of the whole program
+    size_t num_words;
+    atomic_size_t num_errors;
+    void (*task)(struct Link *, Module *);
+    atomic_size_t next_module;
+} Link;
+
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+// runs the task on every module, on the threads of the link
+void for_each_module(Link *link, void (*task)(Link *, Module *));
+
+// thread running the task of the link on the next module, until none is left
+void *module_worker(void *link);
+
+// reads the object of the module
+void load_module(Link *link, Module *module);
+
+// places the modules one after the other, and gathers their labels, returns
+// false if a label is defined twice, or is a predefined symbol, or if there
+// is not enough memory
+bool place_modules(Link *link);
+
+// resolves the imports of every module to labels, or else to variables
+// allocated from address 16, in order of first appearance in the modules,
+// returns false if there is not enough memory
+bool resolve_imports(Link *link);
+
+// copies the words of the module into the program, patching its relocations
+void relocate_module(Link *link, Module *module);
+
+// signals a link error for the file
+void link_error(Link *link, const char *filename, const char *error_msg,
+        const char *name, size_t name_len);
+
+int main(int argc, char *argv[]) {
+    Link link = {.num_threads = sysconf(_SC_NPROCESSORS_ONLN)};
+    atomic_init(&link.num_errors, 0);
+    const char *out_filename = NULL;
+    OutputFormat format = FORMAT_TEXT;
+    int optchar;
+    char *end; // of a number
+    while ((optchar = getopt(argc, argv, "ho:j:f:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                return EXIT_SUCCESS;
+            case 'o': // specify output file
+                out_filename = optarg;
+                break;
+            case 'j': // specify number of threads
+                link.num_threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || link.num_threads < 1) {
+                    fprintf(stderr, "Invalid number of threads: %s\n",
+                            optarg);
+                    print_help(stderr, argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f': // specify output format
+                if (!parse_output_format(optarg, &format)
+                        || format == FORMAT_OBJECT) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    print_help(stderr, argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                print_help(stderr, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (!out_filename || optind == argc) {
+        print_help(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (link.num_threads < 1) {
+        link.num_threads = 1;
+    }
+    link.num_modules = argc - optind;
+    link.modules = calloc(link.num_modules, sizeof(*link.modules));
+    if (!link.modules) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < link.num_modules; ++i) {
+        link.modules[i].filename = argv[optind + i];
+    }
+
+    for_each_module(&link, load_module);
+    if (link.num_errors > 0 || !place_modules(&link)
+            || !resolve_imports(&link)) {
+        return EXIT_FAILURE;
+    }
+    link.words = malloc((link.num_words ? link.num_words : 1)
+            *sizeof(*link.words));
+    if (!link.words) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for_each_module(&link, relocate_module);
+
+    FILE *out_file = fopen(out_filename, "w");
+    if (!out_file) {
+        fprintf(stderr, "Error: could not open file for writing: %s\n",
+                out_filename);
+        return EXIT_FAILURE;
+    }
+    bool success = write_words(out_file, format, link.words, link.num_words);
+    if (fclose(out_file) || !success) {
+        fprintf(stderr, "Error: could not write file: %s\n", out_filename);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: ", exec_name);
+    fprintf(stream, "[-h] [-j num_threads] [-f format] -o out_file "
+            "obj_file...\n");
+}
+
+void for_each_module(Link *link, void (*task)(Link *, Module *)) {
+    link->task = task;
+    atomic_init(&link->next_module, 0);
+    size_t num_threads = link->num_threads;
+    if (num_threads > link->num_modules) {
+        num_threads = link->num_modules;
+    }
+    if (num_threads <= 1) { // no need for threads
+        module_worker(link);
+        return;
+    }
+    pthread_t *threads = malloc(num_threads*sizeof(*threads));
+    size_t num_started = 0;
+    while (threads && num_started < num_threads
+            && !pthread_create(&threads[num_started], NULL, module_worker,
+                link)) {
+        ++num_started;
+    }
+    if (num_started < num_threads) { // the modules left run on this thread
+        module_worker(link);
+    }
+    for (size_t i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+void *module_worker(void *link_ptr) {
+    Link *link = link_ptr;
+    size_t i;
+    while ((i = atomic_fetch_add(&link->next_module, 1)) < link->num_modules) {
+        link->task(link, &link->modules[i]);
+    }
+    return NULL;
+}
+
+void load_module(Link *link, Module *module) {
+    FILE *in_file = fopen(module->filename, "r");
+    if (!in_file) {
+        link_error(link, module->filename, "could not open file for reading",
+                NULL, 0);
+        return;
+    }
+    module->loaded = read_object(in_file, &module->obj);
+    fclose(in_file);
+    if (!module->loaded) {
+        link_error(link, module->filename, "not a valid object", NULL, 0);
+    }
+}
+
+bool place_modules(Link *link) {
+    link->labels = new_symbol_table(link_table_size, &default_allocator);
+    if (!link->labels) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    for (size_t i = 0; i < link->num_modules; ++i) {
+        Module *module = &link->modules[i];
+        module->base_addr = link->num_words;
+        link->num_words += module->obj.num_words;
+        for (size_t j = 0; j < module->obj.num_exports; ++j) {
+            const ObjectExport *export = &module->obj.exports[j];
+            const char *name = module->obj.names + export->name_offset;
+            uint16_t label_addr = module->base_addr + export->addr;
+            uint32_t value;
+            InsertResult inserted = INSERT_DUPLICATE;
+            if (!lookup_predefined(name, export->name_len, &value)) {
+                inserted = insert_symbol(link->labels, name, export->name_len,
+                        label_addr);
+            }
+            if (inserted == INSERT_NO_MEMORY) {
+                link_error(link, module->filename, "out of memory", NULL, 0);
+            } else if (inserted == INSERT_INVALID_KEY) {
+                link_error(link, module->filename, "invalid label name", name,
+                        export->name_len);
+            } else if (inserted != INSERT_OK) {
+                link_error(link, module->filename, "label already defined",
+                        name, export->name_len);
+            }
+        }
+    }
+    return link->num_errors == 0;
+}
+
+bool resolve_imports(Link *link) {
+    SymbolTable *variables = new_symbol_table(link_table_size,
+            &default_allocator);
+    if (!variables) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    uint16_t highest_var_addr = first_var_addr;
+    for (size_t i = 0; i < link->num_modules; ++i) {
+        Module *module = &link->modules[i];
+        module->import_values = malloc((module->obj.num_imports + 1)
+                *sizeof(*module->import_values));
+        if (!module->import_values) {
+            link_error(link, module->filename, "out of memory", NULL, 0);
+            continue;
+        }
+        for (size_t j = 0; j < module->obj.num_imports; ++j) {
+            const ObjectImport *import = &module->obj.imports[j];
+            const char *name = module->obj.names + import->name_offset;
+            uint32_t value;
+            if (!lookup_key(link->labels, name, import->name_len, &value)
+                    && !lookup_key(variables, name, import->name_len,
+                        &value)) { // first appearance of a variable
+                value = highest_var_addr++;
+                InsertResult inserted = insert_symbol(variables, name,
+                        import->name_len, value);
+                if (inserted == INSERT_NO_MEMORY) {
+                    link_error(link, module->filename, "out of memory", NULL,
+                            0);
+                } else if (inserted != INSERT_OK) {
+                    link_error(link, module->filename, "invalid symbol name",
+                            name, import->name_len);
+                }
+            }
+            module->import_values[j] = value;
+        }
+    }
+    delete_symbol_table(variables);
+    return link->num_errors == 0;
+}
+
+void relocate_module(Link *link, Module *module) {
+    const Object *obj = &module->obj;
+    uint16_t *words = link->words + module->base_addr;
+    if (obj->num_words > 0) {
+        memcpy(words, obj->words, obj->num_words*sizeof(*words));
+    }
+    for (size_t i = 0; i < obj->num_relocs; ++i) {
+        const ObjectReloc *reloc = &obj->relocs[i];
+        if (reloc->symbol == RELOC_LOCAL) {
+            words[reloc->addr] += module->base_addr;
+        } else {
+            words[reloc->addr] = module->import_values[reloc->symbol];
+        }
+    }
+}
+
+void link_error(Link *link, const char *filename, const char *error_msg,
+        const char *name, size_t name_len) {
+    flockfile(stderr);
+    fprintf(stderr, "Error: %s: %s", filename, error_msg);
+    if (name) {
+        fprintf(stderr, ": %.*s", (int)name_len, name);
+    }
+    fputc('\n', stderr);
+    funlockfile(stderr);
+    atomic_fetch_add(&link->num_errors, 1);
+}
@@ -2,63 +2,222 @@
 // assembler for the Hack computer, project 6 of the nand2tetris course
 //
 
+#include <dirent.h>
+#include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "Cache.h"
+#include "ChunkedAssembler.h"
+#include "DeadCode.h"
 #include "HackAssembler.h"
+#include "Input.h"
+#include "Object.h"
+#include "Output.h"
+#include "Peephole.h"
+#include "Server.h"
+#include "Stats.h"
+#include "Stream.h"
+#include "Watch.h"
 
 // program options struct
 typedef struct {
-    char *in_filename;
+    char **in_filenames;
+    size_t num_inputs;
     char *out_filename;
+    long num_threads;
+    bool chunked; // each file split in chunks assembled by all the threads
+    OutputFormat format;
+    char *serve_path;  // socket to serve jobs on, if not NULL
+    char *server_path; // socket of the server to send jobs to, if not NULL
+    bool server_fallback; // assemble locally if the server is unreachable
+    char *cache_dir; // outputs are cached in it, if not NULL
+    bool watch;      // assemble the input again whenever it changes
+    bool optimize;   // rewrite the instructions with the peephole optimizer
+    bool dead_code;  // drop the code unreachable from address 0
+    const char *trusted; // labels before jumps to computed addresses that
+                         // reach only referenced labels, "*" for all
+    bool stats;      // report the statistics of every job, as JSON
+    size_t stream_buffer; // words buffered in memory by --stream, 0 if not
+                          // streaming
 } Options;
 
+// input file to assemble, and its result
+typedef struct {
+    const char *in_filename;
+    const char *out_filename; // derived from in_filename if NULL
+    long chunk_threads;       // threads per file if chunked, 0 otherwise
+    OutputFormat format;
+    bool replace_output;      // unlink the output first, it may be cached
+    bool optimize;            // peephole optimized, with its savings reported
+    bool dead_code;           // its dead code dropped, and reported
+    const char *trusted;      // labels of --dead-code
+    bool stats;               // assembled locally, with its statistics reported
+    size_t stream_buffer;     // streamed from input to output, if not 0
+    bool success;
+} Job;
+
+// jobs shared by the worker threads, each takes the next one until none is left
+typedef struct {
+    Job *jobs;
+    size_t num_jobs;
+    atomic_size_t next_job;
+    const char *server_path; // jobs are sent to the server, if not NULL
+    bool server_fallback;
+    const char *cache_dir;   // outputs are cached in it, if not NULL
+} JobQueue;
+
 
 // parses command line arguments, returns an options structure containing the
-// specified input and output filenames or NULL if none are given
+// specified input files, with directories expanded to the .asm files in them,
+// and output filename or NULL if none is given
 Options parse_args(int argc, char *argv[]);
 
+// appends an input filename to the options, expanding directories to the .asm
+// files in them, in alphabetical order. Exits if there is not enough memory
+void add_input(Options *opts, const char *path);
+
+// selects the .asm files of a directory
+int is_asm_file(const struct dirent *entry);
+
 // prints to the specified output stream a small description of program usage
 void print_help(FILE *stream, const char *exec_name);
 
-// signals a file handling error message, aborts program execution
+// signals a file handling error message
 void file_error(const char *error_msg, const char *error_val);
 
 // creates the output filename from the input filename, by adding or replacing
-// the .hack extension. The output filename is allocated on the heap, should be
-// freed if necessary
+// the extension. The output filename is allocated on the heap, should be
+// freed if necessary, NULL if there is not enough memory
 char *make_out_filename(const char *in_filename, const char *extension);
 
+// returns whether the filename is "-", for the standard input or output
+bool is_stdio(const char *filename);
+
+// returns whether the input filename can only be read once, as the standard
+// input, or a pipe or anything else that is not a regular file
+bool is_read_once(const char *filename);
+
+// returns the name of the input file of the job, in messages
+const char *job_name(const Job *job);
+
+// opens the input file of the job for reading, the standard input for "-",
+// returns NULL and signals an error on failure
+FILE *open_job_input(const Job *job);
+
+// returns the output filename of the job, allocated on the heap, NULL if
+// there is not enough memory. It is "-", the standard output, if the input is
+// the standard input and no output filename is given
+char *job_out_filename(const Job *job);
+
+// opens the output file of the job for writing, replacing it if it may be
+// linked into the cache, or the standard output for "-", returns NULL and
+// signals an error on failure, or if out_filename is NULL
+FILE *open_output(const Job *job, const char *out_filename);
+
+// assembles all the jobs on a pool of num_threads worker threads
+void run_jobs(JobQueue *queue, long num_threads);
+
+// worker thread, assembles jobs from the queue with its own assembly state,
+// and its own connection to the server if jobs are sent to one
+void *assemble_worker(void *queue);
+
+// runs the job from the cache, if its output is cached, otherwise on the
+// server or locally, and caches its output. Returns false if it failed
+bool run_job(const JobQueue *queue, const Job *job, int *server_fd,
+        bool *disconnected, Assembly *as);
+
+// assembles the input file of the job and writes its output file, errors are
+// reported for the file, returns false if there were any
+bool assemble_job(const Job *job, Assembly *as);
+
+// assembles the input file of the job in chunks on its threads, and writes its
+// output file, returns false if there were any errors
+bool assemble_chunked_job(const Job *job);
+
+// assembles the input file of the job as it is read, writing the words of its
+// output file as soon as they are final. The output file is removed if there
+// were errors, returns false if there were any
+bool stream_job(const Job *job);
+
+// sends the input file of the job to the server on server_fd, and writes the
+// output file it returns, or prints its errors. Returns false if there were
+// errors, and sets *disconnected if they came from the connection, before the
+// output file was touched
+bool assemble_remote_job(const Job *job, int server_fd, bool *disconnected);
+
 int main(int argc, char *argv[]) {
     Options opts = parse_args(argc, argv);
-
-    FILE *in_file;
-    if (!(in_file = fopen(opts.in_filename, "r"))) {
-        file_error("could not open file for reading", opts.in_filename);
-    }
-    if (opts.out_filename == NULL) { // write to stdout by default
-        opts.out_filename = make_out_filename(opts.in_filename, "hack");
+    if (opts.serve_path) {
+        return run_server(opts.serve_path, opts.num_threads)
+             ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    FILE *out_file;
-    if (!(out_file = fopen(opts.out_filename, "w"))) {
-        file_error("could not open file for writing", opts.out_filename);
+    if (opts.watch) {
+        Job job = {.in_filename = opts.in_filenames[0],
+            .out_filename = opts.out_filename, .format = opts.format};
+        return watch_file(job.in_filename, job_out_filename(&job), job.format)
+             ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    assemble_file(in_file, out_file);
+    bool uncached = opts.stats || opts.stream_buffer || opts.dead_code;
+    bool local = opts.chunked || opts.optimize || uncached;
+    JobQueue queue = {.num_jobs = opts.num_inputs,
+        .server_path = local ? NULL : opts.server_path,
+        .server_fallback = opts.server_fallback,
+        .cache_dir = uncached ? NULL : opts.cache_dir};
+    queue.jobs = calloc(opts.num_inputs, sizeof(*queue.jobs));
+    if (!queue.jobs) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < opts.num_inputs; ++i) {
+        queue.jobs[i].in_filename = opts.in_filenames[i];
+        queue.jobs[i].out_filename = opts.out_filename;
+        queue.jobs[i].chunk_threads = opts.chunked ? opts.num_threads : 0;
+        queue.jobs[i].format = opts.format;
+        queue.jobs[i].replace_output = opts.cache_dir != NULL;
+        queue.jobs[i].optimize = opts.optimize;
+        queue.jobs[i].dead_code = opts.dead_code;
+        queue.jobs[i].trusted = opts.trusted;
+        queue.jobs[i].stats = opts.stats;
+        queue.jobs[i].stream_buffer = opts.stream_buffer;
+    }
+    atomic_init(&queue.next_job, 0);
+    run_jobs(&queue, opts.chunked ? 1 : opts.num_threads);
 
-    return 0;
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < queue.num_jobs; ++i) {
+        if (!queue.jobs[i].success) {
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
 }
 
 Options parse_args(int argc, char *argv[]) {
-    Options opts = {.out_filename = 0, .in_filename = 0};
+    Options opts = {.out_filename = 0, .in_filenames = 0, .num_inputs = 0,
+        .num_threads = sysconf(_SC_NPROCESSORS_ONLN)};
     char *exec_name = argv[0];
     bool args_error = false;
     int optchar;
-    while ((optchar = getopt(argc, argv, "ho:")) != -1) {
+    char *end; // of a number
+    const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"watch", no_argument, NULL, 'w'},
+        {"stats", no_argument, NULL, 's'}, // long only
+        {"stream", optional_argument, NULL, 'm'}, // long only
+        {"dead-code", optional_argument, NULL, 'e'}, // long only
+        {NULL, 0, NULL, 0}
+    };
+    while ((optchar = getopt_long(argc, argv, "ho:j:pf:S:C:c:wO",
+                    long_options, NULL)) != -1) {
         switch (optchar) {
             case 'h': // print help
                 print_help(stdout, exec_name);
@@ -67,6 +226,54 @@ Options parse_args(int argc, char *argv[]) {
             case 'o': // specify output file
                 opts.out_filename = optarg;
                 break;
+            case 'j': // specify number of worker threads
+                opts.num_threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || opts.num_threads < 1) {
+                    fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                    args_error = true;
+                }
+                break;
+            case 'p': // split each file in chunks assembled in parallel
+                opts.chunked = true;
+                break;
+            case 'f': // specify output format
+                if (!parse_output_format(optarg, &opts.format)) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    args_error = true;
+                }
+                break;
+            case 'S': // serve jobs on a socket
+                opts.serve_path = optarg;
+                break;
+            case 'C': // send jobs to the server on a socket
+                opts.server_path = optarg;
+                break;
+            case 'c': // cache outputs in a directory
+                opts.cache_dir = optarg;
+                break;
+            case 'w': // assemble again on every change
+                opts.watch = true;
+                break;
+            case 'O': // run the peephole optimizer
+                opts.optimize = true;
+                break;
+            case 's': // report the statistics of the jobs
+                opts.stats = true;
+                break;
+            case 'e': // drop dead code, trusting the labels
+                opts.dead_code = true;
+                opts.trusted = optarg;
+                break;
+            case 'm': // stream, with a memory cap in KB
+                opts.stream_buffer = optarg
+                    ? strtoul(optarg, NULL, 10)*1024/sizeof(uint16_t)
+                    : default_stream_buffer;
+                if (opts.stream_buffer == 0) {
+                    fprintf(stderr, "Invalid stream buffer size: %s\n",
+                            optarg);
+                    args_error = true;
+                }
+                break;
             case ':': // -o without operand
                 fprintf(stderr, "Option -%c requires an operand\n", optopt);
                 args_error = true;
@@ -76,33 +283,164 @@ Options parse_args(int argc, char *argv[]) {
                 break;
         }
     }
-    if (args_error || argc == 1) {
+    if (opts.num_threads < 1) { // number of processors unknown
+        opts.num_threads = 1;
+    }
+    if (!args_error && opts.serve_path && argc == optind) {
+        return opts;
+    }
+    if (args_error || argc == optind || opts.serve_path) {
         print_help(stderr, exec_name);
         exit(EXIT_FAILURE);
     }
-    if (argc > optind+1) { // too many input files
-        fprintf(stderr, "Too many input files, using %s\n", opts.in_filename);
+    if (!opts.server_path && getenv(server_env_var)) {
+        opts.server_path = getenv(server_env_var);
+        opts.server_fallback = true; // scripts keep working without it
+    }
+    if (!opts.cache_dir && getenv(cache_env_var)) {
+        opts.cache_dir = getenv(cache_env_var);
+    }
+    for (int i = optind; i < argc; ++i) {
+        add_input(&opts, argv[i]);
+    }
+    if (opts.num_inputs == 0) {
+        file_error("no input files found in", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    if (opts.out_filename && opts.num_inputs > 1) {
+        fprintf(stderr, "Option -o requires a single input file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.watch && (opts.num_inputs > 1
+                || is_stdio(opts.in_filenames[0]))) {
+        fprintf(stderr, "Option --watch requires a single input file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.format == FORMAT_OBJECT && (opts.watch || opts.chunked)) {
+        fprintf(stderr, "Objects are not written with -p or --watch\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.optimize && (opts.watch || opts.chunked)) {
+        fprintf(stderr, "Option -O is not used with -p or --watch\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.stats && (opts.watch || opts.chunked)) {
+        fprintf(stderr, "Option --stats is not used with -p or --watch\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.dead_code && (opts.watch || opts.chunked)) {
+        fprintf(stderr, "Option --dead-code is not used with -p or --watch\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.dead_code && opts.format == FORMAT_OBJECT) {
+        fprintf(stderr, "Option --dead-code is not used with objects, whose "
+                "labels other objects may use\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.stream_buffer && (opts.watch || opts.chunked || opts.optimize
+                || opts.stats || opts.dead_code)) {
+        fprintf(stderr, "Option --stream is not used with -p, -O, --stats, "
+                "--dead-code or --watch\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts.stream_buffer && !can_stream(opts.format)) {
+        fprintf(stderr, "Output format %s is not streamed\n",
+                format_names[opts.format]);
+        exit(EXIT_FAILURE);
     }
-    opts.in_filename = argv[optind];
     return opts;
 }
 
+void add_input(Options *opts, const char *path) {
+    struct stat path_stat;
+    if (stat(path, &path_stat) || !S_ISDIR(path_stat.st_mode)) { // a file
+        char **grown = realloc(opts->in_filenames,
+                (opts->num_inputs+1)*sizeof(*opts->in_filenames));
+        char *filename = grown ? strdup(path) : NULL;
+        if (!filename) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        opts->in_filenames = grown;
+        opts->in_filenames[opts->num_inputs++] = filename;
+        return;
+    }
+    struct dirent **entries;
+    int num_entries = scandir(path, &entries, is_asm_file, alphasort);
+    if (num_entries < 0) {
+        file_error("could not read directory", path);
+        return;
+    }
+    for (int i = 0; i < num_entries; ++i) {
+        char *filename = malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+        if (!filename) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        sprintf(filename, "%s/%s", path, entries[i]->d_name);
+        add_input(opts, filename);
+        free(filename);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+int is_asm_file(const struct dirent *entry) {
+    const char *extension = strrchr(entry->d_name, '.');
+    return extension && !strcmp(extension, ".asm");
+}
+
 void print_help(FILE *stream, const char *exec_name) {
     fprintf(stream, "Usage: %s: ", exec_name);
-    fprintf(stream, "[-h] [-o out_file] in_file\n");
+    fprintf(stream, "[-h] [-j num_threads] [-p] [-f format] [-o out_file] "
+            "[-C socket] [-c cache_dir] [-w|--watch] [-O] [--stats] "
+            "[--stream[=max_kb]]\n       [--dead-code[=labels]] "
+            "in_file|in_dir|-...\n");
+    fprintf(stream, "       %s -S socket [-j num_threads]\n", exec_name);
+    fprintf(stream, "formats: text (default), le, be (raw 16-bit words), "
+            "ihex (Intel HEX), rom (header with count and checksum),\n"
+            "         obj (relocatable object, linked by linker/hacklink)\n");
+    fprintf(stream, "-S serves jobs on the socket, -C sends them to it, as "
+            "does setting %s\n", server_env_var);
+    fprintf(stream, "-c caches outputs by the hash of their input, as does "
+            "setting %s\n", cache_env_var);
+    fprintf(stream, "-w assembles the input again whenever it changes, from "
+            "its first changed line\n");
+    fprintf(stream, "-O rewrites the instructions with a peephole optimizer, "
+            "and reports the words saved\n");
+    fprintf(stream, "--stats reports the times, counts and symbol tables of "
+            "every file as JSON on\n        stderr, assembling it locally, "
+            "not from the cache\n");
+    fprintf(stream, "- reads the standard input, written to the standard "
+            "output unless -o is given,\n  and -o - writes the standard "
+            "output, assembling locally, not from the cache\n");
+    fprintf(stream, "--stream writes each word as soon as the symbols before "
+            "it are resolved, buffering\n         the rest in max_kb of "
+            "memory (%zu by default), then in a temporary file\n",
+            default_stream_buffer*sizeof(uint16_t)/1024);
+    fprintf(stream, "--dead-code drops the labels, and the code after them, "
+            "not reachable from address 0,\n            and reports them. "
+            "It drops nothing if a jump to a computed address\n            "
+            "follows a label not in labels, separated by commas, or * for "
+            "all\n");
 }
 
 void file_error(const char *error_msg, const char *error_val) {
     fprintf(stderr, "Error: %s: %s\n", error_msg, error_val);
-    exit(EXIT_FAILURE);
 }
 
 char *make_out_filename(const char *in_filename, const char *extension) {
+    // room for a "./" directory, the '.' of the extension, and the '\0'
     char *out_filename =
-        malloc((strlen(in_filename)+strlen(extension))*sizeof(char));
+        malloc((strlen(in_filename)+strlen(extension)+4)*sizeof(char));
     // dirname may modify the given path, or return a pointer to static storage
     // an aux string is used as an intermediate buffer
-    char *aux = malloc(strlen(in_filename)*sizeof(char));
+    char *aux = malloc((strlen(in_filename)+1)*sizeof(char));
+    if (!out_filename || !aux) {
+        free(out_filename);
+        free(aux);
+        return NULL;
+    }
     strcpy(aux, in_filename);
     char *out_dirname = dirname(aux);
     strcpy(out_filename, out_dirname);
@@ -121,3 +459,330 @@ char *make_out_filename(const char *in_filename, const char *extension) {
     free(aux);
     return out_filename;
 }
+
+bool is_stdio(const char *filename) {
+    return !strcmp(filename, "-");
+}
+
+bool is_read_once(const char *filename) {
+    struct stat path_stat;
+    return is_stdio(filename) || stat(filename, &path_stat)
+        || !S_ISREG(path_stat.st_mode);
+}
+
+const char *job_name(const Job *job) {
+    return is_stdio(job->in_filename) ? "stdin" : job->in_filename;
+}
+
+FILE *open_job_input(const Job *job) {
+    if (is_stdio(job->in_filename)) {
+        return stdin;
+    }
+    FILE *in_file = fopen(job->in_filename, "r");
+    if (!in_file) {
+        file_error("could not open file for reading", job->in_filename);
+    }
+    return in_file;
+}
+
+char *job_out_filename(const Job *job) {
+    if (!job->out_filename && is_stdio(job->in_filename)) {
+        return strdup("-");
+    }
+    return job->out_filename ? strdup(job->out_filename)
+                             : make_out_filename(job->in_filename,
+                                     format_extensions[job->format]);
+}
+
+FILE *open_output(const Job *job, const char *out_filename) {
+    if (!out_filename) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    if (is_stdio(out_filename)) {
+        return stdout;
+    }
+    if (job->replace_output) { // never write through a link into the cache
+        unlink(out_filename);
+    }
+    FILE *out_file = fopen(out_filename, "w");
+    if (!out_file) {
+        file_error("could not open file for writing", out_filename);
+    }
+    return out_file;
+}
+
+void run_jobs(JobQueue *queue, long num_threads) {
+    if ((size_t)num_threads > queue->num_jobs) {
+        num_threads = queue->num_jobs;
+    }
+    if (num_threads <= 1) { // no need for threads
+        assemble_worker(queue);
+        return;
+    }
+    pthread_t *threads = malloc(num_threads*sizeof(*threads));
+    long num_started = 0;
+    while (threads && num_started < num_threads
+            && !pthread_create(&threads[num_started], NULL, assemble_worker,
+                queue)) {
+        ++num_started;
+    }
+    if (num_started < num_threads) { // the jobs left run on this thread
+        assemble_worker(queue);
+    }
+    for (long i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+void *assemble_worker(void *queue_ptr) {
+    JobQueue *queue = queue_ptr;
+    int server_fd = -1; // connected once, on the first job
+    bool disconnected = !queue->server_path;
+    Assembly *as = new_assembly(NULL); // reused for every job of the thread
+    if (!as) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL; // jobs left to the other threads, or failed
+    }
+    as->error_stream = stderr;
+    size_t i;
+    while ((i = atomic_fetch_add(&queue->next_job, 1)) < queue->num_jobs) {
+        queue->jobs[i].success = run_job(queue, &queue->jobs[i], &server_fd,
+                &disconnected, as);
+    }
+    if (server_fd >= 0) {
+        close(server_fd);
+    }
+    delete_assembly(as);
+    return NULL;
+}
+
+bool run_job(const JobQueue *queue, const Job *job, int *server_fd,
+        bool *disconnected, Assembly *as) {
+    char *entry_path = NULL;
+    uint64_t key;
+    bool stdio = is_read_once(job->in_filename)
+        || (job->out_filename && is_stdio(job->out_filename));
+    if (queue->cache_dir && !stdio && cache_key(job->in_filename, job->format,
+                job->optimize, &key)) {
+        entry_path = cache_entry_path(queue->cache_dir, key, job->format);
+        char *out_filename = job_out_filename(job);
+        bool hit = fetch_cached(entry_path, out_filename);
+        free(out_filename);
+        if (hit) { // no parsing at all
+            free(entry_path);
+            return true;
+        }
+    }
+    // the standard input, and pipes, are read once, so they are not sent to
+    // a server that may fail to answer
+    bool success = false, done = false;
+    bool remote = !stdio && !*disconnected;
+    if (remote && *server_fd < 0
+            && (*server_fd = connect_server(queue->server_path)) < 0) {
+        *disconnected = true;
+    }
+    if (remote && !*disconnected) {
+        success = assemble_remote_job(job, *server_fd, disconnected);
+        done = !*disconnected;
+    }
+    if (!done && remote && queue->server_path && !queue->server_fallback) {
+        file_error("could not reach server", queue->server_path);
+    } else if (!done) {
+        success = job->chunk_threads ? assemble_chunked_job(job)
+                                     : assemble_job(job, as);
+    }
+    if (success && entry_path) {
+        char *out_filename = job_out_filename(job);
+        store_cached(out_filename, entry_path);
+        free(out_filename);
+    }
+    free(entry_path);
+    return success;
+}
+
+bool assemble_job(const Job *job, Assembly *as) {
+    if (job->stream_buffer) {
+        return stream_job(job);
+    }
+    AssemblyStats stats;
+    PhaseTime start;
+    if (job->stats) {
+        start_stats(&stats, as);
+        start_phase(&start);
+    }
+    FILE *in_file;
+    if (!(in_file = open_job_input(job))) {
+        return false;
+    }
+    InputBuffer input;
+    if (!open_input(in_file, &input)) {
+        file_error("could not read file", job_name(job));
+        fclose(in_file);
+        return false;
+    }
+    if (job->stats) {
+        end_phase(&stats, STATS_READ, &start);
+        start_phase(&start);
+    }
+    as->relocatable = job->format == FORMAT_OBJECT;
+    bool success;
+    if (job->dead_code) {
+        DeadCodeStats dead_code_stats;
+        PeepholeStats peephole_stats;
+        success = drop_dead_code_buffer(input.data, input.size, job_name(job),
+                as, job->trusted, &dead_code_stats,
+                job->optimize ? &peephole_stats : NULL);
+        if (success) {
+            print_dead_code_stats(stderr, job_name(job), &dead_code_stats);
+        }
+        if (success && job->optimize) {
+            print_peephole_stats(stderr, job_name(job), &peephole_stats);
+        }
+        free_dead_code_stats(&dead_code_stats);
+    } else if (job->optimize) {
+        PeepholeStats peephole_stats;
+        success = optimize_buffer(input.data, input.size, job_name(job),
+                as, &peephole_stats);
+        if (success) {
+            print_peephole_stats(stderr, job_name(job), &peephole_stats);
+        }
+    } else {
+        success = assemble_buffer(input.data, input.size, job_name(job),
+                as);
+    }
+    if (job->stats && success) {
+        end_phase(&stats, STATS_ASSEMBLE, &start);
+        collect_stats(&stats, input.data, input.size, as);
+    }
+    close_input(&input);
+    fclose(in_file);
+    if (!success) { // errors already reported, no output is written
+        return false;
+    }
+    if (job->stats) {
+        start_phase(&start);
+    }
+    char *out_filename = job_out_filename(job);
+    FILE *out_file;
+    if (!(out_file = open_output(job, out_filename))) {
+        free(out_filename);
+        return false;
+    }
+    success = job->format == FORMAT_OBJECT
+            ? write_object(out_file, as)
+            : write_words(out_file, job->format, as->words, as->num_words);
+    if (fclose(out_file) || !success) {
+        file_error("could not write file", out_filename);
+        success = false;
+    }
+    if (job->stats && success) {
+        end_phase(&stats, STATS_OUTPUT, &start);
+        print_stats(stderr, job_name(job), &stats);
+    }
+    free(out_filename);
+    return success;
+}
+
+bool assemble_chunked_job(const Job *job) {
+    FILE *in_file;
+    if (!(in_file = open_job_input(job))) {
+        return false;
+    }
+    ChunkedAssembly *ca;
+    bool success = assemble_chunked(in_file, job_name(job),
+            job->chunk_threads, &ca);
+    fclose(in_file);
+    if (!success) { // errors already reported, no output is written
+        delete_chunked_assembly(ca);
+        return false;
+    }
+    char *out_filename = job_out_filename(job);
+    FILE *out_file;
+    if (!(out_file = open_output(job, out_filename))) {
+        free(out_filename);
+        delete_chunked_assembly(ca);
+        return false;
+    }
+    success = write_chunked(ca, out_file, job->format);
+    if (fclose(out_file) || !success) {
+        file_error("could not write file", out_filename);
+        success = false;
+    }
+    free(out_filename);
+    delete_chunked_assembly(ca);
+    return success;
+}
+
+bool stream_job(const Job *job) {
+    FILE *in_file;
+    if (!(in_file = open_job_input(job))) {
+        return false;
+    }
+    char *out_filename = job_out_filename(job);
+    FILE *out_file;
+    if (!(out_file = open_output(job, out_filename))) {
+        free(out_filename);
+        fclose(in_file);
+        return false;
+    }
+    bool success = stream_file(in_file, out_file, job_name(job), job->format,
+            job->stream_buffer);
+    fclose(in_file);
+    if (fclose(out_file) && success) { // other errors already reported
+        file_error("could not write file", out_filename);
+        success = false;
+    }
+    if (!success && !is_stdio(out_filename)) { // not left incomplete
+        unlink(out_filename);
+    }
+    free(out_filename);
+    return success;
+}
+
+bool assemble_remote_job(const Job *job, int server_fd, bool *disconnected) {
+    FILE *in_file;
+    if (!(in_file = open_job_input(job))) {
+        return false;
+    }
+    InputBuffer input;
+    bool read = open_input(in_file, &input);
+    fclose(in_file);
+    if (!read) {
+        file_error("could not read file", job_name(job));
+        return false;
+    }
+    JobRequest request = {.kind = JOB_SOURCE, .format = job->format,
+        .name_size = strlen(job->in_filename), .data_size = input.size};
+    JobResponse response;
+    char *payload;
+    bool answered = input.size <= UINT32_MAX
+                 && request_job(server_fd, &request, job->in_filename,
+                         input.data, &response, &payload);
+    close_input(&input);
+    if (!answered) {
+        *disconnected = true;
+        return false;
+    }
+    if (response.num_errors > 0) { // errors already formatted by the server
+        fwrite(payload, 1, response.size, stderr);
+        free(payload);
+        return false;
+    }
+    char *out_filename = job_out_filename(job);
+    FILE *out_file;
+    bool success = true;
+    if (!(out_file = open_output(job, out_filename))) {
+        success = false;
+    } else {
+        success = fwrite(payload, 1, response.size, out_file) == response.size;
+        if (fclose(out_file) || !success) {
+            file_error("could not write file", out_filename);
+            success = false;
+        }
+    }
+    free(out_filename);
+    free(payload);
+    return success;
+}
@@ -0,0 +1,155 @@
+//
+// test of a client whose connection the server closed for being idle: the
+// client, given the server by HACKASM_SERVER, sends a first job, then blocks
+// past connection_timeout on a FIFO, which it assembles locally, and must
+// assemble its last job locally too instead of dying of SIGPIPE when it
+// writes to the closed connection
+//
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../Server.h"
+
+// constants
+const char *const assembler_path = "./main";
+const char *const test_program = "@first\n@second\nM=1\n@first\nM=-1\n";
+const char *const test_words = "0000000000010000\n0000000000010001\n"
+    "1110111111001000\n0000000000010000\n1110111010001000\n";
+const int connect_attempts = 100;
+
+
+// writes text to the file at path, returns false on errors
+bool write_file(const char *path, const char *text);
+
+// returns whether the file at path holds exactly text
+bool file_equals(const char *path, const char *text);
+
+// starts a server on socket_path, returns its process id once it accepts
+// connections, or -1
+pid_t start_server(const char *socket_path);
+
+int main(void) {
+    char dir[] = "/tmp/hackasm_test.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("Error: mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char socket_path[64], first_path[64], first_out[64], fifo_path[64],
+         fifo_out[64], last_path[64], last_out[64];
+    snprintf(socket_path, sizeof(socket_path), "%s/sock", dir);
+    snprintf(first_path, sizeof(first_path), "%s/a.asm", dir);
+    snprintf(first_out, sizeof(first_out), "%s/a.hack", dir);
+    snprintf(fifo_path, sizeof(fifo_path), "%s/fifo.asm", dir);
+    snprintf(fifo_out, sizeof(fifo_out), "%s/fifo.hack", dir);
+    snprintf(last_path, sizeof(last_path), "%s/b.asm", dir);
+    snprintf(last_out, sizeof(last_out), "%s/b.hack", dir);
+    if (!write_file(first_path, test_program)
+            || !write_file(last_path, test_program)
+            || mkfifo(fifo_path, 0600)) {
+        perror("Error: could not write the inputs");
+        return EXIT_FAILURE;
+    }
+    pid_t server = start_server(socket_path);
+    if (server < 0) {
+        fprintf(stderr, "Error: could not start the server\n");
+        return EXIT_FAILURE;
+    }
+
+    pid_t client = fork();
+    if (client == 0) {
+        setenv(server_env_var, socket_path, 1);
+        execl(assembler_path, assembler_path, "-j", "1", first_path,
+                fifo_path, last_path, (char *)NULL);
+        _exit(127);
+    }
+    sleep(connection_timeout + 2); // the client blocks opening the FIFO
+    bool written = write_file(fifo_path, test_program);
+    int status = 0;
+    waitpid(client, &status, 0);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    bool passed = true;
+    if (!written) {
+        fprintf(stderr, "FAIL: could not write the FIFO\n");
+        passed = false;
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "FAIL: client killed by signal %d\n",
+                WTERMSIG(status));
+        passed = false;
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "FAIL: client exited with %d\n",
+                WEXITSTATUS(status));
+        passed = false;
+    }
+    if (!file_equals(first_out, test_words)) {
+        fprintf(stderr, "FAIL: wrong output for the job sent first\n");
+        passed = false;
+    }
+    if (!file_equals(fifo_out, test_words)) {
+        fprintf(stderr, "FAIL: wrong output for the FIFO\n");
+        passed = false;
+    }
+    if (!file_equals(last_out, test_words)) {
+        fprintf(stderr, "FAIL: wrong output for the job after the timeout\n");
+        passed = false;
+    }
+    unlink(first_path);
+    unlink(first_out);
+    unlink(fifo_path);
+    unlink(fifo_out);
+    unlink(last_path);
+    unlink(last_out);
+    unlink(socket_path);
+    rmdir(dir);
+    printf("%s: job after the server timeout\n", passed ? "PASS" : "FAIL");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool write_file(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    bool written = fputs(text, file) >= 0;
+    return !fclose(file) && written;
+}
+
+bool file_equals(const char *path, const char *text) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    size_t len = strlen(text);
+    char *contents = malloc(len + 2);
+    size_t num_read = contents ? fread(contents, 1, len + 1, file) : 0;
+    fclose(file);
+    bool equal = num_read == len && !memcmp(contents, text, len);
+    free(contents);
+    return equal;
+}
+
+pid_t start_server(const char *socket_path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(assembler_path, assembler_path, "-S", socket_path, "-j", "2",
+                (char *)NULL);
+        _exit(127);
+    }
+    for (int i = 0; pid > 0 && i < connect_attempts; ++i) {
+        int fd = connect_server(socket_path);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+    return -1;
+}
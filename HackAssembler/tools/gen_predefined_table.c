@@ -0,0 +1,86 @@
+//
+// generates the perfect hash table of the predefined symbols of the Hack
+// assembler, written as C source to stdout
+//
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../PredefinedSymbols.h"
+
+// constants
+enum { num_symbols = 23 };
+const char *keys[num_symbols] = {
+    "SP", "LCL", "ARG", "THIS", "THAT", "SCREEN", "KBD",
+    "R0", "R1", "R2",  "R3",  "R4",  "R5",  "R6",  "R7",
+    "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15"};
+const uint16_t values[num_symbols] = {
+    0, 1, 2, 3, 4, 16384, 24576,
+    0, 1, 2,  3,  4,  5,  6,  7,
+    8, 9, 10, 11, 12, 13, 14, 15};
+const uint64_t max_tries = 1 << 24;
+
+
+// places the predefined symbols into the slots given by the seed, returns false
+// if two of them collide
+bool try_seed(uint64_t seed, int slots[PREDEFINED_TABLE_SIZE]);
+
+// prints the tables of the perfect hash given by seed
+void print_table(uint64_t seed, const int slots[PREDEFINED_TABLE_SIZE]);
+
+int main(void) {
+    int slots[PREDEFINED_TABLE_SIZE];
+    // odd multipliers from a fixed sequence, so the output is reproducible
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    for (uint64_t i = 0; i < max_tries; ++i, seed += 0x6a09e667f3bcc909 << 1) {
+        if (try_seed(seed | 1, slots)) {
+            print_table(seed | 1, slots);
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error: no perfect hash found for the predefined symbols\n");
+    return EXIT_FAILURE;
+}
+
+bool try_seed(uint64_t seed, int slots[PREDEFINED_TABLE_SIZE]) {
+    for (size_t slot = 0; slot < PREDEFINED_TABLE_SIZE; ++slot) {
+        slots[slot] = -1;
+    }
+    for (int i = 0; i < num_symbols; ++i) {
+        uint64_t packed = pack_predefined_key(keys[i], strlen(keys[i]));
+        size_t slot = predefined_slot(packed, seed);
+        if (slots[slot] != -1) { // collision
+            return false;
+        }
+        slots[slot] = i;
+    }
+    return true;
+}
+
+void print_table(uint64_t seed, const int slots[PREDEFINED_TABLE_SIZE]) {
+    printf("// generated by tools/gen_predefined_table, do not edit\n\n");
+    printf("#include \"PredefinedSymbols.h\"\n\n");
+    printf("const uint64_t predefined_seed = 0x%016" PRIx64 ";\n\n", seed);
+    printf("const uint64_t predefined_keys[PREDEFINED_TABLE_SIZE] = {\n");
+    for (size_t slot = 0; slot < PREDEFINED_TABLE_SIZE; ++slot) {
+        if (slots[slot] == -1) {
+            continue;
+        }
+        const char *key = keys[slots[slot]];
+        printf("    [%2zu] = 0x%016" PRIx64 ", // %s\n",
+                slot, pack_predefined_key(key, strlen(key)), key);
+    }
+    printf("};\n\n");
+    printf("const uint16_t predefined_values[PREDEFINED_TABLE_SIZE] = {\n");
+    for (size_t slot = 0; slot < PREDEFINED_TABLE_SIZE; ++slot) {
+        if (slots[slot] == -1) {
+            continue;
+        }
+        printf("    [%2zu] = %" PRIu16 ", // %s\n",
+                slot, values[slots[slot]], keys[slots[slot]]);
+    }
+    printf("};\n");
+}
@@ -0,0 +1,464 @@
+//
+// VM translator for the Hack computer, project 7 and 8 of the nand2tetris
+// course: translates .vm files, or the .vm files of directories, straight
+// into machine words in memory, with no assembly text in between unless it is
+// asked for. Several files are translated in parallel, each into its own
+// relocatable assembly, which are then appended in order
+//
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../CodeWriter.h"
+#include "../HackAssembler.h"
+#include "../Input.h"
+#include "../OptimizedWriter.h"
+#include "../Output.h"
+
+// program options struct
+typedef struct {
+    char *const *in_paths;
+    int num_paths;
+    const char *out_filename; // derived from a single in_path if NULL
+    const char *asm_filename; // assembly text is written to it, if not NULL
+    OutputFormat format;
+    bool bootstrap; // SP=256 and call Sys.init first, always for directories
+                    // and several files
+    bool optimize;  // with the optimizing back end
+    long num_threads;
+} Options;
+
+// translation of a .vm file by a thread, into its own relocatable assembly
+typedef struct FilePart {
+    const char *filename;
+    Assembly *as; // NULL if there was not enough memory for it
+    CodeWriter cw;
+    char *asm_text; // written by cw, if the assembly text is asked for
+    size_t asm_size;
+    bool translated; // without errors
+} FilePart;
+
+// .vm files translated in parallel, and appended in order to a writer once
+// they all are
+typedef struct PartQueue {
+    FilePart *parts;
+    size_t num_parts;
+    const CodeWriter *cw; // the writer they are appended to
+    atomic_size_t next_part;
+} PartQueue;
+
+
+// parses command line arguments, exits on errors
+Options parse_args(int argc, char *argv[]);
+
+// prints to the specified output stream a small description of program usage
+void print_help(FILE *stream, const char *exec_name);
+
+// selects the .vm files of a directory
+int is_vm_file(const struct dirent *entry);
+
+// places into filenames the .vm files of the directory in_dir, in alphabetical
+// order, or in_path alone if it is a file, returns their number, or -1 on
+// errors. The filenames are allocated on the heap
+int list_inputs(const char *in_path, bool *is_dir, char ***filenames);
+
+// places into filenames the .vm files of every path, in order, returns their
+// number, or -1 on errors. any_dir is set if a path is a directory
+int list_all_inputs(char *const *in_paths, int num_paths, bool *any_dir,
+        char ***filenames);
+
+// frees the num_filenames filenames, and their array
+void free_filenames(char **filenames, int num_filenames);
+
+// translates the .vm file filename with the writer, returns false on errors
+bool translate_file(CodeWriter *cw, const char *filename);
+
+// translates the files on num_threads threads, each into its own part, then
+// appends the parts in order to the writer. The result is that of
+// translating them one after the other with it. Returns false on errors
+bool translate_files(CodeWriter *cw, char **filenames, int num_files,
+        long num_threads);
+
+// thread translating the next part of the queue, until none is left
+void *part_worker(void *queue);
+
+// translates the file of the part, in the manner of the writer cw, with the
+// stack top of start cached at its beginning
+void translate_part(FilePart *part, const CodeWriter *cw,
+        const CodeWriter *start);
+
+// frees the assembly, writer and assembly text of the part
+void free_part(FilePart *part);
+
+// creates the output filename from the input path, by replacing the extension
+// of a file, or naming it after a directory, inside it. The output filename
+// is allocated on the heap
+char *make_out_filename(const char *in_path, bool is_dir,
+        const char *extension);
+
+int main(int argc, char *argv[]) {
+    Options opts = parse_args(argc, argv);
+    bool is_dir;
+    char **in_filenames;
+    int num_inputs = list_all_inputs(opts.in_paths, opts.num_paths, &is_dir,
+            &in_filenames);
+    if (num_inputs < 0) {
+        return EXIT_FAILURE;
+    }
+    FILE *asm_file = NULL;
+    if (opts.asm_filename && !(asm_file = fopen(opts.asm_filename, "w"))) {
+        fprintf(stderr, "Error: could not open file for writing: %s\n",
+                opts.asm_filename);
+        return EXIT_FAILURE;
+    }
+    Assembly *as = new_assembly(NULL);
+    CodeWriter cw;
+    if (!as || !init_code_writer(&cw, as, asm_file)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    as->error_stream = stderr;
+    cw.optimize = opts.optimize;
+
+    if (opts.bootstrap || is_dir || opts.num_paths > 1) {
+        write_init(&cw);
+    }
+    bool success = true;
+    if (opts.num_threads > 1 && num_inputs > 1) {
+        success = translate_files(&cw, in_filenames, num_inputs,
+                opts.num_threads);
+    } else {
+        for (int i = 0; i < num_inputs; ++i) {
+            success &= translate_file(&cw, in_filenames[i]);
+        }
+    }
+    success = write_end(&cw) && success;
+    if (asm_file && fclose(asm_file)) {
+        fprintf(stderr, "Error: could not write file: %s\n",
+                opts.asm_filename);
+        success = false;
+    }
+    if (!success) {
+        return EXIT_FAILURE;
+    }
+    resolve_variables(as);
+
+    char *out_filename = opts.out_filename ? strdup(opts.out_filename)
+        : make_out_filename(opts.in_paths[0], is_dir,
+                format_extensions[opts.format]);
+    FILE *out_file = fopen(out_filename, "w");
+    if (!out_file) {
+        fprintf(stderr, "Error: could not open file for writing: %s\n",
+                out_filename);
+        return EXIT_FAILURE;
+    }
+    success = write_words(out_file, opts.format, as->words, as->num_words);
+    if (fclose(out_file) || !success) {
+        fprintf(stderr, "Error: could not write file: %s\n", out_filename);
+        return EXIT_FAILURE;
+    }
+    free_code_writer(&cw);
+    delete_assembly(as);
+    free_filenames(in_filenames, num_inputs);
+    free(out_filename);
+    return EXIT_SUCCESS;
+}
+
+Options parse_args(int argc, char *argv[]) {
+    Options opts = {.format = FORMAT_TEXT,
+        .num_threads = sysconf(_SC_NPROCESSORS_ONLN)};
+    int optchar;
+    char *end; // of a number
+    while ((optchar = getopt(argc, argv, "ho:a:bOf:j:")) != -1) {
+        switch (optchar) {
+            case 'h': // print help
+                print_help(stdout, argv[0]);
+                exit(EXIT_SUCCESS);
+            case 'o': // specify output file
+                opts.out_filename = optarg;
+                break;
+            case 'a': // also write the assembly text
+                opts.asm_filename = optarg;
+                break;
+            case 'b': // write the bootstrap code for a single file
+                opts.bootstrap = true;
+                break;
+            case 'O': // optimize the code
+                opts.optimize = true;
+                break;
+            case 'j': // specify number of threads
+                opts.num_threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || opts.num_threads < 1) {
+                    fprintf(stderr, "Invalid number of threads: %s\n",
+                            optarg);
+                    print_help(stderr, argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f': // specify output format
+                if (!parse_output_format(optarg, &opts.format)
+                        || opts.format == FORMAT_OBJECT) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    print_help(stderr, argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                print_help(stderr, argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    opts.in_paths = argv + optind;
+    opts.num_paths = argc - optind;
+    if (opts.num_paths < 1 || (opts.num_paths > 1 && !opts.out_filename)) {
+        print_help(stderr, argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (opts.num_threads < 1) {
+        opts.num_threads = 1;
+    }
+    return opts;
+}
+
+void print_help(FILE *stream, const char *exec_name) {
+    fprintf(stream, "Usage: %s: ", exec_name);
+    fprintf(stream, "[-h] [-b] [-O] [-j num_threads] [-a asm_file] "
+            "[-f format] [-o out_file] in_file.vm|in_dir...\n");
+    fprintf(stream, "-a also writes the assembly, -b writes the bootstrap "
+            "code, as for a directory\n   or several files, which need -o\n");
+    fprintf(stream, "-j translates the files on num_threads threads, into the "
+            "same output\n");
+    fprintf(stream, "-O caches the stack top in D, folds constants and "
+            "comparisons, and shares the\n   code of calls and returns\n");
+}
+
+int is_vm_file(const struct dirent *entry) {
+    const char *extension = strrchr(entry->d_name, '.');
+    return extension && !strcmp(extension, ".vm");
+}
+
+int list_inputs(const char *in_path, bool *is_dir, char ***filenames) {
+    struct stat path_stat;
+    *is_dir = !stat(in_path, &path_stat) && S_ISDIR(path_stat.st_mode);
+    if (!*is_dir) {
+        *filenames = malloc(sizeof(**filenames));
+        if (!*filenames || !((*filenames)[0] = strdup(in_path))) {
+            free(*filenames);
+            fprintf(stderr, "Error: out of memory\n");
+            return -1;
+        }
+        return 1;
+    }
+    struct dirent **entries;
+    int num_entries = scandir(in_path, &entries, is_vm_file, alphasort);
+    if (num_entries < 0) {
+        fprintf(stderr, "Error: could not read directory: %s\n", in_path);
+        return -1;
+    }
+    *filenames = malloc((num_entries ? num_entries : 1)*sizeof(**filenames));
+    int num_filenames = 0;
+    for (int i = 0; i < num_entries; ++i) {
+        char *filename = *filenames ? malloc(strlen(in_path)
+                + strlen(entries[i]->d_name) + 2) : NULL;
+        if (filename) {
+            sprintf(filename, "%s/%s", in_path, entries[i]->d_name);
+            (*filenames)[num_filenames++] = filename;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    if (!*filenames || num_filenames < num_entries) {
+        free_filenames(*filenames, num_filenames);
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+    return num_entries;
+}
+
+int list_all_inputs(char *const *in_paths, int num_paths, bool *any_dir,
+        char ***filenames) {
+    *any_dir = false;
+    *filenames = NULL;
+    int num_filenames = 0;
+    for (int i = 0; i < num_paths; ++i) {
+        bool is_dir;
+        char **path_filenames;
+        int num_path_filenames = list_inputs(in_paths[i], &is_dir,
+                &path_filenames);
+        if (num_path_filenames < 0) {
+            free_filenames(*filenames, num_filenames);
+            return -1;
+        }
+        *any_dir |= is_dir;
+        char **grown = realloc(*filenames, (num_filenames
+                    + num_path_filenames + 1)*sizeof(**filenames));
+        if (!grown) {
+            free_filenames(path_filenames, num_path_filenames);
+            free_filenames(*filenames, num_filenames);
+            fprintf(stderr, "Error: out of memory\n");
+            return -1;
+        }
+        *filenames = grown;
+        memcpy(*filenames + num_filenames, path_filenames,
+                num_path_filenames*sizeof(**filenames));
+        num_filenames += num_path_filenames;
+        free(path_filenames);
+    }
+    return num_filenames;
+}
+
+void free_filenames(char **filenames, int num_filenames) {
+    for (int i = 0; i < num_filenames; ++i) {
+        free(filenames[i]);
+    }
+    free(filenames);
+}
+
+bool translate_file(CodeWriter *cw, const char *filename) {
+    FILE *in_file = fopen(filename, "r");
+    InputBuffer input;
+    if (!in_file || !open_input(in_file, &input)) {
+        fprintf(stderr, "Error: could not open file for reading: %s\n",
+                filename);
+        if (in_file) {
+            fclose(in_file);
+        }
+        return false;
+    }
+    bool success = translate_buffer(cw, input.data, input.size, filename);
+    close_input(&input);
+    fclose(in_file);
+    return success;
+}
+
+bool translate_files(CodeWriter *cw, char **filenames, int num_files,
+        long num_threads) {
+    PartQueue queue = {.parts = calloc(num_files, sizeof(*queue.parts)),
+        .num_parts = num_files, .cw = cw};
+    if (!queue.parts) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    atomic_init(&queue.next_part, 0);
+    for (int i = 0; i < num_files; ++i) {
+        queue.parts[i].filename = filenames[i];
+    }
+    if (num_threads > num_files) {
+        num_threads = num_files;
+    }
+    pthread_t *threads = malloc(num_threads*sizeof(*threads));
+    long num_started = 0;
+    while (threads && num_started < num_threads
+            && !pthread_create(&threads[num_started], NULL, part_worker,
+                &queue)) {
+        ++num_started;
+    }
+    if (num_started < num_threads) { // the parts left are translated here
+        part_worker(&queue);
+    }
+    for (long i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    // every file but the first was translated from an empty stack top, it is
+    // translated again in the rare case the file before left one cached
+    const CodeWriter in_memory = {.top = TOP_IN_MEMORY};
+    bool success = true;
+    for (int i = 0; i < num_files; ++i) {
+        FilePart *part = &queue.parts[i];
+        if (i > 0 && !same_stack_top(cw, &in_memory)) {
+            free_part(part);
+            translate_part(part, cw, cw);
+        }
+        if (!part->as) {
+            fprintf(stderr, "Error: out of memory\n");
+            success = false;
+            continue;
+        }
+        if (cw->asm_file && part->asm_size > 0) {
+            fwrite(part->asm_text, 1, part->asm_size, cw->asm_file);
+        }
+        success = append_translation(cw, &part->cw) && part->translated
+            && success;
+        free_part(part);
+    }
+    free(queue.parts);
+    return success;
+}
+
+void *part_worker(void *queue_ptr) {
+    PartQueue *queue = queue_ptr;
+    const CodeWriter in_memory = {.top = TOP_IN_MEMORY};
+    size_t i;
+    while ((i = atomic_fetch_add(&queue->next_part, 1)) < queue->num_parts) {
+        translate_part(&queue->parts[i], queue->cw,
+                i == 0 ? queue->cw : &in_memory);
+    }
+    return NULL;
+}
+
+void translate_part(FilePart *part, const CodeWriter *cw,
+        const CodeWriter *start) {
+    FILE *asm_file = NULL;
+    part->as = new_assembly(NULL);
+    if (!part->as || (cw->asm_file && !(asm_file = open_memstream(
+                        &part->asm_text, &part->asm_size)))
+            || !init_code_writer(&part->cw, part->as, asm_file)) {
+        if (asm_file) {
+            fclose(asm_file);
+        }
+        free_part(part);
+        return;
+    }
+    part->as->relocatable = true; // its labels are placed when appended
+    part->cw.optimize = cw->optimize;
+    copy_stack_top(&part->cw, start);
+    part->translated = translate_file(&part->cw, part->filename);
+    if (asm_file) {
+        fclose(asm_file);
+        part->cw.asm_file = NULL;
+    }
+}
+
+void free_part(FilePart *part) {
+    if (part->cw.as) {
+        free_code_writer(&part->cw);
+    }
+    if (part->as) {
+        delete_assembly(part->as);
+    }
+    free(part->asm_text);
+    *part = (FilePart) {.filename = part->filename};
+}
+
+char *make_out_filename(const char *in_path, bool is_dir,
+        const char *extension) {
+    size_t path_len = strlen(in_path);
+    while (path_len > 1 && in_path[path_len-1] == '/') {
+        --path_len;
+    }
+    const char *base = in_path + path_len;
+    while (base != in_path && base[-1] != '/') {
+        --base;
+    }
+    size_t base_len = in_path + path_len - base;
+    // room for the path, a '/', the base name again, a '.', and the '\0'
+    char *out_filename = malloc(2*path_len + strlen(extension) + 3);
+    if (is_dir) {
+        sprintf(out_filename, "%.*s/%.*s.%s", (int)path_len, in_path,
+                (int)base_len, base, extension);
+        return out_filename;
+    }
+    const char *dot = strrchr(base, '.');
+    size_t stem_len = (dot ? dot : in_path + path_len) - in_path;
+    sprintf(out_filename, "%.*s.%s", (int)stem_len, in_path, extension);
+    return out_filename;
+}